@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16 // Enough for anything we put in there
+
+static arena_chunk_t *arena_new_chunk(size_t size) {
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    return chunk;
+}
+
+/* Set up the arena with its first chunk.
+* Returns 0 for success, 1 if the chunk could not be allocated.
+*/
+int arena_init(arena_t *arena, size_t chunkSize) {
+    arena->chunkSize = chunkSize;
+    arena->head = arena_new_chunk(chunkSize);
+    if (arena->head == NULL) {
+        return 1;
+    }
+    arena->current = arena->head;
+    arena->used = 0;
+    return 0;
+}
+
+/* Hand out size bytes, aligned to ARENA_ALIGN.
+* Moves on to the next kept chunk when the current one is full and only mallocs when we run out of kept chunks.
+* Returns NULL if that malloc fails.
+*/
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    while (arena->used + size > arena->current->size) {
+        arena_chunk_t *next = arena->current->next;
+        if (next == NULL || next->size < size) {
+            // New chunk goes right after the current one, any smaller kept chunks stay after it for later
+            size_t chunkSize = (size > arena->chunkSize) ? size : arena->chunkSize;
+            arena_chunk_t *chunk = arena_new_chunk(chunkSize);
+            if (chunk == NULL) {
+                return NULL;
+            }
+            chunk->next = next;
+            arena->current->next = chunk;
+            next = chunk;
+        }
+        arena->current = next;
+        arena->used = 0;
+    }
+    void *ptr = arena->current->data + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+char *arena_strndup(arena_t *arena, const char *s, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char *arena_strdup(arena_t *arena, const char *s) {
+    return arena_strndup(arena, s, strlen(s));
+}
+
+/* Give back everything at once, O(1), the chunks are kept for the next line
+*/
+void arena_reset(arena_t *arena) {
+    arena->current = arena->head;
+    arena->used = 0;
+}
+
+/* Free every chunk
+*/
+void arena_destroy(arena_t *arena) {
+    arena_chunk_t *chunk = arena->head;
+    while (chunk != NULL) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = arena->current = NULL;
+    arena->used = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator for everything that only lives as long as one line (tokens, command_t's, argument lists)
+ * Nothing is freed one at a time, arena_reset gives all of it back at once and keeps the chunks,
+ * so once the chunks are big enough for the longest line a line costs no malloc at all
+ */
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;            // Usable bytes in data
+    char data[];
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *head;    // First chunk, a reset goes back to it
+    arena_chunk_t *current; // Chunk we are bumping through
+    size_t used;            // Bytes handed out from current
+    size_t chunkSize;       // Size of new chunks unless one allocation needs more
+} arena_t;
+
+int arena_init(arena_t *arena, size_t chunkSize);
+void *arena_alloc(arena_t *arena, size_t size);
+char *arena_strdup(arena_t *arena, const char *s);
+char *arena_strndup(arena_t *arena, const char *s, size_t len);
+void arena_reset(arena_t *arena);
+void arena_destroy(arena_t *arena);
+
+#endif
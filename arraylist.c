@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <assert.h>
 #include "arraylist.h"
 
@@ -15,6 +16,22 @@ int al_init(arraylist_t *l, unsigned int cap) {
     } 
     l->capacity = cap;
     l->length = 0;
+    l->arena = NULL;
+    return 0;
+}
+/* Same as al_init but the storage array comes from arena, so there is nothing to destroy afterwards.
+* Growing it takes a new array from the arena, the old one is just left there until the arena is reset.
+*/
+int al_init_arena(arraylist_t *l, unsigned int cap, arena_t *arena) {
+    assert(l != NULL);
+    assert(cap > 0);
+    l->data = arena_alloc(arena, cap * sizeof(char *));
+    if (l->data == NULL) {
+        return 1;
+    }
+    l->capacity = cap;
+    l->length = 0;
+    l->arena = arena;
     return 0;
 }
 /* Free storage array.
@@ -22,7 +39,9 @@ int al_init(arraylist_t *l, unsigned int cap) {
 */
 int al_destroy(arraylist_t *l){
     assert(l != NULL);
-    free(l->data);
+    if (l->arena == NULL) {
+        free(l->data);
+    }
     return 0;
 }
 /* Free all strings in list and set length to 0.
@@ -34,6 +53,14 @@ int al_clear(arraylist_t *l)
     l->length = 0;
     return 0;
 }
+/* Set length to 0 without freeing anything, for lists whose strings live in an arena.
+*/
+int al_reset(arraylist_t *l)
+{
+    assert(l != NULL);
+    l->length = 0;
+    return 0;
+}
 /* Add item to end of list, increasing storage as needed.
 * Returns 0 for success, 1 if the storage could not be increased.
 * Note: does not make a copy of the string.
@@ -44,7 +71,13 @@ int al_append(arraylist_t *l, char *item) {
     if (l->length == l->capacity) {
     // increase the underlying storage
         unsigned int newcap = l->capacity * 2;
-        char **new = realloc(l->data, newcap * sizeof(char *));
+        char **new;
+        if (l->arena != NULL) {
+            new = arena_alloc(l->arena, newcap * sizeof(char *));
+            if (new != NULL) memcpy(new, l->data, l->length * sizeof(char *));
+        } else {
+            new = realloc(l->data, newcap * sizeof(char *));
+        }
         if (new == NULL) return 1;
             l->data = new;
             l->capacity = newcap;
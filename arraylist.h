@@ -1,13 +1,18 @@
 #ifndef ARRAYLIST_H
 #define ARRAYLIST_H
 
+#include "arena.h"
+
 typedef struct {
     char **data;
     unsigned int capacity;
     unsigned int length;
+    arena_t *arena;         // NULL for malloc'd storage, otherwise storage comes from (and dies with) this arena
 } arraylist_t;
 
 int al_init(arraylist_t *list, unsigned int cap);
+int al_init_arena(arraylist_t *list, unsigned int cap, arena_t *arena);
+int al_reset(arraylist_t *list);
 int al_destroy(arraylist_t *list);
 int al_clear(arraylist_t *list);
 int al_append(arraylist_t *list, char *item);
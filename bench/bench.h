@@ -0,0 +1,89 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Helpers shared by the benchmarks in bench/, header only so every benchmark stays a single .c file
+ * Every result is printed as one JSON object per line so runs can be diffed and scraped
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+    long long *data;
+    int length;
+    int capacity;
+} bench_samples_t;
+
+static inline long long bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void bench_init(bench_samples_t *s, int capacity) {
+    s->data = malloc(capacity * sizeof(long long));
+    if (s->data == NULL) {
+        perror("malloc failed in bench_init");
+        exit(EXIT_FAILURE);
+    }
+    s->length = 0;
+    s->capacity = capacity;
+}
+
+static void bench_add(bench_samples_t *s, long long ns) {
+    if (s->length == s->capacity) {
+        s->capacity *= 2;
+        s->data = realloc(s->data, s->capacity * sizeof(long long));
+        if (s->data == NULL) {
+            perror("realloc failed in bench_add");
+            exit(EXIT_FAILURE);
+        }
+    }
+    s->data[s->length++] = ns;
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank percentile, samples must already be sorted
+static long long bench_pct(const bench_samples_t *s, double pct) {
+    int idx = (int)(pct / 100.0 * s->length + 0.5) - 1;
+    if (idx < 0) {
+        idx = 0;
+    }
+    if (idx >= s->length) {
+        idx = s->length - 1;
+    }
+    return s->data[idx];
+}
+
+/* Print one result line, extra is spliced in as more JSON fields (like "\"heap_mb\":256") or NULL
+* Sorts the samples in place
+*/
+static void bench_report(const char *bench, const char *caseName, const char *extra, bench_samples_t *s) {
+    if (s->length == 0) {
+        return;
+    }
+    qsort(s->data, s->length, sizeof(long long), bench_cmp);
+    double sum = 0;
+    for (int i = 0; i < s->length; i++) {
+        sum += s->data[i];
+    }
+    printf("{\"bench\":\"%s\",\"case\":\"%s\",%s%s\"unit\":\"ns\",\"n\":%d,\"min\":%lld,\"median\":%lld,"
+           "\"p90\":%lld,\"p99\":%lld,\"max\":%lld,\"mean\":%.0f}\n",
+           bench, caseName, extra ? extra : "", extra ? "," : "", s->length, s->data[0],
+           bench_pct(s, 50), bench_pct(s, 90), bench_pct(s, 99), s->data[s->length - 1], sum / s->length);
+    fflush(stdout);
+}
+
+static void bench_free(bench_samples_t *s) {
+    free(s->data);
+    s->data = NULL;
+    s->length = s->capacity = 0;
+}
+
+#endif
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE // For copy_file_range
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/wait.h>
+#include <linux/fs.h>
+#include "bench.h"
+#include "../zerocopy.h"
+
+/*
+ * Throughput of copying one big file to another, every sample is one whole copy into a fresh file
+ *  read_write:      a 128 KB read/write loop, every byte comes up to user space and goes back down
+ *  sendfile:        what zc_copy did before for file to file
+ *  copy_file_range: the data stays in the kernel (and on the disk, for filesystems that can copy there)
+ *  ficlone:         a reflink of the whole file, only on filesystems that share blocks (btrfs, XFS), skipped elsewhere
+ *  zc_copy:         what the cat and cp builtins use, whichever of the above the two fds allow
+ *  mysh_cp:         ./mysh running cp src dst, the builtin, with the shell's startup
+ *  cp:              ./mysh running /bin/cp src dst, the external program, for comparison
+ * The copies go to the page cache, nothing is synced, so this is the cost of the copy and not of the disk
+ * usage: copybench [megabytes] [passes] [dir] [mysh]
+ */
+
+enum { READ_WRITE, SENDFILE, COPY_FILE_RANGE, FICLONE_CASE, ZC_COPY };
+
+static char srcPath[4096], dstPath[4096], scriptPath[4096];
+
+static int copyOnce(int kind, int in, int out, off_t size) {
+    if (kind == READ_WRITE) {
+        static char buf[128 * 1024];
+        ssize_t n;
+        while ((n = read(in, buf, sizeof(buf))) > 0) {
+            if (write(out, buf, n) != n) {
+                return -1;
+            }
+        }
+        return (int)n;
+    }
+    if (kind == SENDFILE) {
+        off_t left = size;
+        while (left > 0) {
+            ssize_t n = sendfile(out, in, NULL, left);
+            if (n <= 0) {
+                return -1;
+            }
+            left -= n;
+        }
+        return 0;
+    }
+    if (kind == COPY_FILE_RANGE) {
+        off_t left = size;
+        while (left > 0) {
+            ssize_t n = copy_file_range(in, NULL, out, NULL, left, 0);
+            if (n <= 0) {
+                return -1;
+            }
+            left -= n;
+        }
+        return 0;
+    }
+    if (kind == FICLONE_CASE) {
+        return ioctl(out, FICLONE, in);
+    }
+    return zc_copy(in, out);
+}
+
+static void report(const char *caseName, bench_samples_t *s, long long bytes) {
+    char extra[128];
+    qsort(s->data, s->length, sizeof(long long), bench_cmp);
+    snprintf(extra, sizeof(extra), "\"bytes\":%lld,\"gb_per_sec\":%.2f,\"per\":\"copy\"", bytes, bytes / (double)bench_pct(s, 50));
+    bench_report("copy", caseName, extra, s);
+    bench_free(s);
+}
+
+static void runCase(const char *caseName, int kind, int passes, off_t size) {
+    bench_samples_t s;
+    bench_init(&s, passes);
+    for (int p = 0; p < passes; p++) {
+        int in = open(srcPath, O_RDONLY);
+        int out = open(dstPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (in < 0 || out < 0) {
+            perror("copybench: open");
+            exit(EXIT_FAILURE);
+        }
+        long long start = bench_now_ns();
+        int result = copyOnce(kind, in, out, size);
+        long long ns = bench_now_ns() - start;
+        int err = errno;
+        close(in);
+        close(out);
+        unlink(dstPath);
+        if (result != 0) {
+            if (kind == FICLONE_CASE) {
+                fprintf(stderr, "copybench: no reflinks here (%s), ficlone skipped\n", strerror(err));
+                bench_free(&s);
+                return;
+            }
+            fprintf(stderr, "copybench: %s failed: %s\n", caseName, strerror(err));
+            exit(EXIT_FAILURE);
+        }
+        bench_add(&s, ns);
+    }
+    report(caseName, &s, size);
+}
+
+// ./mysh with a one line script, every sample is the whole run of the shell
+static void runShell(const char *caseName, const char *mysh, const char *line, int passes, off_t size) {
+    FILE *f = fopen(scriptPath, "w");
+    if (f == NULL) {
+        perror(scriptPath);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(f, "%s %s %s\n", line, srcPath, dstPath);
+    fclose(f);
+    bench_samples_t s;
+    bench_init(&s, passes);
+    for (int p = 0; p < passes; p++) {
+        long long start = bench_now_ns();
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl(mysh, mysh, scriptPath, (char *)NULL);
+            _exit(127);
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "copybench: %s failed\n", caseName);
+            exit(EXIT_FAILURE);
+        }
+        bench_add(&s, bench_now_ns() - start);
+        unlink(dstPath);
+    }
+    report(caseName, &s, size);
+}
+
+int main(int argc, char *argv[]) {
+    long long megabytes = argc > 1 ? atoll(argv[1]) : 4096;
+    int passes = argc > 2 ? atoi(argv[2]) : 3;
+    const char *dir = argc > 3 ? argv[3] : "/tmp";
+    const char *mysh = argc > 4 ? argv[4] : "./mysh";
+    snprintf(srcPath, sizeof(srcPath), "%s/copybench-src", dir);
+    snprintf(dstPath, sizeof(dstPath), "%s/copybench-dst", dir);
+    snprintf(scriptPath, sizeof(scriptPath), "%s/copybench.txt", dir);
+
+    // Not all zeros, so no filesystem can get away with a hole
+    int fd = open(srcPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    static char chunk[1024 * 1024];
+    for (size_t i = 0; i < sizeof(chunk); i++) {
+        chunk[i] = (char)(i * 2654435761u >> 13);
+    }
+    for (long long m = 0; fd >= 0 && m < megabytes; m++) {
+        chunk[0] = (char)m;
+        if (write(fd, chunk, sizeof(chunk)) != (ssize_t)sizeof(chunk)) {
+            perror("copybench: writing the source");
+            unlink(srcPath);
+            return EXIT_FAILURE;
+        }
+    }
+    if (fd < 0 || close(fd) != 0) {
+        perror(srcPath);
+        return EXIT_FAILURE;
+    }
+    off_t size = megabytes * sizeof(chunk);
+
+    runCase("read_write", READ_WRITE, passes, size);
+    runCase("sendfile", SENDFILE, passes, size);
+    runCase("copy_file_range", COPY_FILE_RANGE, passes, size);
+    runCase("ficlone", FICLONE_CASE, passes, size);
+    runCase("zc_copy", ZC_COPY, passes, size);
+    if (access(mysh, X_OK) == 0) {
+        runShell("mysh_cp", mysh, "cp", passes, size);
+        runShell("cp", mysh, "/bin/cp", passes, size);
+    } else {
+        fprintf(stderr, "copybench: %s is not there, build it first (make), the shell cases are skipped\n", mysh);
+    }
+    unlink(srcPath);
+    unlink(scriptPath);
+    return 0;
+}
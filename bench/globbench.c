@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "../arena.h"
+#include "../vec.h"
+#include "../wildcard.h"
+
+/*
+ * wild_expand of *.log in flat directories of 1k, 100k and 1M entries, one in ten of them a .log
+ * cold drops the listing cache before every sample so the directory is read each time (from the page cache),
+ * cached is what a script globbing the same directory line after line sees
+ * The directories are made once in /tmp and kept (a .globbench file in each says it is complete)
+ * usage: globbench [passes] [entries ...]
+ */
+
+static void makeDir(const char *dir, long entries) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/.globbench", dir);
+    if (access(path, F_OK) == 0) {
+        return;
+    }
+    fprintf(stderr, "making %ld files in %s\n", entries, dir);
+    mkdir(dir, 0755);
+    for (long i = 0; i < entries; i++) {
+        snprintf(path, sizeof(path), "%s/f%07ld.%s", dir, i, (i % 10 == 0) ? "log" : "txt");
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+    snprintf(path, sizeof(path), "%s/.globbench", dir);
+    close(open(path, O_WRONLY | O_CREAT, 0644));
+}
+
+static void run(const char *caseName, const char *pattern, long entries, int passes, int cold) {
+    bench_samples_t s;
+    bench_init(&s, passes);
+    int matches = 0;
+    for (int p = 0; p <= passes; p++) {
+        arena_t arena;
+        strvec_t out;
+        arena_init(&arena, 1 << 20);
+        strvec_init(&out, &arena);
+        strvec_reserve(&out, 1024);
+        if (cold) {
+            wild_flush();
+        }
+        long long start = bench_now_ns();
+        matches = wild_expand(pattern, &arena, &out);
+        long long ns = bench_now_ns() - start;
+        if (p > 0) { // The first one warms the page cache (and the listing cache for the cached case)
+            bench_add(&s, ns);
+        }
+        arena_destroy(&arena);
+    }
+    char extra[128];
+    snprintf(extra, sizeof(extra), "\"entries\":%ld,\"matches\":%d", entries, matches);
+    bench_report("glob", caseName, extra, &s);
+    bench_free(&s);
+}
+
+int main(int argc, char *argv[]) {
+    int passes = argc > 1 ? atoi(argv[1]) : 10;
+    long defaultSizes[] = {1000, 100000, 1000000};
+    int sizeCount = argc > 2 ? argc - 2 : 3;
+    for (int i = 0; i < sizeCount; i++) {
+        long entries = argc > 2 ? atol(argv[i + 2]) : defaultSizes[i];
+        char dir[256], pattern[300];
+        snprintf(dir, sizeof(dir), "/tmp/globbench-%ld", entries);
+        snprintf(pattern, sizeof(pattern), "%s/*.log", dir);
+        makeDir(dir, entries);
+        run("cold", pattern, entries, passes, 1);
+        run("cached", pattern, entries, passes, 0);
+    }
+    return 0;
+}
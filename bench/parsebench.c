@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../arena.h"
+#include "../tokenizer.h"
+#include "../command.h"
+
+/*
+ * Parser throughput, tok_split + parseCommand on every line the way processCommand does it, without running anything
+ * Every case is a script of one kind of line (or all of them mixed), the line arena is reset after every line like in mysh
+ * usage: parsebench [lines] [passes]
+ */
+
+static const char *simpleLines[] = {"ls -l /tmp", "cd ..", "echo hello world", "pwd"};
+static const char *pipeLines[] = {"ls -l | grep txt | wc -l", "cat log.txt | sort | uniq -c | sort -n | tail"};
+static const char *redirectLines[] = {"sort < in.txt > out.txt", "grep -v # < input.c > output.c"};
+static const char *condLines[] = {"and echo ok", "or cat errors.txt | tail -5 > last.txt"};
+static const char *globLines[] = {"ls *.c src/*.h", "wc -l test?/out[0-9].*"};
+
+typedef struct {
+    const char *name;
+    const char **lines;
+    int count;
+} line_kind_t;
+
+static char *makeScript(const line_kind_t *kinds, int kindCount, long lines, size_t *len) {
+    size_t cap = 4096, used = 0;
+    char *script = malloc(cap);
+    for (long i = 0; i < lines && script != NULL; i++) {
+        const line_kind_t *k = &kinds[i % kindCount];
+        const char *line = k->lines[(i / kindCount) % k->count];
+        size_t n = strlen(line);
+        if (used + n + 2 > cap) {
+            cap *= 2;
+            script = realloc(script, cap);
+            if (script == NULL) {
+                break;
+            }
+        }
+        memcpy(script + used, line, n);
+        used += n;
+        script[used++] = '\n';
+    }
+    if (script == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    *len = used;
+    return script;
+}
+
+// One pass over the script, returns how many lines parsed
+static long pass(const char *script, size_t len, char *line, toklist_t *tokens, arena_t *arena) {
+    long parsed = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (script[i] != '\n') {
+            continue;
+        }
+        memcpy(line, script + start, i - start);
+        line[i - start] = '\0';
+        if (tok_split(tokens, line, i - start) != 0) {
+            perror("tok_split");
+            exit(EXIT_FAILURE);
+        }
+        if (tokens->length > 0 && parseCommand(tokens, line, arena) != NULL) {
+            parsed++;
+        }
+        arena_reset(arena);
+        start = i + 1;
+    }
+    return parsed;
+}
+
+static void run(const char *caseName, const line_kind_t *kinds, int kindCount, long lines, int passes,
+                toklist_t *tokens, arena_t *arena, char *line) {
+    size_t len;
+    char *script = makeScript(kinds, kindCount, lines, &len);
+    bench_samples_t s;
+    bench_init(&s, passes);
+    long parsed = 0;
+    for (int p = 0; p < passes; p++) {
+        long long start = bench_now_ns();
+        parsed = pass(script, len, line, tokens, arena);
+        bench_add(&s, bench_now_ns() - start);
+    }
+    qsort(s.data, s.length, sizeof(long long), bench_cmp);
+    char extra[128];
+    snprintf(extra, sizeof(extra), "\"lines\":%ld,\"parsed\":%ld,\"lines_per_sec\":%.0f", lines, parsed,
+             lines / (bench_pct(&s, 50) / 1e9));
+    bench_report("parser", caseName, extra, &s);
+    bench_free(&s);
+    free(script);
+}
+
+int main(int argc, char *argv[]) {
+    long lines = argc > 1 ? atol(argv[1]) : 1000000;
+    int passes = argc > 2 ? atoi(argv[2]) : 5;
+    line_kind_t kinds[] = {
+        {"simple", simpleLines, 4},
+        {"pipeline", pipeLines, 2},
+        {"redirect", redirectLines, 2},
+        {"condition", condLines, 2},
+        {"wildcard", globLines, 2},
+    };
+    int kindCount = sizeof(kinds) / sizeof(kinds[0]);
+    toklist_t tokens;
+    arena_t arena;
+    char *line = malloc(4096);
+    if (line == NULL || tok_init(&tokens, 40) != 0 || arena_init(&arena, 16 * 1024) != 0) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    for (int k = 0; k < kindCount; k++) {
+        run(kinds[k].name, &kinds[k], 1, lines, passes, &tokens, &arena, line);
+    }
+    run("mixed", kinds, kindCount, lines, passes, &tokens, &arena, line);
+    tok_destroy(&tokens);
+    arena_destroy(&arena);
+    free(line);
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "../arena.h"
+#include "../vec.h"
+#include "../wildcard.h"
+
+/*
+ * Every .log file at any depth of a generated tree (root, then **, then *.log), with 1 thread and then more reading directories (MYSH_GLOB_THREADS)
+ * The tree is 10x10x10 directories with the files spread over the leaves, one in ten of them a .log
+ * It is made once and kept (a .rglobbench-N file in it says how many files it has), so the runs after the first
+ * are with the directories in the page cache
+ * usage: rglobbench [files] [dir] [passes], 1000000 files in /tmp/rglobbench-tree by default
+ */
+
+static void makeTree(const char *root, long files) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/.rglobbench-%ld", root, files);
+    if (access(path, F_OK) == 0) {
+        return;
+    }
+    fprintf(stderr, "making %ld files in %s\n", files, root);
+    mkdir(root, 0755);
+    long perLeaf = (files + 999) / 1000, made = 0;
+    for (int leaf = 0; leaf < 1000 && made < files; leaf++) {
+        snprintf(path, sizeof(path), "%s/d%d", root, leaf / 100);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/d%d/d%d", root, leaf / 100, leaf / 10 % 10);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/d%d/d%d/d%d", root, leaf / 100, leaf / 10 % 10, leaf % 10);
+        mkdir(path, 0755);
+        for (long i = 0; i < perLeaf && made < files; i++, made++) {
+            char file[4096 + 32];
+            snprintf(file, sizeof(file), "%s/f%ld.%s", path, i, (i % 10 == 0) ? "log" : "txt");
+            int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                perror(file);
+                exit(EXIT_FAILURE);
+            }
+            close(fd);
+        }
+    }
+    snprintf(path, sizeof(path), "%s/.rglobbench-%ld", root, files);
+    close(open(path, O_WRONLY | O_CREAT, 0644));
+}
+
+int main(int argc, char **argv) {
+    long files = (argc > 1) ? atol(argv[1]) : 1000000;
+    const char *root = (argc > 2) ? argv[2] : "/tmp/rglobbench-tree";
+    int passes = (argc > 3) ? atoi(argv[3]) : 5;
+    makeTree(root, files);
+
+    char pattern[4096];
+    snprintf(pattern, sizeof(pattern), "%s/**/*.log", root);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threadCounts[] = {1, 2, 4, 8, 16};
+    for (int t = 0; t < 5; t++) {
+        int threads = threadCounts[t];
+        if (threads > 1 && threads > cpus) {
+            break;
+        }
+        char env[16];
+        snprintf(env, sizeof(env), "%d", threads);
+        setenv("MYSH_GLOB_THREADS", env, 1);
+
+        bench_samples_t s;
+        bench_init(&s, passes);
+        int matches = 0;
+        for (int pass = 0; pass <= passes; pass++) {
+            arena_t arena;
+            strvec_t out;
+            arena_init(&arena, 1 << 20);
+            strvec_init(&out, &arena);
+            strvec_reserve(&out, 1024);
+            long long start = bench_now_ns();
+            matches = wild_expand(pattern, &arena, &out);
+            long long ns = bench_now_ns() - start;
+            if (pass > 0) { // The first one warms the page cache
+                bench_add(&s, ns);
+            }
+            arena_destroy(&arena);
+        }
+        char extra[128];
+        snprintf(extra, sizeof(extra), "\"threads\":%d,\"files\":%ld,\"matches\":%d", threads, files, matches);
+        bench_report("rglob", "star_star_log", extra, &s);
+        bench_free(&s);
+    }
+    return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/sh
+# Runs every benchmark, one JSON object per result line on stdout and appended to $BENCH_OUT (bench/results.jsonl)
+# BENCH_QUICK=1 uses small sizes so the whole suite takes seconds instead of minutes (no 1M file trees)
+cd "$(dirname "$0")/.." || exit 1
+out=${BENCH_OUT:-bench/results.jsonl}
+
+if [ -n "$BENCH_QUICK" ]; then
+    set -- "tokbench 8 3" "scanbench 8 3" "parsebench 100000 3" "vecbench 100000 3" "globbench 5 1000 100000" \
+           "rglobbench 100000 /tmp/rglobbench-quick 3" "spawnbench 200 0" "shellbench ./mysh 300 3 8" \
+           "servebench ./mysh ./mysh-client 200" "copybench 64 3"
+else
+    set -- "tokbench" "scanbench" "parsebench" "vecbench" "globbench" "rglobbench" "spawnbench" "shellbench ./mysh" "servebench" "copybench"
+fi
+
+for b in "$@"; do
+    # shellcheck disable=SC2086
+    ./bench/$b | tee -a "$out" || exit 1
+done
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "bench.h"
+#include "../scan.h"
+#include "../tokenizer.h"
+
+/*
+ * The scan.c kernels against the loops process_lines and seperateWords used to have (one byte at a time, isspace)
+ * lines: find every newline of the script, words: tok_split every line (copied into a line buffer first, like mysh does)
+ * Two scripts, short lines like a normal batch file and very long lines with long words
+ * usage: scanbench [scriptMB] [passes]
+ */
+
+static volatile size_t sink; // Keeps the compiler from dropping the loops
+
+static char *makeScript(size_t size, int longLines) {
+    char *script = malloc(size);
+    if (script == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    unsigned int seed = 4242;
+    size_t len = 0, lineStart = 0;
+    size_t lineTarget = longLines ? 8192 : 40;
+    while (len < size - 1) {
+        seed = seed * 1103515245 + 12345;
+        size_t wordLen = 1 + (seed >> 16) % (longLines ? 200 : 9);
+        for (size_t i = 0; i < wordLen && len < size - 1; i++) {
+            script[len++] = 'a' + (seed >> (i % 16)) % 26;
+        }
+        if (len - lineStart >= lineTarget) {
+            script[len++] = '\n';
+            lineStart = len;
+        } else if (len < size - 1) {
+            script[len++] = ((seed >> 24) % 8 == 0) ? '\t' : ' ';
+        }
+    }
+    script[size - 1] = '\n';
+    return script;
+}
+
+static size_t linesOld(const char *s, size_t len) {
+    size_t count = 0;
+    for (size_t pos = 0; pos < len; pos++) {
+        if (s[pos] == '\n') {
+            count++;
+        }
+    }
+    return count;
+}
+
+static size_t linesMemchr(const char *s, size_t len) {
+    size_t count = 0;
+    const char *end = s + len;
+    while ((s = memchr(s, '\n', end - s)) != NULL) {
+        count++;
+        s++;
+    }
+    return count;
+}
+
+static size_t linesScan(const char *s, size_t len) {
+    size_t count = 0, pos = 0;
+    while ((pos += scan_newline(s + pos, len - pos)) < len) {
+        count++;
+        pos++;
+    }
+    return count;
+}
+
+// Word count of one line the way seperateWords walked it
+static size_t wordsOld(char *s, size_t len) {
+    size_t count = 0;
+    int inside = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (c == '#') {
+            break;
+        }
+        if (isspace(c)) {
+            count += inside;
+            inside = 0;
+        } else {
+            inside = 1;
+        }
+    }
+    return count + inside;
+}
+
+static toklist_t tokens;
+
+static size_t wordsTok(char *s, size_t len) {
+    if (tok_split(&tokens, s, len) != 0) {
+        perror("tok_split");
+        exit(EXIT_FAILURE);
+    }
+    return tokens.length;
+}
+
+static void runLines(const char *caseName, size_t (*fn)(const char *, size_t), const char *script, size_t len,
+                     const char *scriptName, int passes) {
+    char extra[128];
+    bench_samples_t s;
+    bench_init(&s, passes);
+    for (int p = 0; p < passes; p++) {
+        long long start = bench_now_ns();
+        sink = fn(script, len);
+        bench_add(&s, bench_now_ns() - start);
+    }
+    qsort(s.data, s.length, sizeof(long long), bench_cmp);
+    snprintf(extra, sizeof(extra), "\"script\":\"%s\",\"mb_per_sec\":%.0f", scriptName,
+             len / (bench_pct(&s, 50) / 1e9) / (1024 * 1024));
+    bench_report("scan_lines", caseName, extra, &s);
+    bench_free(&s);
+}
+
+// lineEnds holds where every line ends (its newline), found before timing so only the word scanning is measured
+static void runWords(const char *caseName, size_t (*fn)(char *, size_t), const char *script, size_t len,
+                     const size_t *lineEnds, size_t lineCount, char *lineBuf, const char *scriptName, int passes) {
+    char extra[128];
+    bench_samples_t s;
+    bench_init(&s, passes);
+    for (int p = 0; p < passes; p++) {
+        long long start = bench_now_ns();
+        size_t words = 0, lineStart = 0;
+        for (size_t i = 0; i < lineCount; i++) {
+            memcpy(lineBuf, script + lineStart, lineEnds[i] - lineStart);
+            words += fn(lineBuf, lineEnds[i] - lineStart);
+            lineStart = lineEnds[i] + 1;
+        }
+        sink = words;
+        bench_add(&s, bench_now_ns() - start);
+    }
+    qsort(s.data, s.length, sizeof(long long), bench_cmp);
+    snprintf(extra, sizeof(extra), "\"script\":\"%s\",\"mb_per_sec\":%.0f", scriptName,
+             len / (bench_pct(&s, 50) / 1e9) / (1024 * 1024));
+    bench_report("scan_words", caseName, extra, &s);
+    bench_free(&s);
+}
+
+int main(int argc, char *argv[]) {
+    int mb = argc > 1 ? atoi(argv[1]) : 64;
+    int passes = argc > 2 ? atoi(argv[2]) : 5;
+    const char *kernels[] = {"scalar", "sse2", "avx2"};
+    size_t len = (size_t)mb << 20;
+    if (tok_init(&tokens, 40) != 0) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    for (int longLines = 0; longLines <= 1; longLines++) {
+        const char *scriptName = longLines ? "long_lines" : "short_lines";
+        char *script = makeScript(len, longLines);
+
+        runLines("old_loop", linesOld, script, len, scriptName, passes);
+        runLines("memchr", linesMemchr, script, len, scriptName, passes);
+        for (int k = 0; k < 3; k++) {
+            if (scan_select(kernels[k]) == 0) {
+                runLines(kernels[k], linesScan, script, len, scriptName, passes);
+            }
+        }
+
+        size_t lineCount = linesMemchr(script, len);
+        size_t *lineEnds = malloc(lineCount * sizeof(size_t));
+        char *lineBuf = malloc(len + 1);
+        if (lineEnds == NULL || lineBuf == NULL) {
+            perror("malloc");
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0, n = 0; i < len; i++) {
+            if (script[i] == '\n') {
+                lineEnds[n++] = i;
+            }
+        }
+        runWords("old_loop", wordsOld, script, len, lineEnds, lineCount, lineBuf, scriptName, passes);
+        for (int k = 0; k < 3; k++) {
+            if (scan_select(kernels[k]) == 0) {
+                runWords(kernels[k], wordsTok, script, len, lineEnds, lineCount, lineBuf, scriptName, passes);
+            }
+        }
+        free(lineEnds);
+        free(lineBuf);
+        free(script);
+    }
+    tok_destroy(&tokens);
+    return 0;
+}
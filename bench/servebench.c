@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "../serve.h"
+
+/*
+ * Latency of running a short script on a mysh --serve server against starting a shell for it, per script
+ *  cold:   fork + exec ./mysh script, what a script costs today (exec, dynamic linking, setup, teardown)
+ *  client: fork + exec ./mysh-client sock script, what a caller sees when it uses the client
+ *  direct: connect + send + wait for the status from here, the server side on its own without the client's exec
+ * Each script is one line run for real (echo into /dev/null), so the numbers are startup cost plus one line
+ * usage: servebench [mysh] [client] [requests] [workers]
+ */
+
+static char scriptPath[] = "/tmp/servebench.txt";
+static char sockPath[] = "/tmp/servebench.sock";
+
+// Run argv with stdout going to /dev/null and wait for it
+static void runProgram(char **argv) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            _exit(127);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "servebench: %s failed\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int connectServer(void) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sockPath);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// The same request mysh-client sends, stdout is /dev/null
+static void runDirect(int devNull, const char *cwd) {
+    int sock = connectServer();
+    if (sock < 0) {
+        perror(sockPath);
+        exit(EXIT_FAILURE);
+    }
+    serve_request_t req = {SERVE_MAGIC, SERVE_PATH, strlen(cwd), strlen(scriptPath)};
+    int fds[3] = {STDIN_FILENO, devNull, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov[3] = {{&req, sizeof(req)}, {(char *)cwd, req.cwdLen}, {scriptPath, req.bodyLen}};
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+    int32_t status;
+    if (sendmsg(sock, &msg, 0) != (ssize_t)(sizeof(req) + req.cwdLen + req.bodyLen)
+        || read(sock, &status, sizeof(status)) != sizeof(status) || status != 0) {
+        fprintf(stderr, "servebench: request failed\n");
+        exit(EXIT_FAILURE);
+    }
+    close(sock);
+}
+
+static void report(const char *caseName, bench_samples_t *s, int workers) {
+    char extra[128];
+    qsort(s->data, s->length, sizeof(long long), bench_cmp);
+    snprintf(extra, sizeof(extra), "\"workers\":%d,\"scripts_per_sec\":%.0f,\"per\":\"script\"", workers,
+             1e9 / bench_pct(s, 50));
+    bench_report("serve", caseName, extra, s);
+    bench_free(s);
+}
+
+int main(int argc, char *argv[]) {
+    char *mysh = argc > 1 ? argv[1] : "./mysh";
+    char *client = argc > 2 ? argv[2] : "./mysh-client";
+    int requests = argc > 3 ? atoi(argv[3]) : 1000;
+    char *workers = argc > 4 ? argv[4] : "2";
+    if (access(mysh, X_OK) != 0 || access(client, X_OK) != 0) {
+        fprintf(stderr, "servebench: %s or %s is not there, build them first (make)\n", mysh, client);
+        return EXIT_FAILURE;
+    }
+    FILE *f = fopen(scriptPath, "w");
+    if (f == NULL) {
+        perror(scriptPath);
+        return EXIT_FAILURE;
+    }
+    fprintf(f, "echo hello\n");
+    fclose(f);
+
+    pid_t server = fork();
+    if (server < 0) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (server == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDERR_FILENO); // The "serving" line
+        execl(mysh, mysh, "--serve", sockPath, workers, (char *)NULL);
+        _exit(127);
+    }
+    int sock = -1;
+    for (int i = 0; i < 500 && (sock = connectServer()) < 0; i++) {
+        usleep(10000);
+    }
+    if (sock < 0) {
+        fprintf(stderr, "servebench: the server did not come up\n");
+        kill(server, SIGTERM);
+        return EXIT_FAILURE;
+    }
+    close(sock); // That worker gets nothing and just gets replaced
+
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        return EXIT_FAILURE;
+    }
+    int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    char *coldArgv[] = {mysh, scriptPath, NULL};
+    char *clientArgv[] = {client, sockPath, scriptPath, NULL};
+    bench_samples_t cold, viaClient, direct;
+    bench_init(&cold, requests);
+    bench_init(&viaClient, requests);
+    bench_init(&direct, requests);
+    // Interleaved so a noisy moment hits all three the same
+    for (int i = 0; i < requests; i++) {
+        long long start = bench_now_ns();
+        runProgram(coldArgv);
+        bench_add(&cold, bench_now_ns() - start);
+        start = bench_now_ns();
+        runProgram(clientArgv);
+        bench_add(&viaClient, bench_now_ns() - start);
+        start = bench_now_ns();
+        runDirect(devNull, cwd);
+        bench_add(&direct, bench_now_ns() - start);
+    }
+    report("cold", &cold, atoi(workers));
+    report("client", &viaClient, atoi(workers));
+    report("direct", &direct, atoi(workers));
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(scriptPath);
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+/*
+ * The whole shell, ./mysh running generated batch scripts, every sample is one run and is reported per line
+ *  pipeline: the same line over and over, a builtin (cd .), one program (true), and 2 and N stage pipelines of true,
+ *            which is fork/exec (posix_spawn) plus wait latency as a script sees it
+ *  e2e:      a script of mixed lines (builtins, programs, pipelines, redirections, wildcards, and/or),
+ *            read as text and from its compiled .myshc
+ * usage: shellbench [mysh] [lines] [runs] [stages]
+ */
+
+static char scriptPath[] = "/tmp/shellbench.txt";
+static char compiledPath[] = "/tmp/shellbench.txt.myshc";
+
+static void writeScript(const char **lines, int lineKinds, long count) {
+    FILE *f = fopen(scriptPath, "w");
+    if (f == NULL) {
+        perror(scriptPath);
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < count; i++) {
+        fprintf(f, "%s\n", lines[i % lineKinds]);
+    }
+    fclose(f);
+    unlink(compiledPath);
+}
+
+static void runShell(const char *mysh, char *arg1, char *arg2) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        // The scripts write nothing worth keeping, throw it away so the terminal is not what gets measured
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            _exit(127);
+        }
+        execl(mysh, mysh, arg1, arg2, (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+        fprintf(stderr, "shellbench: could not run %s\n", mysh);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void run(const char *bench, const char *caseName, const char *mysh, long lines, int runs, int compiled) {
+    if (compiled) {
+        runShell(mysh, "--compile", scriptPath);
+    }
+    bench_samples_t s;
+    bench_init(&s, runs);
+    for (int r = 0; r < runs; r++) {
+        long long start = bench_now_ns();
+        runShell(mysh, scriptPath, NULL);
+        bench_add(&s, (bench_now_ns() - start) / lines);
+    }
+    qsort(s.data, s.length, sizeof(long long), bench_cmp);
+    char extra[128];
+    snprintf(extra, sizeof(extra), "\"lines\":%ld,\"lines_per_sec\":%.0f,\"per\":\"line\"", lines, 1e9 / bench_pct(&s, 50));
+    bench_report(bench, caseName, extra, &s);
+    bench_free(&s);
+}
+
+int main(int argc, char *argv[]) {
+    const char *mysh = argc > 1 ? argv[1] : "./mysh";
+    long lines = argc > 2 ? atol(argv[2]) : 2000;
+    int runs = argc > 3 ? atoi(argv[3]) : 10;
+    int stages = argc > 4 ? atoi(argv[4]) : 8;
+    if (access(mysh, X_OK) != 0) {
+        fprintf(stderr, "shellbench: %s is not there, build it first (make)\n", mysh);
+        return EXIT_FAILURE;
+    }
+
+    char nStage[1024] = "true";
+    for (int i = 1; i < stages && strlen(nStage) < sizeof(nStage) - 8; i++) {
+        strcat(nStage, " | true");
+    }
+    const char *builtinLine[] = {"cd ."};
+    const char *oneLine[] = {"true"};
+    const char *twoLine[] = {"true | true"};
+    const char *nLine[] = {nStage};
+    char nCase[32];
+    snprintf(nCase, sizeof(nCase), "stages_%d", stages);
+
+    writeScript(builtinLine, 1, lines * 10); // Builtins are cheap, more lines so the run is not all startup
+    run("pipeline", "builtin", mysh, lines * 10, runs, 0);
+    writeScript(oneLine, 1, lines);
+    run("pipeline", "stages_1", mysh, lines, runs, 0);
+    writeScript(twoLine, 1, lines);
+    run("pipeline", "stages_2", mysh, lines, runs, 0);
+    writeScript(nLine, 1, lines / 2);
+    run("pipeline", nCase, mysh, lines / 2, runs, 0);
+
+    const char *mixed[] = {
+        "cd /tmp",
+        "echo hello > /tmp/shellbench.out",
+        "cat < /tmp/shellbench.out | wc -c",
+        "false",
+        "or echo recovered",
+        "ls /tmp/shellbench.* | sort",
+        "pwd",
+        "# a comment",
+        "and which true",
+    };
+    int mixedKinds = sizeof(mixed) / sizeof(mixed[0]);
+    writeScript(mixed, mixedKinds, lines);
+    run("e2e", "mixed_text", mysh, lines, runs, 0);
+    run("e2e", "mixed_compiled", mysh, lines, runs, 1);
+
+    unlink(scriptPath);
+    unlink(compiledPath);
+    unlink("/tmp/shellbench.out");
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "../launcher.h"
+
+/*
+ * Spawn latency, launch_spawn against the old fork + execv path (launch_fork)
+ * Each sample starts /bin/true and waits for it, with the shell heap grown to different sizes first
+ * since page table copying is what makes fork slow once a batch run has been going for a while
+ * usage: spawnbench [iterations] [heapMB ...]
+ */
+
+typedef int (*launch_fn)(const char *, char **, int, int, pid_t, pid_t *);
+
+static void run(const char *caseName, launch_fn launch, int iterations, int heapMB) {
+    char *argv[] = {"true", NULL};
+    char extra[64];
+    bench_samples_t s;
+    bench_init(&s, iterations);
+    for (int i = 0; i < iterations; i++) {
+        pid_t pid;
+        int status;
+        long long start = bench_now_ns();
+        if (launch("/bin/true", argv, -1, -1, -1, &pid) != 0) {
+            fprintf(stderr, "spawnbench: could not start /bin/true\n");
+            exit(EXIT_FAILURE);
+        }
+        waitpid(pid, &status, 0);
+        bench_add(&s, bench_now_ns() - start);
+    }
+    snprintf(extra, sizeof(extra), "\"heap_mb\":%d", heapMB);
+    bench_report("spawn", caseName, extra, &s);
+    bench_free(&s);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    int defaultSizes[] = {0, 64, 512};
+    int sizeCount = argc > 2 ? argc - 2 : 3;
+    char *ballast = NULL;
+    size_t ballastSize = 0;
+
+    for (int i = 0; i < sizeCount; i++) {
+        int heapMB = argc > 2 ? atoi(argv[i + 2]) : defaultSizes[i];
+        // Grow the heap and touch every page so fork really has to copy the page tables
+        ballastSize = (size_t)heapMB << 20;
+        free(ballast);
+        ballast = ballastSize ? malloc(ballastSize) : NULL;
+        if (ballastSize && ballast == NULL) {
+            perror("malloc");
+            return EXIT_FAILURE;
+        }
+        if (ballast) {
+            memset(ballast, 1, ballastSize);
+        }
+        run("fork_execv", launch_fork, iterations, heapMB);
+        run("posix_spawn", launch_spawn, iterations, heapMB);
+    }
+    free(ballast);
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "bench.h"
+#include "../tokenizer.h"
+
+/*
+ * Tokenizer throughput on a synthetic script (100 MB unless given), tokens per second is what we are after
+ * tok_split is run against a copy of the old seperateWords (a 500 byte word buffer and a strdup per token)
+ * Every line is copied into a line buffer first, the same thing process_lines does, for both cases
+ * usage: tokbench [scriptMB] [passes]
+ */
+
+static const char *words[] = {
+    "ls", "-l", "cat", "grep", "foo", "bar.txt", "*.c", "src/*.h", "echo", "hello", "world", "wc", "-l",
+    "sort", "-u", "/usr/bin/env", "a_much_longer_argument_that_goes_on_for_a_while", "x", "--verbose", "42",
+};
+static const char *ops[] = { "<", ">", "|", "and", "or" };
+static volatile long long sink; // Keeps the compiler from dropping the strcmp's in oldSplit
+
+// Lines of 3 to 14 tokens, a few operators sprinkled in and a comment now and then
+static char *makeScript(size_t size, size_t *lenOut) {
+    char *script = malloc(size + 256);
+    if (script == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    unsigned int seed = 12345;
+    size_t len = 0;
+    while (len < size) {
+        int count = 3 + (seed = seed * 1103515245 + 12345) % 12;
+        for (int i = 0; i < count && len < size; i++) {
+            seed = seed * 1103515245 + 12345;
+            const char *w = ((seed >> 8) % 6 == 0 && i > 0) ? ops[(seed >> 12) % 5] : words[(seed >> 12) % 20];
+            size_t wl = strlen(w);
+            memcpy(script + len, w, wl);
+            len += wl;
+            script[len++] = ' ';
+        }
+        if ((seed >> 20) % 16 == 0) {
+            memcpy(script + len, "# comment", 9);
+            len += 9;
+        }
+        script[len++] = '\n';
+    }
+    *lenOut = len;
+    return script;
+}
+
+// The tokenizer mysh had before tokenizer.c, kept here only to compare against
+static long long oldSplit(char *command, int linelen, char **out, int outcap) {
+    char wordArray[500];
+    int wordIndex = 0, insideAWord = 0, count = 0;
+    for (int i = 0; i < linelen; i++) {
+        char c = command[i];
+        if (c == '#') {
+            break;
+        }
+        if (isspace(c)) {
+            if (insideAWord) {
+                wordArray[wordIndex] = '\0';
+                if (count < outcap) {
+                    out[count++] = strdup(wordArray);
+                }
+                wordIndex = 0;
+                insideAWord = 0;
+            }
+        } else {
+            if (wordIndex < 499) {
+                wordArray[wordIndex++] = c;
+            }
+            insideAWord = 1;
+        }
+    }
+    if (insideAWord) {
+        wordArray[wordIndex] = '\0';
+        if (count < outcap) {
+            out[count++] = strdup(wordArray);
+        }
+    }
+    // The old parser then strcmp'd every token, so that is part of the cost too
+    long long ops = 0;
+    for (int i = 0; i < count; i++) {
+        ops += strcmp(out[i], "<") == 0 || strcmp(out[i], ">") == 0 || strcmp(out[i], "|") == 0 ||
+               strcmp(out[i], "and") == 0 || strcmp(out[i], "or") == 0;
+        free(out[i]);
+    }
+    sink += ops;
+    return count;
+}
+
+static long long passTok(const char *script, size_t len, char *line, toklist_t *tokens) {
+    long long total = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (script[i] == '\n') {
+            memcpy(line, script + start, i - start);
+            if (tok_split(tokens, line, i - start) != 0) {
+                perror("tok_split");
+                exit(EXIT_FAILURE);
+            }
+            total += tokens->length;
+            start = i + 1;
+        }
+    }
+    return total;
+}
+
+static long long passOld(const char *script, size_t len, char *line) {
+    char *out[256];
+    long long total = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (script[i] == '\n') {
+            memcpy(line, script + start, i - start);
+            line[i - start] = '\0';
+            total += oldSplit(line, i - start, out, 256);
+            start = i + 1;
+        }
+    }
+    return total;
+}
+
+static void report(const char *caseName, int mb, long long tokenCount, bench_samples_t *s) {
+    char extra[128];
+    qsort(s->data, s->length, sizeof(long long), bench_cmp);
+    double perSec = tokenCount / (bench_pct(s, 50) / 1e9);
+    snprintf(extra, sizeof(extra), "\"script_mb\":%d,\"tokens\":%lld,\"tokens_per_sec\":%.0f", mb, tokenCount, perSec);
+    bench_report("tokenizer", caseName, extra, s);
+}
+
+int main(int argc, char *argv[]) {
+    int mb = argc > 1 ? atoi(argv[1]) : 100;
+    int passes = argc > 2 ? atoi(argv[2]) : 5;
+    size_t len;
+    char *script = makeScript((size_t)mb << 20, &len);
+    char *line = malloc(4096); // makeScript lines are well under this
+    toklist_t tokens;
+    if (line == NULL || tok_init(&tokens, 40) != 0) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    bench_samples_t s;
+    long long tokenCount = 0;
+    bench_init(&s, passes);
+    for (int p = 0; p < passes; p++) {
+        long long start = bench_now_ns();
+        tokenCount = passTok(script, len, line, &tokens);
+        bench_add(&s, bench_now_ns() - start);
+    }
+    report("tok_split", mb, tokenCount, &s);
+    bench_free(&s);
+
+    bench_init(&s, passes);
+    for (int p = 0; p < passes; p++) {
+        long long start = bench_now_ns();
+        tokenCount = passOld(script, len, line);
+        bench_add(&s, bench_now_ns() - start);
+    }
+    report("copy_strdup", mb, tokenCount, &s);
+    bench_free(&s);
+
+    tok_destroy(&tokens);
+    free(line);
+    free(script);
+    return 0;
+}
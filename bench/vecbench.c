@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../arena.h"
+#include "../arraylist.h"
+#include "../vec.h"
+
+/*
+ * Building argument lists the way the parser does, one list per command from the line arena, reset after every line
+ *  al_append_malloc: the old arraylist with malloc'd storage starting at 10, freed after every list
+ *  al_append_arena:  the arraylist from the arena starting at 8 (what createCommandStruct did before strvec)
+ *  strvec_push:      strvec_t from the arena, the first 8 are inline
+ *  strvec_extend:    the same filled with one extend
+ * For argvs of 3, 8, 16 and 64 words, every sample is one pass over lists lists and is reported per list
+ * usage: vecbench [lists] [passes]
+ */
+
+enum { AL_MALLOC, AL_ARENA, VEC_PUSH, VEC_EXTEND };
+
+static char *words[64];
+
+// Build one list of n words, returns its first word so nothing gets optimized away
+static char *build(int kind, arena_t *arena, int n) {
+    if (kind == AL_MALLOC) {
+        arraylist_t list;
+        al_init(&list, 10);
+        for (int i = 0; i < n; i++) {
+            al_append(&list, words[i]);
+        }
+        al_append(&list, NULL);
+        char *first = list.data[0];
+        al_destroy(&list);
+        return first;
+    }
+    if (kind == AL_ARENA) {
+        arraylist_t *list = arena_alloc(arena, sizeof(arraylist_t));
+        al_init_arena(list, 8, arena);
+        for (int i = 0; i < n; i++) {
+            al_append(list, words[i]);
+        }
+        al_append(list, NULL);
+        return list->data[0];
+    }
+    strvec_t *v = arena_alloc(arena, sizeof(strvec_t));
+    strvec_init(v, arena);
+    if (kind == VEC_EXTEND) {
+        strvec_extend(v, words, n);
+    } else {
+        for (int i = 0; i < n; i++) {
+            strvec_push(v, words[i]);
+        }
+    }
+    strvec_push(v, NULL);
+    return v->data[0];
+}
+
+static void run(const char *caseName, int kind, int n, long lists, int passes) {
+    arena_t arena;
+    if (arena_init(&arena, 16 * 1024) != 0) {
+        perror("arena_init");
+        exit(EXIT_FAILURE);
+    }
+    bench_samples_t s;
+    bench_init(&s, passes);
+    volatile char *sink = NULL;
+    for (int p = 0; p <= passes; p++) {
+        long long start = bench_now_ns();
+        for (long i = 0; i < lists; i++) {
+            sink = build(kind, &arena, n);
+            arena_reset(&arena);
+        }
+        long long ns = bench_now_ns() - start;
+        if (p > 0) { // The first one grows the arena chunks
+            bench_add(&s, ns / lists);
+        }
+    }
+    (void)sink;
+    char extra[64];
+    snprintf(extra, sizeof(extra), "\"words\":%d,\"lists\":%ld,\"per\":\"list\"", n, lists);
+    bench_report("vec", caseName, extra, &s);
+    bench_free(&s);
+    arena_destroy(&arena);
+}
+
+int main(int argc, char *argv[]) {
+    long lists = argc > 1 ? atol(argv[1]) : 1000000;
+    int passes = argc > 2 ? atoi(argv[2]) : 10;
+    static char text[64][8];
+    for (int i = 0; i < 64; i++) {
+        snprintf(text[i], sizeof(text[i]), "w%d", i);
+        words[i] = text[i];
+    }
+
+    const int sizes[] = {3, 8, 16, 64};
+    for (int i = 0; i < 4; i++) {
+        run("al_append_malloc", AL_MALLOC, sizes[i], lists, passes);
+        run("al_append_arena", AL_ARENA, sizes[i], lists, passes);
+        run("strvec_push", VEC_PUSH, sizes[i], lists, passes);
+        run("strvec_extend", VEC_EXTEND, sizes[i], lists, passes);
+    }
+    return 0;
+}
@@ -2,40 +2,96 @@
 #include <stdlib.h>
 #include <unistd.h>  
 #include <string.h> 
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "builtInCommands.h"
+#include "pathcache.h"
+#include "launcher.h"
+#include "zerocopy.h"
+#include "jobs.h"
+#include "parallel.h"
+
+__thread builtin_io_t builtinIo = {STDIN_FILENO, STDOUT_FILENO, NULL, 0};
+
+// The FILE the running builtin prints to, a stage on a thread gets it the first time it prints so cat and tee never malloc one
+static FILE *builtinOut(void) {
+    if (builtinIo.out == NULL && builtinIo.onThread) {
+        builtinIo.out = fdopen(builtinIo.outFd, "w");
+        if (builtinIo.out == NULL) {
+            perror("fdopen (builtin stage)");
+            builtinIo.out = stderr; // Better than mixing it into whatever the shell's stdout is
+        }
+    }
+    return builtinIo.out != NULL ? builtinIo.out : stdout;
+}
+
+// Push out what was printed so far, before bytes get written straight to the fd
+static void builtinFlush(void) {
+    if (!builtinIo.onThread) {
+        fflush(stdout);
+    } else if (builtinIo.out != NULL) {
+        fflush(builtinIo.out);
+    }
+}
 
 // The cd function, we used chdir to go into the directory 
-void builtin_cd(arraylist_t *list) {
+int builtin_cd(strvec_t *list) {
     int argCount = list->length - 1; //Not including the null char
     if (argCount != 2) { //Cd must expect one arg
         fprintf(stderr, "cd: expected one argument\n");
-        return;
+        return 1;
+    }
+    if (builtinIo.onThread) {
+        // The cwd belongs to the whole shell, a cd in a pipeline only says whether it would have worked
+        struct stat st;
+        if (stat(list->data[1], &st) != 0) {
+            perror("cd");
+            return 1;
+        }
+        if (!S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "cd: %s: Not a directory\n", list->data[1]);
+            return 1;
+        }
+        if (access(list->data[1], X_OK) != 0) {
+            perror("cd");
+            return 1;
+        }
+        return 0;
     }
     if (chdir(list->data[1]) != 0) {  //chdir returns 0 if success
         perror("cd");
+        return 1;
     }
+    return 0;
 }
 
 // pwd prints the path of where are we are heading to
-void builtin_pwd(arraylist_t *list) {
+int builtin_pwd(strvec_t *list) {
     (void)list;  // Original code used list, but later on we realized we didnt need it, alot of our code uses it this way but its too much work to change it, just use (void)list it tells the compiler that were not using it on purpose
     char path[4096]; //The array for the path we wil get
     if (getcwd(path, sizeof(path)) == NULL) { 
         perror("built_pwd not working check");
-        return;
+        return 1;
     }
-    printf("%s\n", path);
-    fflush(stdout);  //Using flush instead of write
+    fprintf(builtinOut(), "%s\n", path);
+    fflush(builtinOut());  //Using flush instead of write
+    return 0;
 }
 
 /*
  * builtin_exit--> it expects only the command exit
  */
-void builtin_exit(arraylist_t *list) {
+int builtin_exit(strvec_t *list) {
     int argCount = list->length - 1;
     if (argCount != 1) {
         fprintf(stderr, "exit: Does not expect arguments\n");
-        return;
+        return 1;
+    }
+    if (builtinIo.onThread) {
+        return 0; // Only the stage ends, the shell keeps going
     }
     printf("mysh: exiting\n");
     fflush(stdout);  // Ensure the output is displayed, we use fflush not write the whole project
@@ -45,48 +101,911 @@ void builtin_exit(arraylist_t *list) {
 /*
  * die, Prints error messages following the die command, then exits with failure.
  */
-void builtin_die(arraylist_t *list) {
+int builtin_die(strvec_t *list) {
     int argCount = list->length - 1;
     if (argCount < 1) {  // Should at least have die
         fprintf(stderr, "die: missing message\n");
+        if (builtinIo.onThread) {
+            return 1;
+        }
         exit(EXIT_FAILURE);
     }
     // Print arguments as the error message.
-    for (int i = 1; i < list->length - 1; i++) {
+    for (int i = 1; i < argCount; i++) {
         fprintf(stderr, "%s ", list->data[i]);
     }
     fprintf(stderr, "\n");
+    if (builtinIo.onThread) {
+        return 1;
+    }
     exit(EXIT_FAILURE);
 }
 
 /*
  * which, for executables only
  */
-void builtin_which(arraylist_t *list) {
+int builtin_which(strvec_t *list) {
     int argCount = list->length - 1;
     if (argCount != 2) {  // which needs a plus one argument
         fprintf(stderr, "which: expected more arguments\n");
-        return;
+        return 1;
     }
     const char *cmd = list->data[1];
-    const char *dirs[] = {"/usr/local/bin", "/usr/bin", "/bin"};
     char path[4096];
-    int found = 0;
-    for (int i = 0; i < 3; i++) {
-        strncpy(path, dirs[i], sizeof(path) - 1);
-        path[sizeof(path) - 1] = '\0'; 
-        strncat(path, "/", sizeof(path) - strlen(path) - 1);
-        strncat(path, cmd, sizeof(path) - strlen(path) - 1); //So its like if we get ls we cat --> usr/bin/ls and then accesds will find it and then print it out to user
-        
-
-        if (access(path, X_OK) == 0) {
-            printf("%s\n", path);
-            found = 1;
+    // Same cache the shell uses to run things, so which always agrees with what would actually run
+    if (pc_lookup(cmd, path, sizeof(path)) == 0 && access(path, X_OK) == 0) {
+        fprintf(builtinOut(), "%s\n", path);
+        fflush(builtinOut());
+        return 0;
+    }
+    //If we didnt find it print something out
+    fprintf(stderr, "which: %s not found\n", cmd);
+    return 1;
+}
+
+/*
+ * hash, looks at the executable lookup cache
+ * hash -> table with hit counts, hash -l -> reusable listing, hash -r -> forget everything
+ * hash -p path name -> pin name to path, hash name... -> look the names up now
+ */
+int builtin_hash(strvec_t *list) {
+    int argCount = list->length - 1;
+    if (argCount == 1) {
+        pc_print(builtinOut(), 0);
+        return 0;
+    }
+    const char *opt = list->data[1];
+    if (strcmp(opt, "-r") == 0 && argCount == 2) {
+        pc_clear();
+    } else if (strcmp(opt, "-l") == 0 && argCount == 2) {
+        pc_print(builtinOut(), 1);
+    } else if (strcmp(opt, "-p") == 0) {
+        if (argCount != 4) {
+            fprintf(stderr, "hash: -p expects a path and a name\n");
+            return 1;
+        }
+        return pc_add(list->data[3], list->data[2]);
+    } else if (opt[0] == '-') {
+        fprintf(stderr, "hash: usage: hash [-l | -r | -p path name | name ...]\n");
+        return 1;
+    } else {
+        char path[4096];
+        int status = 0;
+        for (int i = 1; i < argCount; i++) {
+            if (pc_lookup(list->data[i], path, sizeof(path)) != 0) {
+                fprintf(stderr, "hash: %s: not found\n", list->data[i]);
+                status = 1;
+            }
+        }
+        return status;
+    }
+    return 0;
+}
+
+/*
+ * rehash, same thing as hash -r
+ */
+int builtin_rehash(strvec_t *list) {
+    int argCount = list->length - 1;
+    if (argCount != 1) {
+        fprintf(stderr, "rehash: Does not expect arguments\n");
+        return 1;
+    }
+    pc_clear();
+    return 0;
+}
+
+/*
+ * Options we dont do ourselves (cat -n, tee -p...) go to the real program, same as if it was not a builtin
+ * It gets the builtin's stdin/stdout, which already point at any redirection or pipe
+ */
+static int runExternal(strvec_t *list) {
+    char path[4096];
+    pid_t pid;
+    int status;
+    if (pc_lookup(list->data[0], path, sizeof(path)) != 0) {
+        fprintf(stderr, "%s: command not found\n", list->data[0]);
+        return 1;
+    }
+    builtinFlush();
+    int inFd = builtinIo.onThread ? builtinIo.inFd : -1;
+    int outFd = builtinIo.onThread ? builtinIo.outFd : -1;
+    int err = launch_spawn(path, list->data, inFd, outFd, -1, &pid);
+    if (err != 0) {
+        fprintf(stderr, "execv: %s\n", strerror(err));
+        return 1;
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+        return 1;
+    }
+    return WEXITSTATUS(status);
+}
+
+/*
+ * cat, copies each file (or stdin for none or -) to stdout
+ * The bytes are moved with splice/sendfile when the fds allow it, see zerocopy.c
+ */
+int builtin_cat(strvec_t *list) {
+    int argCount = list->length - 1;
+    int first = 1;
+    // -u is the only option POSIX has and we never buffer anyway, everything else goes to the real cat
+    while (first < argCount && list->data[first][0] == '-' && list->data[first][1] != '\0') {
+        if (strcmp(list->data[first], "--") == 0) {
+            first++;
+            break;
+        }
+        if (strcmp(list->data[first], "-u") != 0) {
+            return runExternal(list);
+        }
+        first++;
+    }
+
+    builtinFlush(); // Anything printf'd before has to come out before the bytes we write straight to the fd
+    int status = 0;
+    if (first == argCount) {
+        if (zc_copy(builtinIo.inFd, builtinIo.outFd) != 0) {
+            if (errno != EPIPE) {
+                perror("cat");
+            }
+            status = 1;
+        }
+        return status;
+    }
+    for (int i = first; i < argCount; i++) {
+        const char *name = list->data[i];
+        int fd = (strcmp(name, "-") == 0) ? builtinIo.inFd : open(name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (zc_copy(fd, builtinIo.outFd) != 0) {
+            if (errno == EPIPE) {
+                // Whoever reads us is gone, a real cat would have been killed by SIGPIPE right here
+                if (fd != builtinIo.inFd) {
+                    close(fd);
+                }
+                return 1;
+            }
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+        }
+        if (fd != builtinIo.inFd) {
+            close(fd);
+        }
+    }
+    return status;
+}
+
+/*
+ * tee [-a] [-i] file..., copies stdin to stdout and to every file
+ * When stdin is a pipe the copies are made with tee(2)/splice so the data never leaves the kernel
+ */
+int builtin_tee(strvec_t *list) {
+    int argCount = list->length - 1;
+    int append = 0;
+    int first = 1;
+    while (first < argCount && list->data[first][0] == '-' && list->data[first][1] != '\0') {
+        if (strcmp(list->data[first], "--") == 0) {
+            first++;
+            break;
+        }
+        // -i is ignoring SIGINT, the shell never hands ^C to a builtin so there is nothing to do
+        for (const char *opt = list->data[first] + 1; *opt; opt++) {
+            if (*opt == 'a') {
+                append = 1;
+            } else if (*opt != 'i') {
+                return runExternal(list);
+            }
+        }
+        first++;
+    }
+
+    int fileCount = argCount - first;
+    int outs[fileCount + 1];
+    int outCount = 0;
+    int status = 0;
+    outs[outCount++] = builtinIo.outFd;
+    for (int i = first; i < argCount; i++) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        int fd = open(list->data[i], flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", list->data[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        outs[outCount++] = fd;
+    }
+
+    builtinFlush();
+    if (zc_tee(builtinIo.inFd, outs, outCount) != 0) {
+        if (errno != EPIPE) {
+            perror("tee");
+        }
+        status = 1;
+    }
+    for (int i = 1; i < outCount; i++) {
+        close(outs[i]);
+    }
+    return status;
+}
+
+/*
+ * cp src dst, only the plain shape: one regular file to a file or into a directory, no options
+ * The bytes go through zc_copy, so a reflink or copy_file_range when the filesystem can do it and they never come up here
+ * Anything else (options, more sources, special files, a copy onto itself, a target we can not open) goes to the real cp,
+ * which also gets to word the errors
+ */
+int builtin_cp(strvec_t *list) {
+    int argCount = list->length - 1;
+    if (argCount != 3 || list->data[1][0] == '-' || list->data[2][0] == '-') {
+        return runExternal(list);
+    }
+    const char *src = list->data[1];
+    const char *dst = list->data[2];
+    char path[4096];
+    struct stat from, to;
+    if (stat(src, &from) != 0 || !S_ISREG(from.st_mode)) {
+        return runExternal(list);
+    }
+    int exists = (stat(dst, &to) == 0);
+    if (exists && S_ISDIR(to.st_mode)) {
+        const char *base = strrchr(src, '/');
+        base = base ? base + 1 : src;
+        if (snprintf(path, sizeof(path), "%s/%s", dst, base) >= (int)sizeof(path)) {
+            return runExternal(list);
+        }
+        dst = path;
+        exists = (stat(dst, &to) == 0);
+    }
+    if (exists && (!S_ISREG(to.st_mode) || (to.st_dev == from.st_dev && to.st_ino == from.st_ino))) {
+        return runExternal(list);
+    }
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return runExternal(list);
+    }
+    // A new file gets the mode of src (minus the umask), an existing one keeps its own, like cp
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, from.st_mode & 0777);
+    if (out < 0) {
+        close(in);
+        return runExternal(list);
+    }
+    int status = 0;
+    if (zc_copy(in, out) != 0) {
+        fprintf(stderr, "cp: %s: %s\n", dst, strerror(errno));
+        status = 1;
+    }
+    close(in);
+    if (close(out) != 0 && status == 0) {
+        fprintf(stderr, "cp: %s: %s\n", dst, strerror(errno));
+        status = 1;
+    }
+    return status;
+}
+
+// Job number from "2" or "%2", 0 if there was no argument, -1 if it is not a number
+static int jobArgument(strvec_t *list, const char *name) {
+    int argCount = list->length - 1;
+    if (argCount == 1) {
+        return 0;
+    }
+    const char *arg = list->data[1];
+    if (arg[0] == '%') {
+        arg++;
+    }
+    char *end;
+    long id = strtol(arg, &end, 10);
+    if (argCount > 2 || *arg == '\0' || *end != '\0' || id <= 0) {
+        fprintf(stderr, "%s: expected a job number\n", name);
+        return -1;
+    }
+    return (int)id;
+}
+
+// jobs, every background job and whether it is still running
+int builtin_jobs(strvec_t *list) {
+    (void)list;
+    jobs_list();
+    return 0;
+}
+
+// wait [n], waits for job n (or all of them) and returns its exit status
+int builtin_wait(strvec_t *list) {
+    int id = jobArgument(list, "wait");
+    if (id < 0) {
+        return 1;
+    }
+    return jobs_wait(id);
+}
+
+// fg [n], runs job n (or the last one) in the foreground
+int builtin_fg(strvec_t *list) {
+    int id = jobArgument(list, "fg");
+    if (id < 0) {
+        return 1;
+    }
+    return jobs_fg(id);
+}
+
+// parallel [-j N] cmd {} ::: inputs, see parallel.c
+int builtin_parallel(strvec_t *list) {
+    return par_run(list);
+}
+
+// Write out what echo/printf printed, 1 if that failed (a full disk, a closed pipe...)
+static int flushOutput(const char *name) {
+    FILE *out = builtinOut();
+    if (fflush(out) != 0 || ferror(out)) {
+        if (errno != EPIPE) {
+            fprintf(stderr, "%s: write error: %s\n", name, strerror(errno));
+        }
+        clearerr(out);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * One backslash escape of echo -e, printf formats and printf %b, s points just after the backslash
+ * octalZero: \0nnn (echo and %b) instead of \nnn (printf format), up to 3 octal digits either way
+ * Puts the byte in *out and returns how many characters after the backslash it used,
+ * *out is -1 for \c (stop all output) and -2 when it was not an escape (the backslash is printed as it is)
+ */
+static int parseEscape(const char *s, int octalZero, int *out) {
+    switch (*s) {
+        case '\\': *out = '\\'; return 1;
+        case 'a': *out = '\a'; return 1;
+        case 'b': *out = '\b'; return 1;
+        case 'c': *out = -1; return 1;
+        case 'e': *out = 27; return 1;
+        case 'f': *out = '\f'; return 1;
+        case 'n': *out = '\n'; return 1;
+        case 'r': *out = '\r'; return 1;
+        case 't': *out = '\t'; return 1;
+        case 'v': *out = '\v'; return 1;
+    }
+    if (*s == 'x' && isxdigit((unsigned char)s[1])) {
+        int value = 0, used = 1;
+        while (used < 3 && isxdigit((unsigned char)s[used])) {
+            char c = s[used++];
+            value = value * 16 + (isdigit((unsigned char)c) ? c - '0' : (tolower((unsigned char)c) - 'a' + 10));
+        }
+        *out = value;
+        return used;
+    }
+    if ((octalZero && *s == '0') || (!octalZero && *s >= '0' && *s <= '7')) {
+        int value = 0, used = octalZero ? 1 : 0, digits = 0;
+        while (digits < 3 && s[used] >= '0' && s[used] <= '7') {
+            value = value * 8 + (s[used++] - '0');
+            digits++;
+        }
+        *out = value & 0xff;
+        return used;
+    }
+    *out = -2;
+    return 0;
+}
+
+// Print s with its escapes worked out, returns 1 if a \c said to stop
+static int printEscaped(const char *s, int octalZero) {
+    FILE *out = builtinOut();
+    for (; *s; s++) {
+        if (*s != '\\') {
+            putc(*s, out);
+            continue;
+        }
+        int c;
+        int used = parseEscape(s + 1, octalZero, &c);
+        if (c == -1) {
+            return 1;
+        }
+        if (c == -2) {
+            putc('\\', out);
+            continue;
+        }
+        putc(c, out);
+        s += used;
+    }
+    return 0;
+}
+
+/*
+ * echo [-neE] args, like coreutils: -n no newline, -e backslash escapes, -E none (the default)
+ * An argument only counts as options if every letter in it is one of n, e and E
+ */
+int builtin_echo(strvec_t *list) {
+    int argCount = list->length - 1;
+    int newline = 1, escapes = 0, first = 1;
+    FILE *out = builtinOut();
+    for (; first < argCount; first++) {
+        const char *arg = list->data[first];
+        if (arg[0] != '-' || arg[1] == '\0' || strspn(arg + 1, "neE") != strlen(arg + 1)) {
             break;
         }
+        for (const char *p = arg + 1; *p; p++) {
+            if (*p == 'n') {
+                newline = 0;
+            } else {
+                escapes = (*p == 'e');
+            }
+        }
+    }
+    for (int i = first; i < argCount; i++) {
+        if (i > first) {
+            putc(' ', out);
+        }
+        if (!escapes) {
+            fputs(list->data[i], out);
+        } else if (printEscaped(list->data[i], 1)) {
+            return flushOutput("echo"); // \c, nothing more, not even the newline
+        }
+    }
+    if (newline) {
+        putc('\n', out);
+    }
+    return flushOutput("echo");
+}
+
+int builtin_true(strvec_t *list) {
+    (void)list;
+    return 0;
+}
+
+int builtin_false(strvec_t *list) {
+    (void)list;
+    return 1;
+}
+
+/*
+ * test / [
+ * Up to 4 arguments follow the POSIX rules exactly (so test -n, test ! = x... mean what POSIX says),
+ * longer ones go through a small recursive descent parser with ! ( ) -a and -o, -a binding tighter
+ * Exit status 0 true, 1 false, 2 for an error
+ */
+
+typedef struct {
+    char **args;
+    int count;
+    int pos;
+    int error;
+    const char *name;
+} test_state_t;
+
+static void testError(test_state_t *t, const char *what, const char *arg) {
+    if (!t->error) {
+        fprintf(stderr, "%s: %s%s%s\n", t->name, what, arg ? ": " : "", arg ? arg : "");
+    }
+    t->error = 1;
+}
+
+static int testUnaryOp(const char *op) {
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' && strchr("bcdefghknprsStuwxzLGO", op[1]) != NULL;
+}
+
+static int testBinaryOp(const char *op) {
+    static const char *ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL};
+    for (int i = 0; ops[i] != NULL; i++) {
+        if (strcmp(op, ops[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static long long testInteger(test_state_t *t, const char *s) {
+    char *end;
+    errno = 0;
+    long long value = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end)) {
+        end++;
+    }
+    if (*s == '\0' || *end != '\0' || errno != 0) {
+        testError(t, "integer expression expected", s);
+        return 0;
+    }
+    return value;
+}
+
+static int testUnary(test_state_t *t, const char *op, const char *arg) {
+    struct stat st;
+    if (op[1] == 'n') {
+        return arg[0] != '\0';
+    }
+    if (op[1] == 'z') {
+        return arg[0] == '\0';
+    }
+    if (op[1] == 't') {
+        return isatty((int)testInteger(t, arg));
+    }
+    if (op[1] == 'r' || op[1] == 'w' || op[1] == 'x') {
+        return access(arg, op[1] == 'r' ? R_OK : op[1] == 'w' ? W_OK : X_OK) == 0;
+    }
+    if (op[1] == 'h' || op[1] == 'L') {
+        return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+    if (stat(arg, &st) != 0) {
+        return 0;
+    }
+    switch (op[1]) {
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'e': return 1;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'k': return (st.st_mode & S_ISVTX) != 0;
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        case 'G': return st.st_gid == getegid();
+        case 'O': return st.st_uid == geteuid();
+    }
+    return 0;
+}
+
+static int testBinary(test_state_t *t, const char *a, const char *op, const char *b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(a, b) == 0;
+    }
+    if (strcmp(op, "!=") == 0) {
+        return strcmp(a, b) != 0;
+    }
+    if (strcmp(op, "<") == 0) {
+        return strcmp(a, b) < 0;
+    }
+    if (strcmp(op, ">") == 0) {
+        return strcmp(a, b) > 0;
+    }
+    if (op[1] == 'n' || op[1] == 'o' || strcmp(op, "-ef") == 0) {
+        struct stat sa, sb;
+        int haveA = stat(a, &sa) == 0, haveB = stat(b, &sb) == 0;
+        if (strcmp(op, "-ef") == 0) {
+            return haveA && haveB && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        }
+        if (strcmp(op, "-ot") == 0) {
+            const char *swap = a;
+            a = b;
+            b = swap;
+            struct stat s = sa;
+            sa = sb;
+            sb = s;
+            int h = haveA;
+            haveA = haveB;
+            haveB = h;
+        }
+        // a newer than b, a file that is not there is older than any that is
+        if (!haveA) {
+            return 0;
+        }
+        if (!haveB) {
+            return 1;
+        }
+        return sa.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+               (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec);
     }
-    
-    if (!found){ //If we didnt find it print something out
-        fprintf(stderr, "which: %s not found\n", cmd);
+    long long x = testInteger(t, a), y = testInteger(t, b);
+    switch (op[1] == 'e' ? 0 : op[1] == 'n' ? 1 : op[2] == 't' ? (op[1] == 'l' ? 2 : 4) : (op[1] == 'l' ? 3 : 5)) {
+        case 0: return x == y;
+        case 1: return x != y;
+        case 2: return x < y;
+        case 3: return x <= y;
+        case 4: return x > y;
+        default: return x >= y;
     }
-}  //
+}
+
+static int testOr(test_state_t *t);
+
+static int testPrimary(test_state_t *t) {
+    char **a = t->args + t->pos;
+    int left = t->count - t->pos;
+    if (left <= 0) {
+        testError(t, "argument expected", NULL);
+        return 0;
+    }
+    if (strcmp(a[0], "!") == 0) {
+        t->pos++;
+        return !testPrimary(t);
+    }
+    if (strcmp(a[0], "(") == 0 && left > 1) {
+        t->pos++;
+        int value = testOr(t);
+        if (t->pos >= t->count || strcmp(t->args[t->pos], ")") != 0) {
+            testError(t, "')' expected", NULL);
+            return 0;
+        }
+        t->pos++;
+        return value;
+    }
+    if (left >= 3 && testBinaryOp(a[1])) {
+        t->pos += 3;
+        return testBinary(t, a[0], a[1], a[2]);
+    }
+    if (left >= 2 && testUnaryOp(a[0])) {
+        t->pos += 2;
+        return testUnary(t, a[0], a[1]);
+    }
+    t->pos++;
+    return a[0][0] != '\0';
+}
+
+static int testAnd(test_state_t *t) {
+    int value = testPrimary(t);
+    while (t->pos < t->count && strcmp(t->args[t->pos], "-a") == 0) {
+        t->pos++;
+        value = testPrimary(t) && value;
+    }
+    return value;
+}
+
+static int testOr(test_state_t *t) {
+    int value = testAnd(t);
+    while (t->pos < t->count && strcmp(t->args[t->pos], "-o") == 0) {
+        t->pos++;
+        value = testAnd(t) || value;
+    }
+    return value;
+}
+
+// The fixed POSIX meaning of 0 to 4 arguments, -1 when they are not one of those shapes
+static int testPosix(test_state_t *t, char **a, int n) {
+    switch (n) {
+        case 0:
+            return 0;
+        case 1:
+            return a[0][0] != '\0';
+        case 2:
+            if (strcmp(a[0], "!") == 0) {
+                return a[1][0] == '\0';
+            }
+            if (testUnaryOp(a[0])) {
+                return testUnary(t, a[0], a[1]);
+            }
+            return -1;
+        case 3:
+            if (testBinaryOp(a[1])) {
+                return testBinary(t, a[0], a[1], a[2]);
+            }
+            if (strcmp(a[0], "!") == 0) {
+                int value = testPosix(t, a + 1, 2);
+                return value < 0 ? -1 : !value;
+            }
+            if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0) {
+                return a[1][0] != '\0';
+            }
+            return -1;
+        case 4:
+            if (strcmp(a[0], "!") == 0) {
+                int value = testPosix(t, a + 1, 3);
+                return value < 0 ? -1 : !value;
+            }
+            if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0) {
+                return testPosix(t, a + 1, 2);
+            }
+            return -1;
+    }
+    return -1;
+}
+
+int builtin_test(strvec_t *list) {
+    test_state_t t;
+    t.name = list->data[0];
+    t.args = list->data + 1;
+    t.count = list->length - 2; // Not the name and not the NULL
+    t.pos = 0;
+    t.error = 0;
+    if (strcmp(t.name, "[") == 0) {
+        if (t.count == 0 || strcmp(t.args[t.count - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        t.count--;
+    }
+    int value = testPosix(&t, t.args, t.count);
+    if (value < 0) {
+        value = testOr(&t);
+        if (!t.error && t.pos < t.count) {
+            testError(&t, "too many arguments", t.args[t.pos]);
+        }
+    }
+    if (t.error) {
+        return 2;
+    }
+    return value ? 0 : 1;
+}
+
+/*
+ * printf format [args], the format is used again while there are arguments left, like POSIX says
+ * Conversions: %s %b %c %d %i %o %u %x %X %e %E %f %F %g %G %a %A %%, with flags, width and precision (* too)
+ * A missing argument is "" or 0, a number that is not one prints an error and makes the exit status 1
+ */
+
+typedef struct {
+    char **args;
+    int count;
+    int next;
+    int status;
+} printf_state_t;
+
+static const char *printfArg(printf_state_t *p) {
+    return p->next < p->count ? p->args[p->next++] : NULL;
+}
+
+// A numeric argument, 'c or "c is the code of c
+static int printfNumber(printf_state_t *p, const char *s, int isFloat, long long *iv, unsigned long long *uv, long double *fv) {
+    *iv = 0;
+    *uv = 0;
+    *fv = 0;
+    if (s == NULL || *s == '\0') {
+        return 0;
+    }
+    if (s[0] == '\'' || s[0] == '"') {
+        *iv = (unsigned char)s[1];
+        *uv = *iv;
+        *fv = *iv;
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    if (isFloat) {
+        *fv = strtold(s, &end);
+    } else if (s[0] == '-') {
+        *iv = strtoll(s, &end, 0);
+        *uv = (unsigned long long)*iv;
+    } else {
+        *uv = strtoull(s, &end, 0);
+        *iv = (long long)*uv;
+    }
+    if (end == s || *end != '\0' || errno != 0) {
+        fprintf(stderr, "printf: %s: %s\n", s, end == s || *end != '\0' ? "invalid number" : strerror(errno));
+        p->status = 1;
+    }
+    return 0;
+}
+
+// One pass over the format, returns 1 if a \c (in the format or in a %b) said to stop
+static int printfOnce(printf_state_t *p, const char *format) {
+    FILE *out = builtinOut();
+    for (const char *f = format; *f; f++) {
+        if (*f == '\\') {
+            int c;
+            int used = parseEscape(f + 1, 0, &c);
+            if (c == -1) {
+                return 1;
+            }
+            if (c == -2) {
+                putc('\\', out);
+            } else {
+                putc(c, out);
+                f += used;
+            }
+            continue;
+        }
+        if (*f != '%') {
+            putc(*f, out);
+            continue;
+        }
+        if (f[1] == '%') {
+            putc('%', out);
+            f++;
+            continue;
+        }
+
+        // Copy the spec into spec (with * replaced by the number), then hand it to printf with the right type
+        char spec[64];
+        size_t n = 0;
+        spec[n++] = '%';
+        const char *s = f + 1;
+        while (*s && strchr("-+ #0", *s) && n < 20) {
+            spec[n++] = *s++;
+        }
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*s != '.') {
+                    break;
+                }
+                spec[n++] = *s++;
+            }
+            if (*s == '*') {
+                long long iv;
+                unsigned long long uv;
+                long double fv;
+                printfNumber(p, printfArg(p), 0, &iv, &uv, &fv);
+                n += snprintf(spec + n, sizeof(spec) - n, "%d", (int)iv);
+                s++;
+            } else {
+                while (isdigit((unsigned char)*s) && n < 40) {
+                    spec[n++] = *s++;
+                }
+            }
+        }
+        char conv = *s;
+        if (conv == '\0' || strchr("sbcdiouxXeEfFgGaA", conv) == NULL) {
+            fprintf(stderr, "printf: %%%c: invalid conversion\n", conv ? conv : ' ');
+            p->status = 1;
+            return 1;
+        }
+        f = s;
+        const char *arg = printfArg(p);
+        long long iv;
+        unsigned long long uv;
+        long double fv;
+        switch (conv) {
+            case 's':
+                spec[n++] = 's';
+                spec[n] = '\0';
+                fprintf(out, spec, arg ? arg : "");
+                break;
+            case 'b':
+                // Escapes in the argument, width and precision are not supported with it
+                if (arg != NULL && printEscaped(arg, 1)) {
+                    return 1;
+                }
+                break;
+            case 'c':
+                spec[n++] = 'c';
+                spec[n] = '\0';
+                fprintf(out, spec, arg ? arg[0] : '\0');
+                break;
+            case 'd':
+            case 'i':
+                printfNumber(p, arg, 0, &iv, &uv, &fv);
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = conv;
+                spec[n] = '\0';
+                fprintf(out, spec, iv);
+                break;
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                printfNumber(p, arg, 0, &iv, &uv, &fv);
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = conv;
+                spec[n] = '\0';
+                fprintf(out, spec, uv);
+                break;
+            default:
+                printfNumber(p, arg, 1, &iv, &uv, &fv);
+                spec[n++] = 'L';
+                spec[n++] = conv;
+                spec[n] = '\0';
+                fprintf(out, spec, fv);
+                break;
+        }
+    }
+    return 0;
+}
+
+int builtin_printf(strvec_t *list) {
+    int argCount = list->length - 1;
+    int first = 1;
+    if (first < argCount && strcmp(list->data[first], "--") == 0) {
+        first++;
+    }
+    if (first >= argCount) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 1;
+    }
+    printf_state_t p;
+    p.args = list->data + first + 1;
+    p.count = argCount - first - 1;
+    p.next = 0;
+    p.status = 0;
+    const char *format = list->data[first];
+    do {
+        int before = p.next;
+        if (printfOnce(&p, format) || p.next == before) {
+            break; // \c, or a format without conversions would go round forever
+        }
+    } while (p.next < p.count);
+    if (flushOutput("printf") != 0) {
+        return 1;
+    }
+    return p.status;
+}
+
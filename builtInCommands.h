@@ -1,11 +1,42 @@
 #ifndef BUILTINS_H //The guards
 #define BUILTINS_H
 
-#include "arraylist.h"
-void builtin_cd(arraylist_t *list);
-void builtin_pwd(arraylist_t *list);
-void builtin_exit(arraylist_t *list);
-void builtin_die(arraylist_t *list);
-void builtin_which(arraylist_t *list);
+#include <stdio.h>
+#include "vec.h"
+
+/*
+ * Where the builtin that is running reads and writes
+ * Run by the shell itself that is fd 0, fd 1 and stdout, with any < or > already dup2'd onto them
+ * A pipeline stage on a thread (see runPipeline) gets its own fds and FILE instead since the fd table is shared,
+ * and leaves the shell alone like a subshell would: cd only checks the directory, exit and die only end the stage
+ */
+typedef struct {
+    int inFd;
+    int outFd;
+    FILE *out;      // NULL means stdout
+    int onThread;
+} builtin_io_t;
+
+extern __thread builtin_io_t builtinIo;
+
+int builtin_cd(strvec_t *list);
+int builtin_pwd(strvec_t *list);
+int builtin_exit(strvec_t *list);
+int builtin_die(strvec_t *list);
+int builtin_which(strvec_t *list);
+int builtin_hash(strvec_t *list);
+int builtin_rehash(strvec_t *list);
+int builtin_cat(strvec_t *list);
+int builtin_tee(strvec_t *list);
+int builtin_cp(strvec_t *list);
+int builtin_jobs(strvec_t *list);
+int builtin_wait(strvec_t *list);
+int builtin_fg(strvec_t *list);
+int builtin_parallel(strvec_t *list);
+int builtin_echo(strvec_t *list);
+int builtin_true(strvec_t *list);
+int builtin_false(strvec_t *list);
+int builtin_test(strvec_t *list);
+int builtin_printf(strvec_t *list);
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,691 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "pathcache.h"
+#include "zerocopy.h"
+
+#define CACHE_MAGIC 0x3163796d      // "myc1", the start of every entry file
+#define CACHE_DEFAULT_MB 256
+#define CACHE_MAX_OUTPUTS 64
+
+// The counters in the stats file, it is also what the store is locked with (flock)
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t bytes;     // What the blobs take, give or take blobs nobody points to anymore until the next eviction
+} cache_counts_t;
+
+// One output of an entry in the entry file, the path follows it, pathLen 0 is stdout
+typedef struct {
+    cache_id_t blob;
+    uint64_t size;
+    uint32_t pathLen;
+} cache_output_t;
+
+typedef struct {
+    uint64_t a;
+    uint64_t b;
+    uint64_t len;
+} cache_hash_t;
+
+static char cacheRoot[4096];    // Empty until cache_open found (or made) the store
+
+/*
+ * Two 64 bit lanes over 8 byte words, 128 bits is plenty for names nobody picks on purpose
+ */
+static void cache_hash_init(cache_hash_t *h) {
+    h->a = 0x9e3779b97f4a7c15ULL;
+    h->b = 0xc2b2ae3d27d4eb4fULL;
+    h->len = 0;
+}
+
+static inline void cache_mix(cache_hash_t *h, uint64_t w) {
+    h->a = (h->a ^ w) * 0x9e3779b97f4a7c15ULL;
+    h->a = (h->a << 31) | (h->a >> 33);
+    h->b = (h->b + w) * 0xc2b2ae3d27d4eb4fULL;
+    h->b ^= h->b >> 29;
+}
+
+static void cache_hash_add(cache_hash_t *h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    h->len += len;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        cache_mix(h, w);
+    }
+    if (len > 0) {
+        uint64_t w = 0;
+        memcpy(&w, p, len);
+        cache_mix(h, w ^ ((uint64_t)len << 56));
+    }
+}
+
+// With its '\0', so "ab" "c" and "a" "bc" are not the same
+static void cache_hash_str(cache_hash_t *h, const char *s) {
+    cache_hash_add(h, s, strlen(s) + 1);
+}
+
+static uint64_t cache_fmix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static cache_id_t cache_hash_done(cache_hash_t *h) {
+    cache_id_t id;
+    id.hi = cache_fmix(h->a ^ h->len);
+    id.lo = cache_fmix(h->b ^ id.hi);
+    return id;
+}
+
+/* The stat of a file, what tells us it changed without reading it
+* Returns 1 if it is not there
+*/
+static int cache_hash_file(cache_hash_t *h, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return 1;
+    }
+    uint64_t stamp[7] = {st.st_dev, st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+                         st.st_ctim.tv_sec, st.st_ctim.tv_nsec};
+    cache_hash_add(h, stamp, sizeof(stamp));
+    return 0;
+}
+
+static void cache_name(const cache_id_t *id, char *name) {
+    snprintf(name, 33, "%016llx%016llx", (unsigned long long)id->hi, (unsigned long long)id->lo);
+}
+
+static int cache_parse_name(const char *name, cache_id_t *id) {
+    if (strlen(name) != 32 || strspn(name, "0123456789abcdef") != 32) {
+        return 1;
+    }
+    char half[17];
+    memcpy(half, name, 16);
+    half[16] = '\0';
+    id->hi = strtoull(half, NULL, 16);
+    id->lo = strtoull(name + 16, NULL, 16);
+    return 0;
+}
+
+// root/sub/name into buf, returns 1 if it does not fit
+static int cache_path(char *buf, size_t len, const char *sub, const char *name) {
+    return snprintf(buf, len, "%s/%s/%s", cacheRoot, sub, name) >= (int)len;
+}
+
+static int cache_mkdirs(const char *path) {
+    char buf[4096];
+    if (snprintf(buf, sizeof(buf), "%s", path) >= (int)sizeof(buf)) {
+        return 1;
+    }
+    for (char *p = buf + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(buf, 0755) != 0 && errno != EEXIST) {
+                return 1;
+            }
+            *p = '/';
+        }
+    }
+    return mkdir(buf, 0755) != 0 && errno != EEXIST;
+}
+
+/* Find the store and make its directories the first time, returns 1 if there is none we can use
+*/
+static int cache_open(void) {
+    if (cacheRoot[0] != '\0') {
+        return 0;
+    }
+    const char *dir = getenv("MYSH_CACHE_DIR");
+    const char *home = getenv("HOME");
+    int len;
+    if (dir != NULL && *dir != '\0') {
+        len = snprintf(cacheRoot, sizeof(cacheRoot), "%s", dir);
+    } else if (home != NULL && *home != '\0') {
+        len = snprintf(cacheRoot, sizeof(cacheRoot), "%s/.cache/mysh", home);
+    } else {
+        fprintf(stderr, "cached: set MYSH_CACHE_DIR or HOME for the cache\n");
+        return 1;
+    }
+    char sub[4096 + 16];
+    if (len >= (int)sizeof(cacheRoot) - 16) {
+        fprintf(stderr, "cached: cache directory name too long\n");
+        cacheRoot[0] = '\0';
+        return 1;
+    }
+    snprintf(sub, sizeof(sub), "%s/objects", cacheRoot);
+    int failed = cache_mkdirs(sub);
+    snprintf(sub, sizeof(sub), "%s/entries", cacheRoot);
+    if (failed || cache_mkdirs(sub)) {
+        perror(cacheRoot);
+        cacheRoot[0] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+/* Lock the store and read the counters, every change to the store happens between this and cache_unlock
+* Returns the locked fd, or -1
+*/
+static int cache_lock(cache_counts_t *counts) {
+    if (cache_open() != 0) {
+        return -1;
+    }
+    char path[4096 + 16];
+    snprintf(path, sizeof(path), "%s/stats", cacheRoot);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    while (flock(fd, LOCK_EX) != 0 && errno == EINTR) {
+        // Another shell is storing
+    }
+    memset(counts, 0, sizeof(*counts));
+    if (pread(fd, counts, sizeof(*counts), 0) != sizeof(*counts)) {
+        memset(counts, 0, sizeof(*counts)); // A new store
+    }
+    return fd;
+}
+
+static void cache_unlock(int fd, const cache_counts_t *counts) {
+    if (pwrite(fd, counts, sizeof(*counts), 0) != sizeof(*counts)) {
+        perror("cached: stats");
+    }
+    close(fd); // Drops the lock
+}
+
+static uint64_t cache_limit(void) {
+    const char *mb = getenv("MYSH_CACHE_SIZE");
+    long long n = (mb != NULL) ? atoll(mb) : 0;
+    return (uint64_t)(n > 0 ? n : CACHE_DEFAULT_MB) * 1024 * 1024;
+}
+
+/*
+ * Everything the line depends on, see cache.h, inputs are the -i files
+ * Returns 0 with key filled in, 1 if the line can not be cached (an input is missing, it should run and fail the normal way)
+ */
+int cache_key(command_t *cmd, char **inputs, int inputCount, cache_id_t *key) {
+    cache_hash_t h;
+    cache_hash_init(&h);
+    char buf[4096];
+    if (getcwd(buf, sizeof(buf)) == NULL) {
+        return 1;
+    }
+    cache_hash_str(&h, buf);
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next) {
+        char **words = stage->args->data;
+        uint64_t count = 0;
+        while (words[count] != NULL) {
+            count++;
+        }
+        cache_hash_add(&h, &count, sizeof(count));
+        for (uint64_t i = 0; i < count; i++) {
+            cache_hash_str(&h, words[i]);
+        }
+        // The program itself, so a new version of it is a miss
+        if (strchr(words[0], '/') != NULL) {
+            cache_hash_file(&h, words[0]);
+        } else if (pc_lookup(words[0], buf, sizeof(buf)) == 0) {
+            cache_hash_str(&h, buf);
+            cache_hash_file(&h, buf);
+        }
+        if (stage->inputFile != NULL) {
+            cache_hash_str(&h, stage->inputFile);
+            if (cache_hash_file(&h, stage->inputFile) != 0) {
+                return 1;
+            }
+        }
+        if (stage->hereData != NULL) {
+            uint64_t len = stage->hereLen;
+            cache_hash_add(&h, &len, sizeof(len));
+            cache_hash_add(&h, stage->hereData, stage->hereLen);
+        }
+        cache_hash_str(&h, stage->outputFile != NULL ? stage->outputFile : "");
+    }
+    for (int i = 0; i < inputCount; i++) {
+        cache_hash_str(&h, inputs[i]);
+        if (cache_hash_file(&h, inputs[i]) != 0) {
+            fprintf(stderr, "cached: %s: %s\n", inputs[i], strerror(errno));
+            return 1;
+        }
+    }
+    *key = cache_hash_done(&h);
+    return 0;
+}
+
+/* Write the whole content of fd (from offset 0) into objects/ under the hash of that content
+* Returns the bytes the store grew by (0 if that content was there already), -1 on an error
+*/
+static long long cache_put_blob(int fd, cache_output_t *out) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    cache_hash_t h;
+    cache_hash_init(&h);
+    if (st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            return -1;
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        cache_hash_add(&h, data, st.st_size);
+        munmap(data, st.st_size);
+    }
+    out->blob = cache_hash_done(&h);
+    out->size = st.st_size;
+
+    char name[33], path[4096 + 64], tmp[4096 + 64];
+    cache_name(&out->blob, name);
+    if (cache_path(path, sizeof(path), "objects", name) != 0) {
+        return -1;
+    }
+    if (access(path, F_OK) == 0) {
+        return 0; // Same output as some other line, nothing to write
+    }
+    snprintf(tmp, sizeof(tmp), "%s/objects/tmp.%d", cacheRoot, (int)getpid());
+    int blobFd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (blobFd < 0) {
+        return -1;
+    }
+    int failed = lseek(fd, 0, SEEK_SET) != 0 || zc_copy(fd, blobFd) != 0;
+    if (close(blobFd) != 0 || failed || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return st.st_size;
+}
+
+/* The outputs of an entry file, malloc'd, count is set to how many there are
+* Returns NULL if it is not there or not one of ours
+*/
+static char *cache_read_entry(int fd, uint32_t *count) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 8 || st.st_size > 1024 * 1024) {
+        return NULL;
+    }
+    char *data = malloc(st.st_size);
+    if (data == NULL || pread(fd, data, st.st_size, 0) != st.st_size) {
+        free(data);
+        return NULL;
+    }
+    uint32_t magic;
+    memcpy(&magic, data, 4);
+    memcpy(count, data + 4, 4);
+    // Walk it once so the callers can trust the lengths
+    size_t pos = 8;
+    for (uint32_t i = 0; i < *count && magic == CACHE_MAGIC; i++) {
+        cache_output_t out;
+        if (pos + sizeof(out) > (size_t)st.st_size) {
+            magic = 0;
+            break;
+        }
+        memcpy(&out, data + pos, sizeof(out));
+        pos += sizeof(out) + out.pathLen;
+        if (pos > (size_t)st.st_size || out.pathLen >= 4096) {
+            magic = 0;
+        }
+    }
+    if (magic != CACHE_MAGIC || *count > CACHE_MAX_OUTPUTS) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+/*
+ * A hit writes back every output of the entry, the > files and then stdout, and marks the entry as used for the LRU
+ * Returns 0 for a hit, 1 for a miss (nothing was written then, the line has to run)
+ */
+int cache_restore(const cache_id_t *key, command_t *cmd) {
+    (void)cmd; // The entry has the paths, the key made sure they are the same ones
+    cache_counts_t counts;
+    int lockFd = cache_lock(&counts);
+    if (lockFd < 0) {
+        return 1;
+    }
+    char name[33], path[4096 + 64];
+    cache_name(key, name);
+    int result = 1;
+    uint32_t count = 0;
+    char *entry = NULL;
+    int blobs[CACHE_MAX_OUTPUTS];
+    int opened = 0;
+    int entryFd = -1;
+    if (cache_path(path, sizeof(path), "entries", name) == 0) {
+        entryFd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (entryFd >= 0) {
+        entry = cache_read_entry(entryFd, &count);
+    }
+
+    // Every blob has to be there before anything is written
+    size_t pos = 8;
+    for (; entry != NULL && opened < (int)count; opened++) {
+        cache_output_t out;
+        memcpy(&out, entry + pos, sizeof(out));
+        pos += sizeof(out) + out.pathLen;
+        char blobName[33];
+        cache_name(&out.blob, blobName);
+        cache_path(path, sizeof(path), "objects", blobName);
+        blobs[opened] = open(path, O_RDONLY | O_CLOEXEC);
+        if (blobs[opened] < 0) {
+            break;
+        }
+    }
+    if (entry != NULL && opened == (int)count) {
+        result = 0;
+        pos = 8;
+        for (uint32_t i = 0; i < count; i++) {
+            cache_output_t out;
+            memcpy(&out, entry + pos, sizeof(out));
+            pos += sizeof(out);
+            if (out.pathLen == 0) {
+                fflush(stdout);
+                if (zc_copy(blobs[i], STDOUT_FILENO) != 0) {
+                    perror("cached: stdout");
+                }
+                continue;
+            }
+            memcpy(path, entry + pos, out.pathLen);
+            path[out.pathLen] = '\0';
+            pos += out.pathLen;
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+            if (fd < 0 || zc_copy(blobs[i], fd) != 0) {
+                perror(path);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        futimens(entryFd, NULL); // Just used, last in line for eviction
+    }
+    for (int i = 0; i < opened && i < (int)count; i++) {
+        close(blobs[i]);
+    }
+    if (entryFd >= 0) {
+        close(entryFd);
+    }
+    free(entry);
+    if (result == 0) {
+        counts.hits++;
+    } else {
+        counts.misses++;
+    }
+    cache_unlock(lockFd, &counts);
+    return result;
+}
+
+typedef struct {
+    char name[33];
+    struct timespec used;
+    cache_output_t *outputs;
+    uint32_t count;
+} cache_entry_t;
+
+static int cache_newest_first(const void *x, const void *y) {
+    const cache_entry_t *a = x, *b = y;
+    if (a->used.tv_sec != b->used.tv_sec) {
+        return (a->used.tv_sec < b->used.tv_sec) - (a->used.tv_sec > b->used.tv_sec);
+    }
+    return (a->used.tv_nsec < b->used.tv_nsec) - (a->used.tv_nsec > b->used.tv_nsec);
+}
+
+// Open addressing set of blob ids, capacity is a power of two, an all zero id is an empty slot
+static int cache_set_add(cache_id_t *set, size_t capacity, const cache_id_t *id) {
+    for (size_t i = id->lo & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+        if (set[i].hi == 0 && set[i].lo == 0) {
+            set[i] = *id;
+            return 1;
+        }
+        if (set[i].hi == id->hi && set[i].lo == id->lo) {
+            return 0;
+        }
+    }
+}
+
+static int cache_set_has(const cache_id_t *set, size_t capacity, const cache_id_t *id) {
+    for (size_t i = id->lo & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+        if (set[i].hi == 0 && set[i].lo == 0) {
+            return 0;
+        }
+        if (set[i].hi == id->hi && set[i].lo == id->lo) {
+            return 1;
+        }
+    }
+}
+
+/*
+ * Drop the least recently used entries until the blobs the rest point to fit in 90% of the limit,
+ * then every blob nobody points to anymore. The newest entry always stays, it is the one just stored
+ * Runs with the store locked, and only once the limit is passed, so it can take its time
+ */
+static void cache_evict(cache_counts_t *counts, uint64_t limit) {
+    char path[4096 + 64];
+    snprintf(path, sizeof(path), "%s/entries", cacheRoot);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    cache_entry_t *entries = NULL;
+    size_t entryCount = 0, entryCap = 0, refs = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        cache_id_t id;
+        if (cache_parse_name(de->d_name, &id) != 0) {
+            continue;
+        }
+        int fd = openat(dirfd(dir), de->d_name, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        uint32_t count;
+        char *data = (fd >= 0 && fstat(fd, &st) == 0) ? cache_read_entry(fd, &count) : NULL;
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (data == NULL) {
+            continue;
+        }
+        if (entryCount == entryCap) {
+            entryCap = entryCap ? entryCap * 2 : 64;
+            cache_entry_t *grown = realloc(entries, entryCap * sizeof(cache_entry_t));
+            if (grown == NULL) {
+                free(data);
+                break;
+            }
+            entries = grown;
+        }
+        cache_entry_t *e = &entries[entryCount];
+        e->outputs = malloc((count ? count : 1) * sizeof(cache_output_t));
+        if (e->outputs == NULL) {
+            free(data);
+            break;
+        }
+        size_t pos = 8;
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(&e->outputs[i], data + pos, sizeof(cache_output_t));
+            pos += sizeof(cache_output_t) + e->outputs[i].pathLen;
+        }
+        free(data);
+        memcpy(e->name, de->d_name, 33);
+        e->used = st.st_mtim;
+        e->count = count;
+        refs += count;
+        entryCount++;
+    }
+    closedir(dir);
+    qsort(entries, entryCount, sizeof(cache_entry_t), cache_newest_first);
+
+    size_t capacity = 16;
+    while (capacity < 2 * refs + 2) {
+        capacity *= 2;
+    }
+    cache_id_t *kept = calloc(capacity, sizeof(cache_id_t));
+    if (kept == NULL) {
+        goto done;
+    }
+    uint64_t target = limit / 10 * 9;
+    uint64_t keptBytes = 0;
+    size_t keep = entryCount;
+    for (size_t i = 0; i < entryCount; i++) {
+        uint64_t added = 0;
+        for (uint32_t j = 0; j < entries[i].count; j++) {
+            if (!cache_set_has(kept, capacity, &entries[i].outputs[j].blob)) {
+                added += entries[i].outputs[j].size;
+            }
+        }
+        if (i > 0 && keptBytes + added > target) {
+            keep = i;
+            break;
+        }
+        for (uint32_t j = 0; j < entries[i].count; j++) {
+            cache_set_add(kept, capacity, &entries[i].outputs[j].blob);
+        }
+        keptBytes += added;
+    }
+    for (size_t i = keep; i < entryCount; i++) {
+        cache_path(path, sizeof(path), "entries", entries[i].name);
+        unlink(path);
+        counts->evictions++;
+    }
+
+    snprintf(path, sizeof(path), "%s/objects", cacheRoot);
+    dir = opendir(path);
+    while (dir != NULL && (de = readdir(dir)) != NULL) {
+        cache_id_t id;
+        if (cache_parse_name(de->d_name, &id) == 0 && !cache_set_has(kept, capacity, &id)) {
+            unlinkat(dirfd(dir), de->d_name, 0);
+        }
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    counts->bytes = keptBytes;
+    free(kept);
+done:
+    for (size_t i = 0; i < entryCount; i++) {
+        free(entries[i].outputs);
+    }
+    free(entries);
+}
+
+/*
+ * After a miss that exited 0, keep what the line wrote: every > file of its stages and its stdout,
+ * which the caller captured into stdoutFd
+ * Returns 0 if the entry was stored
+ */
+int cache_store(const cache_id_t *key, command_t *cmd, int stdoutFd) {
+    cache_counts_t counts;
+    int lockFd = cache_lock(&counts);
+    if (lockFd < 0) {
+        return 1;
+    }
+    char buf[8 + CACHE_MAX_OUTPUTS * (sizeof(cache_output_t) + 256)];
+    uint32_t magic = CACHE_MAGIC, count = 0;
+    size_t pos = 8;
+    int failed = 0;
+    for (command_t *stage = cmd; stage != NULL && !failed; stage = stage->next) {
+        if (stage->outputFile == NULL) {
+            continue;
+        }
+        cache_output_t out;
+        memset(&out, 0, sizeof(out));
+        out.pathLen = strlen(stage->outputFile);
+        int fd = open(stage->outputFile, O_RDONLY | O_CLOEXEC);
+        long long added = (fd >= 0) ? cache_put_blob(fd, &out) : -1;
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (added < 0 || count == CACHE_MAX_OUTPUTS - 1 || pos + sizeof(out) + out.pathLen > sizeof(buf)) {
+            failed = 1;
+            break;
+        }
+        counts.bytes += added;
+        memcpy(buf + pos, &out, sizeof(out));
+        memcpy(buf + pos + sizeof(out), stage->outputFile, out.pathLen);
+        pos += sizeof(out) + out.pathLen;
+        count++;
+    }
+    if (!failed) {
+        cache_output_t out;
+        memset(&out, 0, sizeof(out));
+        long long added = cache_put_blob(stdoutFd, &out);
+        if (added < 0) {
+            failed = 1;
+        } else {
+            counts.bytes += added;
+            memcpy(buf + pos, &out, sizeof(out));
+            pos += sizeof(out);
+            count++;
+        }
+    }
+    memcpy(buf, &magic, 4);
+    memcpy(buf + 4, &count, 4);
+
+    // Written next to it and renamed, so a reader never sees half an entry
+    char name[33], path[4096 + 64], tmp[4096 + 64];
+    cache_name(key, name);
+    snprintf(tmp, sizeof(tmp), "%s/entries/tmp.%d", cacheRoot, (int)getpid());
+    if (!failed && cache_path(path, sizeof(path), "entries", name) == 0) {
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        failed = fd < 0 || write(fd, buf, pos) != (ssize_t)pos;
+        if (fd >= 0 && close(fd) != 0) {
+            failed = 1;
+        }
+        if (failed || rename(tmp, path) != 0) {
+            unlink(tmp);
+            failed = 1;
+        }
+    }
+    if (failed) {
+        fprintf(stderr, "cached: could not store the result in %s\n", cacheRoot);
+    }
+    uint64_t limit = cache_limit();
+    if (counts.bytes > limit) {
+        cache_evict(&counts, limit);
+    }
+    cache_unlock(lockFd, &counts);
+    return failed;
+}
+
+/* cached -s, the counters and what is in the store
+*/
+void cache_stats(FILE *out) {
+    cache_counts_t counts;
+    int lockFd = cache_lock(&counts);
+    if (lockFd < 0) {
+        return;
+    }
+    char path[4096 + 16];
+    snprintf(path, sizeof(path), "%s/entries", cacheRoot);
+    long entries = 0;
+    DIR *dir = opendir(path);
+    struct dirent *de;
+    while (dir != NULL && (de = readdir(dir)) != NULL) {
+        cache_id_t id;
+        entries += cache_parse_name(de->d_name, &id) == 0;
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    fprintf(out, "cache: %s\n", cacheRoot);
+    fprintf(out, "hits %llu, misses %llu, evictions %llu\n", (unsigned long long)counts.hits,
+            (unsigned long long)counts.misses, (unsigned long long)counts.evictions);
+    fprintf(out, "entries %ld, %llu of %llu bytes\n", entries, (unsigned long long)counts.bytes,
+            (unsigned long long)cache_limit());
+    close(lockFd);
+}
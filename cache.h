@@ -0,0 +1,28 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "command.h"
+
+/*
+ * Results of lines run with the cached prefix, so a line whose inputs did not change is not run again
+ * The key of a line is a hash of the directory, every stage's words and executable (path, inode, size, mtime),
+ * the stat of every < file and -i file (device, inode, size, mtime, ctime) and the here-doc bodies
+ * A line that exited 0 stores its stdout and its > files as blobs named by the hash of their content, so the same output
+ * is kept only once, and an entry named by the key lists them. A hit writes them back and nothing runs
+ * The store is $MYSH_CACHE_DIR (~/.cache/mysh by default), entries/, objects/ and a stats file with the counters,
+ * once the blobs take more than $MYSH_CACHE_SIZE MB (256) the least recently used entries are dropped
+ */
+
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} cache_id_t;
+
+int cache_key(command_t *cmd, char **inputs, int inputCount, cache_id_t *key);
+int cache_restore(const cache_id_t *key, command_t *cmd);
+int cache_store(const cache_id_t *key, command_t *cmd, int stdoutFd);
+void cache_stats(FILE *out);
+
+#endif
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command.h"
+
+/*
+ * This function creates a new commandStructure
+ * The struct and its args list both come from arena, so there is nothing to free, the arena reset after the line takes them
+ */
+command_t *createCommandStruct(arena_t *arena) {
+    command_t *cmd = arena_alloc(arena, sizeof(command_t));
+    if (cmd == NULL) {
+        perror("arena_alloc failed in createCommandStruct");
+        return NULL;
+    }
+    cmd->program = NULL; 
+    // The argument list, the first 8 words fit in it and only a longer line takes more from the arena
+    cmd->args = arena_alloc(arena, sizeof(strvec_t));
+    if (cmd->args == NULL) {
+        perror("arena_alloc failed for args list");
+        return NULL;
+    }
+    strvec_init(cmd->args, arena);
+
+    cmd->inputFile = NULL;
+    cmd->outputFile = NULL;
+    cmd->hereDelim = NULL;
+    cmd->hereData = NULL;
+    cmd->hereLen = 0;
+    cmd->pipePresent = 0;
+    cmd->startsWithCondition = 0;
+    cmd->background = 0;
+    cmd->next = NULL;
+    cmd->condition = NONE;
+    return cmd;
+}
+
+/*
+ * This function will add a token to the struct commands argument list
+ * The token is not copied, it has to live as long as the line (tokens are slices of the line buffer, wildcard matches are in the arena)
+ */
+
+void addTokenToArgs(command_t *cmd, char *token) {
+    if (strvec_push(cmd->args, token) != 0) {
+        fprintf(stderr, "Failed to add token to args list\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * finalizeArgs--> it adds a null pointer to the end of our args list
+ * This mkaes sure that cmd->args->data is properly null-terminated so we dont get any errors
+ */
+
+void finalizeArgs(command_t *cmd) {
+    if (strvec_push(cmd->args, NULL) != 0) {
+        fprintf(stderr, "Failed to finalize args list\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * The word of the << or <<< in token i, stuck on (<<EOF) or the next token (<< EOF), which i then moves past
+ * Quotes around it are taken off ('EOF' and "EOF" are EOF, nothing is expanded in a body anyway)
+ * Returns NULL if there is no word, *len is the length without the quotes
+ */
+static const char *hereWord(toklist_t *tokens, unsigned int *i, char *line, size_t *len) {
+    token_t *tok = &tokens->data[*i];
+    unsigned int skip = (tok->kind == TOK_HERESTR) ? 3 : 2;
+    const char *word;
+    if (tok->length > skip) {
+        word = line + tok->offset + skip;
+        *len = tok->length - skip;
+    } else if (*i + 1 < tokens->length) {
+        (*i)++;
+        word = line + tokens->data[*i].offset;
+        *len = tokens->data[*i].length;
+    } else {
+        return NULL;
+    }
+    if (*len >= 2 && (word[0] == '\'' || word[0] == '"') && word[*len - 1] == word[0]) {
+        word++;
+        *len -= 2;
+    }
+    return word;
+}
+
+/* Build the command structure for the tokens tok_split found in line, nothing is run here
+ * The tokens already know their kind, so we switch on it, and line + offset is already a '\0' terminated word
+ * Words are stored as they are, wildcards are expanded right before the command runs
+ * Returns the head of the pipeline, or NULL for a syntax error (the error is already printed)
+ */
+command_t *parseCommand(toklist_t *tokens, char *line, arena_t *arena) {
+    command_t *commandHead = createCommandStruct(arena);
+    if (!commandHead) {
+        fprintf(stderr, "Failed to create command structure\n");
+        return NULL;
+    }
+    commandHead->startsWithCondition = (tokens->data[0].kind == TOK_AND || tokens->data[0].kind == TOK_OR);
+    
+    command_t *ptr = commandHead; //Made a comand linked list for the pipe if it appears
+
+    // Process each token in the tokenized input.
+    for (unsigned int i = 0; i < tokens->length; i++) {
+        token_t *tok = &tokens->data[i];
+        
+        switch (tok->kind) {
+            case TOK_LT:  // If word == <
+                if (ptr->hereDelim != NULL || ptr->hereData != NULL) {
+                    fprintf(stderr, "Syntax error: '<' and a here-document on the same command\n");
+                    return NULL;
+                }
+                i++;  // Move to the filename.
+                if (i < tokens->length) {
+                    ptr->inputFile = line + tokens->data[i].offset;  // Points into the line, no copy needed
+                } else {
+                    fprintf(stderr, "Syntax error: missing input file after '<'\n");
+                    return NULL;
+                }
+                break;
+            case TOK_GT:  // If word == >
+                i++;  // Move to the filename.
+                if (i < tokens->length) {
+                    ptr->outputFile = line + tokens->data[i].offset;
+                } else {
+                    fprintf(stderr, "Error: missing output file after '>'\n");
+                    return NULL;
+                }
+                break;
+            case TOK_HEREDOC:  // << EOF, the body is filled in by readHereDocs once the whole line is parsed
+            case TOK_HERESTR:  // <<< word, the word and a newline are the input
+            {
+                size_t len;
+                const char *word = hereWord(tokens, &i, line, &len);
+                if (word == NULL) {
+                    fprintf(stderr, "Syntax error: missing word after '%s'\n", tok->kind == TOK_HEREDOC ? "<<" : "<<<");
+                    return NULL;
+                }
+                if (ptr->inputFile != NULL || ptr->hereDelim != NULL || ptr->hereData != NULL) {
+                    fprintf(stderr, "Syntax error: more than one input for a command with a here-document\n");
+                    return NULL;
+                }
+                if (tok->kind == TOK_HEREDOC) {
+                    ptr->hereDelim = arena_strndup(arena, word, len);
+                    if (ptr->hereDelim == NULL) {
+                        perror("arena_alloc failed for a here-document");
+                        return NULL;
+                    }
+                } else {
+                    ptr->hereData = arena_alloc(arena, len + 1);
+                    if (ptr->hereData == NULL) {
+                        perror("arena_alloc failed for a here-string");
+                        return NULL;
+                    }
+                    memcpy(ptr->hereData, word, len);
+                    ptr->hereData[len] = '\n';
+                    ptr->hereLen = len + 1;
+                }
+                break;
+            }
+            case TOK_PIPE:  // If token == |
+                ptr->pipePresent = 1;
+                ptr->next = createCommandStruct(arena);
+                if (!ptr->next) { 
+                    fprintf(stderr, "Pipeline has no next command; failed to proceed\n");
+                    return NULL;
+                }
+                ptr = ptr->next; 
+                break;
+            case TOK_AND:  //Handle conditional operators
+            case TOK_OR:
+                if (ptr != commandHead) {
+                    fprintf(stderr, "Error: conditional operator cannot appear after a pipe\n");
+                    return NULL;
+                }
+                ptr->condition = (tok->kind == TOK_AND) ? AND : OR;
+                break;
+            case TOK_AMP:  // Only as the last token, it is about the whole line, anywhere else it is just a word
+                if (i != tokens->length - 1) {
+                    addTokenToArgs(ptr, line + tok->offset);
+                } else {
+                    commandHead->background = 1;
+                }
+                break;
+            case TOK_WORD:  // Now just as regular, * words too since they get expanded when the line runs
+                addTokenToArgs(ptr, line + tok->offset);
+                break;
+        }
+    }
+    
+    // Finalize the argument list of every stage by appending a NULL pointer.
+    for (command_t *stage = commandHead; stage != NULL; stage = stage->next) {
+        finalizeArgs(stage);
+    }
+    
+    if (commandHead->args->data[0] == NULL) {
+        fprintf(stderr, "Error: missing command after conditional operator.\n");
+        return NULL;
+    }
+    for (command_t *stage = commandHead->next; stage != NULL; stage = stage->next) {
+        if (stage->args->data[0] == NULL) {
+            fprintf(stderr, "Error: missing command after '|'\n");
+            return NULL;
+        }
+    }
+    
+    // Make sure no conditioals come after piping
+    command_t *temp = commandHead->next;
+    while (temp != NULL) {
+        if (temp->condition != NONE) {
+            fprintf(stderr, "Error: conditional operator cannot appear after a pipe\n");
+            return NULL;
+        }
+        temp = temp->next;
+    }
+    return commandHead;
+}
+
+/*
+ * Read the lines up to the one that is exactly delim into one block from arena, into *data and *len
+ * With arena NULL the lines are only skipped. Returns 0 for success, 1 if the arena ran out
+ */
+static int readHereBody(const char *delim, size_t delimLen, here_lines_t nextLine, void *ctx, arena_t *arena,
+                        char **data, size_t *len) {
+    size_t capacity = 256, used = 0;
+    char *body = NULL;
+    if (arena != NULL && (body = arena_alloc(arena, capacity)) == NULL) {
+        return 1;
+    }
+    for (;;) {
+        size_t lineLen;
+        char *line = nextLine(ctx, &lineLen);
+        if (line == NULL) {
+            fprintf(stderr, "Warning: here-document ended by the end of the file (wanted '%.*s')\n", (int)delimLen, delim);
+            break;
+        }
+        if (lineLen == delimLen && memcmp(line, delim, delimLen) == 0) {
+            break;
+        }
+        if (arena == NULL) {
+            continue;
+        }
+        if (used + lineLen + 1 > capacity) {
+            // The old block stays in the arena until the line is done, like everything else
+            while (used + lineLen + 1 > capacity) {
+                capacity *= 2;
+            }
+            char *grown = arena_alloc(arena, capacity);
+            if (grown == NULL) {
+                return 1;
+            }
+            memcpy(grown, body, used);
+            body = grown;
+        }
+        memcpy(body + used, line, lineLen);
+        used += lineLen;
+        body[used++] = '\n';
+    }
+    *data = body;
+    *len = used;
+    return 0;
+}
+
+/*
+ * The bodies of the << here-docs of a line come from the lines right after it, one after the other in the order they
+ * were written like sh does, nextLine hands them out. cmd is the parsed line, or NULL if it did not parse, then the
+ * bodies are still read (and dropped) so they are never run as commands
+ * Returns 0 for success, 1 if the arena ran out (already printed)
+ */
+int readHereDocs(command_t *cmd, toklist_t *tokens, char *line, here_lines_t nextLine, void *ctx, arena_t *arena) {
+    if (cmd != NULL) {
+        for (command_t *stage = cmd; stage != NULL; stage = stage->next) {
+            if (stage->hereDelim != NULL &&
+                readHereBody(stage->hereDelim, strlen(stage->hereDelim), nextLine, ctx, arena, &stage->hereData, &stage->hereLen) != 0) {
+                perror("arena_alloc failed for a here-document");
+                return 1;
+            }
+        }
+        return 0;
+    }
+    for (unsigned int i = 0; i < tokens->length; i++) {
+        if (tokens->data[i].kind != TOK_HEREDOC) {
+            continue;
+        }
+        size_t len;
+        const char *delim = hereWord(tokens, &i, line, &len);
+        char *data;
+        size_t dataLen;
+        if (delim != NULL) {
+            readHereBody(delim, len, nextLine, ctx, NULL, &data, &dataLen);
+        }
+    }
+    return 0;
+}
+
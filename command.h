@@ -0,0 +1,37 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "arena.h"
+#include "vec.h"
+#include "tokenizer.h"
+
+/*
+ * The struct command where it will hold all the needed data when we process a line
+ * parseCommand only builds it, running it is up to mysh.c, so a parsed line can also be saved by myshc.c and loaded again later
+ */
+
+typedef struct command {
+    char *program;          // The name of the program, which is really the executable
+    strvec_t *args;         // The argument strings, for execv use args->data as it holds the string names
+    char *inputFile;        // Input redirection filename 
+    char *outputFile;       // Output redirection filename 
+    char *hereDelim;        // << word, readHereDocs reads the body out of the lines after the command
+    char *hereData;         // Body of the here-doc, or the word and a newline for <<<, it is stdin instead of a file
+    size_t hereLen;
+    int pipePresent;        // Flag that shows if a pipe exists
+    int startsWithCondition; // The line started with and/or, which is an error if nothing has run yet
+    int background;         // The line ended with &, it runs as a job and nobody waits for it
+    struct command *next;   // When pipelines exist we need to seperate commands so we will use a linked list of commands
+    enum { NONE, AND, OR } condition;  // Conditional operator relative to previous command
+}command_t;
+
+command_t *createCommandStruct(arena_t *arena);
+void addTokenToArgs(command_t *cmd, char *token);
+void finalizeArgs(command_t *cmd);
+command_t *parseCommand(toklist_t *tokens, char *line, arena_t *arena);
+
+// Hands out the next line of the script without its newline, NULL at the end, for the here-doc bodies
+typedef char *(*here_lines_t)(void *ctx, size_t *len);
+int readHereDocs(command_t *cmd, toklist_t *tokens, char *line, here_lines_t nextLine, void *ctx, arena_t *arena);
+
+#endif
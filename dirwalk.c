@@ -0,0 +1,359 @@
+#define _GNU_SOURCE // For getdents64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "dirwalk.h"
+
+#define DIRWALK_BUFSIZE (256 * 1024)    // getdents64 buffer per thread
+#define DIRWALK_CHUNK (64 * 1024)       // Path strings are packed into chunks this big
+#define DIRWALK_MAX_THREADS 16
+
+struct dirwalk_chunk {
+    struct dirwalk_chunk *next;
+    size_t used;
+    char data[DIRWALK_CHUNK];
+};
+
+typedef struct {
+    char *path;     // With a / at the end unless it is the root, malloc'd
+    size_t len;
+} dw_task_t;
+
+// Owner pushes and pops at the tail, thieves take from the head, so a thief gets the oldest (biggest) piece of the tree
+typedef struct {
+    pthread_mutex_t lock;
+    dw_task_t *tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} dw_deque_t;
+
+struct dw_pool;
+
+typedef struct {
+    struct dw_pool *pool;
+    int id;
+    dw_deque_t queue;
+    char *buf;
+    char **paths;
+    size_t count;
+    size_t capacity;
+    dirwalk_chunk_t *chunks;
+    int failed;
+} dw_worker_t;
+
+typedef struct dw_pool {
+    dw_worker_t *workers;
+    int workerCount;
+    atomic_long pending;    // Directories queued or being read, the walk is over when it gets to 0
+    atomic_long queued;     // Directories sitting in some deque, not taken by anyone yet
+    atomic_int sleeping;    // Workers parked on wake because there was nothing to take
+    pthread_mutex_t idleLock;
+    pthread_cond_t wake;    // A directory was queued, or the walk is over
+    dirwalk_filter_t filter;
+    const void *ctx;
+} dw_pool_t;
+
+static int dw_push(dw_deque_t *q, dw_task_t task) {
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->capacity) {
+        // Slide what is left to the front before growing
+        size_t live = q->tail - q->head;
+        if (q->head > 0 && live < q->capacity / 2) {
+            memmove(q->tasks, q->tasks + q->head, live * sizeof(dw_task_t));
+        } else {
+            size_t newcap = q->capacity ? q->capacity * 2 : 64;
+            dw_task_t *grown = malloc(newcap * sizeof(dw_task_t));
+            if (grown == NULL) {
+                pthread_mutex_unlock(&q->lock);
+                return 1;
+            }
+            memcpy(grown, q->tasks + q->head, live * sizeof(dw_task_t));
+            free(q->tasks);
+            q->tasks = grown;
+            q->capacity = newcap;
+        }
+        q->head = 0;
+        q->tail = live;
+    }
+    q->tasks[q->tail++] = task;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+static int dw_pop(dw_deque_t *q, dw_task_t *task, int steal) {
+    int found = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+        *task = steal ? q->tasks[q->head++] : q->tasks[--q->tail];
+        found = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+// Wake a parked worker for a directory that was just queued, or all of them once the walk is over
+// queued/pending are changed before sleeping is looked at and dw_idle does it the other way round, so one of the two sides
+// always sees the other and no wakeup is lost
+static void dw_wake(dw_pool_t *pool, int all) {
+    if (atomic_load(&pool->sleeping) == 0) {
+        return;
+    }
+    pthread_mutex_lock(&pool->idleLock);
+    if (all) {
+        pthread_cond_broadcast(&pool->wake);
+    } else {
+        pthread_cond_signal(&pool->wake);
+    }
+    pthread_mutex_unlock(&pool->idleLock);
+}
+
+// Nothing to take anywhere, sleep until a directory is queued or the walk is over, returns 1 when it is over
+static int dw_idle(dw_pool_t *pool) {
+    pthread_mutex_lock(&pool->idleLock);
+    atomic_fetch_add(&pool->sleeping, 1);
+    while (atomic_load(&pool->pending) > 0 && atomic_load(&pool->queued) == 0) {
+        pthread_cond_wait(&pool->wake, &pool->idleLock);
+    }
+    atomic_fetch_sub(&pool->sleeping, 1);
+    pthread_mutex_unlock(&pool->idleLock);
+    return atomic_load(&pool->pending) == 0;
+}
+
+static char *dw_store(dw_worker_t *w, const char *a, size_t alen, const char *b, size_t blen, int slash) {
+    size_t need = alen + blen + slash + 1;
+    if (need > DIRWALK_CHUNK) {
+        return NULL;
+    }
+    if (w->chunks == NULL || w->chunks->used + need > DIRWALK_CHUNK) {
+        dirwalk_chunk_t *chunk = malloc(sizeof(dirwalk_chunk_t));
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = w->chunks;
+        chunk->used = 0;
+        w->chunks = chunk;
+    }
+    char *s = w->chunks->data + w->chunks->used;
+    memcpy(s, a, alen);
+    memcpy(s + alen, b, blen);
+    if (slash) {
+        s[alen + blen] = '/';
+    }
+    s[need - 1] = '\0';
+    w->chunks->used += need;
+    return s;
+}
+
+static int dw_keep(dw_worker_t *w, char *path) {
+    if (path == NULL) {
+        return 1;
+    }
+    if (w->count == w->capacity) {
+        size_t newcap = w->capacity ? w->capacity * 2 : 256;
+        char **grown = realloc(w->paths, newcap * sizeof(char *));
+        if (grown == NULL) {
+            return 1;
+        }
+        w->paths = grown;
+        w->capacity = newcap;
+    }
+    w->paths[w->count++] = path;
+    return 0;
+}
+
+// Read one directory, keep what the filter wants and queue the subdirectories on our own deque
+static void dw_read_dir(dw_worker_t *w, dw_task_t *task) {
+    dw_pool_t *pool = w->pool;
+    int fd = open(task->len ? task->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return; // Not readable, or gone since we saw it, it just has nothing in it for us
+    }
+    for (;;) {
+        ssize_t n = getdents64(fd, w->buf, DIRWALK_BUFSIZE);
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t off = 0; off < n;) {
+            struct dirent64 *entry = (struct dirent64 *)(w->buf + off);
+            off += entry->d_reclen;
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            int isDir = (entry->d_type == DT_DIR);
+            if (entry->d_type == DT_UNKNOWN) {
+                // Some filesystems do not fill in d_type, only then do we pay for a stat
+                struct stat st;
+                isDir = fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+            }
+            size_t nameLen = strlen(name);
+            int keep = pool->filter(pool->ctx, name, isDir);
+            if (keep != DIRWALK_SKIP &&
+                dw_keep(w, dw_store(w, task->path, task->len, name, nameLen, keep == DIRWALK_KEEP_SLASH)) != 0) {
+                w->failed = 1;
+            }
+            if (isDir && name[0] != '.') { // Hidden directories are not walked into
+                dw_task_t sub;
+                sub.len = task->len + nameLen + 1;
+                sub.path = malloc(sub.len + 1);
+                if (sub.path == NULL) {
+                    w->failed = 1;
+                    continue;
+                }
+                memcpy(sub.path, task->path, task->len);
+                memcpy(sub.path + task->len, name, nameLen);
+                sub.path[sub.len - 1] = '/';
+                sub.path[sub.len] = '\0';
+                atomic_fetch_add(&pool->pending, 1);
+                if (dw_push(&w->queue, sub) != 0) {
+                    free(sub.path);
+                    atomic_fetch_sub(&pool->pending, 1);
+                    w->failed = 1;
+                    continue;
+                }
+                atomic_fetch_add(&pool->queued, 1);
+                dw_wake(pool, 0);
+            }
+        }
+    }
+    close(fd);
+}
+
+static void *dw_worker(void *arg) {
+    dw_worker_t *w = arg;
+    dw_pool_t *pool = w->pool;
+    for (;;) {
+        dw_task_t task;
+        int found = dw_pop(&w->queue, &task, 0);
+        for (int i = 1; !found && i < pool->workerCount; i++) {
+            found = dw_pop(&pool->workers[(w->id + i) % pool->workerCount].queue, &task, 1);
+        }
+        if (!found) {
+            if (dw_idle(pool)) {
+                return NULL;
+            }
+            continue; // Someone queued a directory, we may or may not be the one who gets it
+        }
+        atomic_fetch_sub(&pool->queued, 1);
+        dw_read_dir(w, &task);
+        free(task.path);
+        if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+            dw_wake(pool, 1); // That was the last one, everyone parked can go
+        }
+    }
+}
+
+static int dw_thread_count(void) {
+    const char *env = getenv("MYSH_GLOB_THREADS");
+    long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) {
+        n = 1;
+    }
+    return n > DIRWALK_MAX_THREADS ? DIRWALK_MAX_THREADS : n;
+}
+
+/* Walk everything under root (a path ending in /, or "" for the current directory), it is read but not kept itself
+* MYSH_GLOB_THREADS sets how many threads read directories, the default is one per CPU
+* Returns 0 for success, 1 if we ran out of memory (result is then empty)
+*/
+int dirwalk(const char *root, dirwalk_filter_t filter, const void *ctx, dirwalk_result_t *result) {
+    dw_pool_t pool;
+    pool.workerCount = dw_thread_count();
+    pool.filter = filter;
+    pool.ctx = ctx;
+    atomic_init(&pool.pending, 1);
+    atomic_init(&pool.queued, 1);
+    atomic_init(&pool.sleeping, 0);
+    pool.workers = calloc(pool.workerCount, sizeof(dw_worker_t));
+    result->paths = NULL;
+    result->count = 0;
+    result->chunks = NULL;
+    if (pool.workers == NULL) {
+        return 1;
+    }
+    pthread_mutex_init(&pool.idleLock, NULL);
+    pthread_cond_init(&pool.wake, NULL);
+
+    int failed = 0, started = 0;
+    pthread_t threads[DIRWALK_MAX_THREADS];
+    for (int i = 0; i < pool.workerCount; i++) {
+        dw_worker_t *w = &pool.workers[i];
+        w->pool = &pool;
+        w->id = i;
+        pthread_mutex_init(&w->queue.lock, NULL);
+        w->buf = malloc(DIRWALK_BUFSIZE);
+        if (w->buf == NULL) {
+            failed = 1;
+        }
+    }
+    dw_task_t first;
+    first.len = strlen(root);
+    first.path = strdup(root);
+    if (first.path == NULL || failed || dw_push(&pool.workers[0].queue, first) != 0) {
+        free(first.path);
+        failed = 1;
+    } else {
+        // We are worker 0 ourselves, the others get threads
+        for (int i = 1; i < pool.workerCount; i++) {
+            if (pthread_create(&threads[i], NULL, dw_worker, &pool.workers[i]) != 0) {
+                break; // Fewer threads just means the ones we have do more of the stealing
+            }
+            started = i;
+        }
+        dw_worker(&pool.workers[0]);
+        for (int i = 1; i <= started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    // Gather every thread's paths and chunks into the result
+    size_t total = 0;
+    for (int i = 0; i < pool.workerCount; i++) {
+        total += pool.workers[i].count;
+        failed |= pool.workers[i].failed;
+    }
+    result->paths = failed ? NULL : malloc((total + 1) * sizeof(char *));
+    for (int i = 0; i < pool.workerCount; i++) {
+        dw_worker_t *w = &pool.workers[i];
+        if (result->paths != NULL) {
+            memcpy(result->paths + result->count, w->paths, w->count * sizeof(char *));
+            result->count += w->count;
+        }
+        while (w->chunks != NULL) {
+            dirwalk_chunk_t *next = w->chunks->next;
+            w->chunks->next = result->chunks;
+            result->chunks = w->chunks;
+            w->chunks = next;
+        }
+        free(w->paths);
+        free(w->buf);
+        free(w->queue.tasks);
+        pthread_mutex_destroy(&w->queue.lock);
+    }
+    free(pool.workers);
+    pthread_mutex_destroy(&pool.idleLock);
+    pthread_cond_destroy(&pool.wake);
+    if (result->paths == NULL) {
+        dirwalk_free(result);
+        return 1;
+    }
+    return 0;
+}
+
+void dirwalk_free(dirwalk_result_t *result) {
+    while (result->chunks != NULL) {
+        dirwalk_chunk_t *next = result->chunks->next;
+        free(result->chunks);
+        result->chunks = next;
+    }
+    free(result->paths);
+    result->paths = NULL;
+    result->count = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef DIRWALK_H
+#define DIRWALK_H
+
+#include <stddef.h>
+
+/*
+ * Walks a whole directory tree with a pool of threads, for ** in wildcards
+ * Every thread has its own queue of directories to read and takes work from the others when it runs dry,
+ * and sleeps on a condition variable when there is nothing to take until a directory is queued or the walk is over,
+ * directories are read with getdents64 into a big buffer and d_type tells files from directories, so there is no stat
+ * Directories starting with . are not walked into and symlinks are not followed, like ** does in bash
+ * filter is called for every entry (from any of the threads, so it can not change anything) and returns
+ * DIRWALK_SKIP, DIRWALK_KEEP to keep the path or DIRWALK_KEEP_SLASH to keep it with a / after it
+ * The paths come back in no particular order, sorting is up to the caller
+ */
+
+enum { DIRWALK_SKIP, DIRWALK_KEEP, DIRWALK_KEEP_SLASH };
+
+typedef int (*dirwalk_filter_t)(const void *ctx, const char *name, int isDir);
+
+typedef struct dirwalk_chunk dirwalk_chunk_t;
+
+typedef struct {
+    char **paths;
+    size_t count;
+    dirwalk_chunk_t *chunks;    // Where the path strings live
+} dirwalk_result_t;
+
+int dirwalk(const char *root, dirwalk_filter_t filter, const void *ctx, dirwalk_result_t *result);
+void dirwalk_free(dirwalk_result_t *result);
+
+#endif
@@ -0,0 +1,418 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include "jobs.h"
+
+#define JOBS_EVENTS 16
+
+typedef struct {
+    int id;
+    pid_t pgid;
+    int stageCount;
+    int running;            // Stages not reaped yet
+    int stopped;            // Suspended with ^Z, until fg wakes it up again
+    int lastStatus;         // Wait status of the last stage, the exit status of the job
+    pid_t *pids;            // -1 once reaped (or if the stage never started)
+    int *pidfds;            // -1 if there is no pidfd, the stage is polled with waitpid then
+    char *text;             // The line, for jobs and the Done message
+} job_t;
+
+static job_t **jobTable = NULL;    // Slot id - 1, NULL when free
+static int jobSlots = 0;
+static int epollFd = -1;
+static int runningStages = 0;      // Stages not reaped yet, over all jobs
+static int polledStages = 0;       // Running stages without a pidfd
+static int notifyJobs = 0;         // Interactive, say when jobs start and finish
+static int haveTerminal = 0;
+
+void jobs_init(int notify, int ownTerminal) {
+    notifyJobs = notify;
+    haveTerminal = ownTerminal;
+}
+
+// Give the terminal to pgid (or back to us with our own group), only if the shell had it to begin with
+// SIGTTOU is blocked around it since taking the terminal back from the background would stop us otherwise
+void jobs_terminal(pid_t pgid) {
+    if (!haveTerminal) {
+        return;
+    }
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &block, &old);
+    tcsetpgrp(STDIN_FILENO, pgid);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+// The line as it ran, stages joined with | (wildcards are already expanded by now)
+static char *jobs_text(command_t *cmd) {
+    size_t len = 1;
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next) {
+        for (int i = 0; stage->args->data[i] != NULL; i++) {
+            len += strlen(stage->args->data[i]) + 1;
+        }
+        len += (stage->inputFile ? strlen(stage->inputFile) + 3 : 0) + (stage->outputFile ? strlen(stage->outputFile) + 3 : 0) + 2;
+        len += (stage->hereDelim ? strlen(stage->hereDelim) + 3 : (stage->hereData ? 4 : 0));
+    }
+    char *text = malloc(len);
+    if (text == NULL) {
+        return NULL;
+    }
+    char *p = text;
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next) {
+        for (int i = 0; stage->args->data[i] != NULL; i++) {
+            p += sprintf(p, "%s%s", i ? " " : "", stage->args->data[i]);
+        }
+        if (stage->inputFile) {
+            p += sprintf(p, " < %s", stage->inputFile);
+        } else if (stage->hereDelim) {
+            p += sprintf(p, " <<%s", stage->hereDelim);
+        } else if (stage->hereData) {
+            p += sprintf(p, " <<<");
+        }
+        if (stage->outputFile) {
+            p += sprintf(p, " > %s", stage->outputFile);
+        }
+        if (stage->next) {
+            p += sprintf(p, " | ");
+        }
+    }
+    *p = '\0';
+    return text;
+}
+
+static job_t *jobs_find(int id) {
+    if (id == 0) {
+        // The most recent one, like %+ in bash
+        for (int i = jobSlots - 1; i >= 0; i--) {
+            if (jobTable[i] != NULL) {
+                return jobTable[i];
+            }
+        }
+        return NULL;
+    }
+    return (id > 0 && id <= jobSlots) ? jobTable[id - 1] : NULL;
+}
+
+static void jobs_remove(job_t *job) {
+    for (int i = 0; i < job->stageCount; i++) {
+        if (job->pidfds[i] >= 0) {
+            close(job->pidfds[i]); // Closing the only fd of it takes it out of the epoll set too
+        }
+    }
+    jobTable[job->id - 1] = NULL;
+    free(job->text);
+    free(job);
+}
+
+static void jobs_reaped(job_t *job, int stage, int status) {
+    if (job->pidfds[stage] >= 0) {
+        close(job->pidfds[stage]);
+        job->pidfds[stage] = -1;
+    } else {
+        polledStages--;
+    }
+    job->pids[stage] = -1;
+    job->running--;
+    runningStages--;
+    if (stage == job->stageCount - 1) {
+        job->lastStatus = status;
+    }
+}
+
+// Exit status of a finished job the way prevExitStatus counts it
+static int jobs_status(job_t *job) {
+    return WIFEXITED(job->lastStatus) ? WEXITSTATUS(job->lastStatus) : 1;
+}
+
+// The table entry for jobs_add and jobs_suspend, NULL if there is no memory for it
+static job_t *jobs_new(command_t *cmd, pid_t pgid, const pid_t *pids, int stageCount) {
+    int slot = 0;
+    while (slot < jobSlots && jobTable[slot] != NULL) {
+        slot++;
+    }
+    if (slot == jobSlots) {
+        int newSlots = jobSlots ? jobSlots * 2 : 8;
+        job_t **grown = realloc(jobTable, newSlots * sizeof(job_t *));
+        if (grown == NULL) {
+            perror("realloc failed in jobs_add");
+            return NULL;
+        }
+        memset(grown + jobSlots, 0, (newSlots - jobSlots) * sizeof(job_t *));
+        jobTable = grown;
+        jobSlots = newSlots;
+    }
+    if (epollFd < 0) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    // One block for the job and both of its arrays
+    job_t *job = malloc(sizeof(job_t) + stageCount * (sizeof(pid_t) + sizeof(int)));
+    if (job == NULL) {
+        perror("malloc failed in jobs_add");
+        return NULL;
+    }
+    job->id = slot + 1;
+    job->pgid = pgid;
+    job->stageCount = stageCount;
+    job->running = 0;
+    job->stopped = 0;
+    job->lastStatus = 1 << 8; // Reads as exit status 1 if the last stage never started
+    job->pids = (pid_t *)(job + 1);
+    job->pidfds = (int *)(job->pids + stageCount);
+    job->text = jobs_text(cmd);
+    for (int i = 0; i < stageCount; i++) {
+        job->pids[i] = pids[i];
+        job->pidfds[i] = -1;
+        if (pids[i] <= 0) {
+            continue;
+        }
+        job->running++;
+        runningStages++;
+        // A child that already exited is a zombie until we reap it, so pidfd_open still finds it
+        int fd = (epollFd >= 0) ? syscall(SYS_pidfd_open, pids[i], 0) : -1;
+        if (fd >= 0) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u64 = (uint64_t)job->id << 32 | (uint32_t)i;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        job->pidfds[i] = fd;
+        if (fd < 0) {
+            polledStages++;
+        }
+    }
+    jobTable[slot] = job;
+    return job;
+}
+
+/* Put a line that was just started in the background into the table, pids[i] is -1 for stages that did not start
+* Returns the job number, or -1 if it could not be added (the stages keep running, they are just not tracked)
+*/
+int jobs_add(command_t *cmd, pid_t pgid, const pid_t *pids, int stageCount) {
+    job_t *job = jobs_new(cmd, pgid, pids, stageCount);
+    if (job == NULL) {
+        return -1;
+    }
+    if (notifyJobs) {
+        fprintf(stderr, "[%d] %d\n", job->id, (int)pgid);
+    }
+    return job->id;
+}
+
+// Take the terminal back from a job that just got stopped and say so, like bash does at the prompt
+static void jobs_stopped(job_t *job) {
+    job->stopped = 1;
+    jobs_terminal(getpgrp());
+    printf("\n[%d] Stopped\t%s\n", job->id, job->text ? job->text : "");
+    fflush(stdout);
+}
+
+// 1 at the prompt with the terminal, a line in the foreground that gets stopped is put in the table then
+int jobs_control(void) {
+    return notifyJobs && haveTerminal;
+}
+
+/* A line running in the foreground got stopped (^Z), pids[i] is -1 for the stages that are already gone and
+* lastStatus is the wait status of the last stage if it is one of them
+* At the prompt it goes into the table as a stopped job that fg wakes up again, and the shell gets the terminal back
+* A script has no prompt to go back to, so the shell stops itself too, like sh without job control, and once whoever
+* started it wakes it up again the line gets the terminal back and is woken up too
+* Returns the job number, 0 if the shell was stopped with it, or -1 if the shell has no terminal to do either with
+* (or no memory), the caller keeps the line going then
+*/
+int jobs_suspend(command_t *cmd, pid_t pgid, const pid_t *pids, int stageCount, int lastStatus) {
+    if (!haveTerminal) {
+        return -1;
+    }
+    if (!notifyJobs) {
+        jobs_terminal(getpgrp());
+        kill(getpid(), SIGTSTP);
+        jobs_terminal(pgid);
+        kill(-pgid, SIGCONT);
+        return 0;
+    }
+    job_t *job = jobs_new(cmd, pgid, pids, stageCount);
+    if (job == NULL) {
+        return -1;
+    }
+    job->lastStatus = lastStatus;
+    jobs_stopped(job);
+    return job->id;
+}
+
+/* Reap every stage that has finished, waiting up to timeout ms (-1 forever) for the first one
+* Only pidfds that epoll says are readable get a waitpid, plus the stages that have no pidfd
+*/
+void jobs_collect(int timeout) {
+    if (runningStages == 0) {
+        return;
+    }
+    if (polledStages > 0 && (timeout < 0 || timeout > 10)) {
+        timeout = 10; // Those stages can not wake us up, look at them again every now and then
+    }
+    struct epoll_event events[JOBS_EVENTS];
+    int n = 0;
+    if (epollFd >= 0) {
+        n = epoll_wait(epollFd, events, JOBS_EVENTS, timeout);
+        if (n < 0) {
+            n = 0; // EINTR, the caller loops
+        }
+    } else if (timeout != 0) {
+        usleep(timeout * 1000);
+    }
+    for (int i = 0; i < n; i++) {
+        job_t *job = jobs_find((int)(events[i].data.u64 >> 32));
+        int stage = (int)(uint32_t)events[i].data.u64;
+        int status;
+        if (job != NULL && stage < job->stageCount && job->pids[stage] > 0 &&
+            waitpid(job->pids[stage], &status, WNOHANG) == job->pids[stage]) {
+            jobs_reaped(job, stage, status);
+        }
+    }
+    if (polledStages == 0) {
+        return;
+    }
+    for (int i = 0; i < jobSlots; i++) {
+        job_t *job = jobTable[i];
+        for (int s = 0; job != NULL && s < job->stageCount; s++) {
+            int status;
+            if (job->pids[s] > 0 && job->pidfds[s] < 0 && waitpid(job->pids[s], &status, WNOHANG) == job->pids[s]) {
+                jobs_reaped(job, s, status);
+            }
+        }
+    }
+}
+
+// Before a prompt: reap what finished and say so, the way bash prints Done before the next prompt
+void jobs_notify(void) {
+    if (jobSlots == 0) {
+        return;
+    }
+    jobs_collect(0);
+    for (int i = 0; i < jobSlots; i++) {
+        job_t *job = jobTable[i];
+        if (job == NULL || job->running > 0) {
+            continue;
+        }
+        if (notifyJobs) {
+            int status = jobs_status(job);
+            if (status == 0) {
+                printf("[%d] Done\t%s\n", job->id, job->text ? job->text : "");
+            } else {
+                printf("[%d] Exit %d\t%s\n", job->id, status, job->text ? job->text : "");
+            }
+        }
+        jobs_remove(job);
+    }
+    fflush(stdout);
+}
+
+// The jobs builtin, at the prompt finished jobs are shown once and then dropped, a script keeps them for wait
+void jobs_list(void) {
+    jobs_collect(0);
+    for (int i = 0; i < jobSlots; i++) {
+        job_t *job = jobTable[i];
+        if (job == NULL) {
+            continue;
+        }
+        if (job->running > 0) {
+            printf("[%d] %s\t%s\n", job->id, job->stopped ? "Stopped" : "Running", job->text ? job->text : "");
+        } else {
+            int status = jobs_status(job);
+            if (status == 0) {
+                printf("[%d] Done\t%s\n", job->id, job->text ? job->text : "");
+            } else {
+                printf("[%d] Exit %d\t%s\n", job->id, status, job->text ? job->text : "");
+            }
+            if (notifyJobs) {
+                jobs_remove(job);
+            }
+        }
+    }
+    fflush(stdout);
+}
+
+/* Block until job id is done (0 waits for all of them) and drop it from the table
+* Returns its exit status (0 when waiting for all), or 127 if there is no such job like bash
+*/
+int jobs_wait(int id) {
+    if (id == 0) {
+        for (int i = 0; i < jobSlots; i++) {
+            if (jobTable[i] != NULL) {
+                jobs_wait(i + 1);
+            }
+        }
+        return 0;
+    }
+    job_t *job = jobs_find(id);
+    if (job == NULL) {
+        fprintf(stderr, "wait: no such job %d\n", id);
+        return 127;
+    }
+    while (job->running > 0) {
+        jobs_collect(-1);
+    }
+    int status = jobs_status(job);
+    jobs_remove(job);
+    return status;
+}
+
+/* Bring job id (0 for the most recent one) to the foreground: give it the terminal, wake it up if it stopped
+* and wait for it like any line run in the foreground
+* Returns its exit status, 128 + SIGTSTP if it was stopped again (it stays in the table), or 1 if there is no such job
+*/
+int jobs_fg(int id) {
+    job_t *job = jobs_find(id);
+    if (job == NULL) {
+        fprintf(stderr, "fg: no such job\n");
+        return 1;
+    }
+    printf("%s\n", job->text ? job->text : "");
+    fflush(stdout);
+    if (job->running > 0) {
+        jobs_terminal(job->pgid);
+        kill(-job->pgid, SIGCONT);
+        job->stopped = 0;
+    }
+    while (job->running > 0) {
+        int status;
+        pid_t pid = waitpid(-job->pgid, &status, WUNTRACED);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("waitpid");
+            break;
+        }
+        if (WIFSTOPPED(status)) {
+            if (haveTerminal && (WSTOPSIG(status) == SIGTSTP || WSTOPSIG(status) == SIGSTOP)) {
+                jobs_stopped(job); // Stays in the table for the next fg
+                return 128 + SIGTSTP;
+            }
+            kill(pid, SIGCONT); // Touched the terminal before it was handed over
+            continue;
+        }
+        for (int i = 0; i < job->stageCount; i++) {
+            if (job->pids[i] == pid) {
+                jobs_reaped(job, i, status);
+            }
+        }
+    }
+    jobs_terminal(getpgrp());
+    int status = jobs_status(job);
+    jobs_remove(job);
+    return status;
+}
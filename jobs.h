@@ -0,0 +1,27 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <sys/types.h>
+#include "command.h"
+
+/*
+ * Background jobs, a line ending in & is started and added here instead of being waited for
+ * Every stage gets a pidfd that sits in one epoll set, so finished jobs are reaped by looking at the set
+ * (jobs_collect with a 0 timeout before every prompt) and the shell never blocks on a job unless wait or fg asks it to
+ * Kernels without pidfd_open still work, those stages are checked with waitpid(WNOHANG) instead
+ * A line in the foreground that gets a ^Z at the prompt goes in here too, as a stopped job until fg wakes it up
+ * A finished job stays in the table with its status until it is waited for, or until the prompt (or jobs) reported it
+ */
+
+void jobs_init(int notify, int ownTerminal);
+int jobs_add(command_t *cmd, pid_t pgid, const pid_t *pids, int stageCount);
+int jobs_suspend(command_t *cmd, pid_t pgid, const pid_t *pids, int stageCount, int lastStatus);
+int jobs_control(void);
+void jobs_collect(int timeout);
+void jobs_notify(void);
+void jobs_list(void);
+int jobs_wait(int id);
+int jobs_fg(int id);
+void jobs_terminal(pid_t pgid);
+
+#endif
@@ -0,0 +1,219 @@
+#define _GNU_SOURCE // For pipe2
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include "launcher.h"
+
+extern char **environ;
+
+// glibc mallocs for every file action we add, but redirections and pipes keep landing on the same fd numbers
+// line after line, so the actions for the last few in/out pairs are kept and reused (per thread, nothing is shared)
+// A pipeline needs one pair per stage, so there are enough slots for the usual lengths before one gets recycled
+// Builtin pipeline stages spawn from threads that do not live long, their slots go away with them (actionSlotsKey)
+#define ACTION_SLOTS 8
+
+typedef struct {
+    posix_spawn_file_actions_t actions;
+    int inFd;   // -2 means the slot is empty
+    int outFd;
+    int errFd;
+} action_slot_t;
+
+static __thread action_slot_t actionSlots[ACTION_SLOTS];
+static __thread int actionSlotsReady = 0;
+static __thread int nextVictim = 0;   // Slots are recycled round robin
+static pthread_key_t actionSlotsKey;  // Only there for its destructor
+static pthread_once_t actionSlotsOnce = PTHREAD_ONCE_INIT;
+
+// Runs when a thread that spawned something exits, slots points at that thread's actionSlots
+static void dropActionSlots(void *slots) {
+    action_slot_t *slot = slots;
+    for (int i = 0; i < ACTION_SLOTS; i++) {
+        if (slot[i].inFd != -2) {
+            posix_spawn_file_actions_destroy(&slot[i].actions);
+            slot[i].inFd = slot[i].outFd = -2;
+        }
+    }
+}
+
+static void makeActionSlotsKey(void) {
+    pthread_key_create(&actionSlotsKey, dropActionSlots);
+}
+
+// File actions that dup2 inFd, outFd and errFd onto stdin, stdout and stderr (skipping the -1's), NULL if they could not be built
+static posix_spawn_file_actions_t *cachedFileActions(int inFd, int outFd, int errFd) {
+    if (!actionSlotsReady) {
+        for (int i = 0; i < ACTION_SLOTS; i++) {
+            actionSlots[i].inFd = actionSlots[i].outFd = -2;
+        }
+        actionSlotsReady = 1;
+        pthread_once(&actionSlotsOnce, makeActionSlotsKey);
+        pthread_setspecific(actionSlotsKey, actionSlots);
+
+    }
+    for (int i = 0; i < ACTION_SLOTS; i++) {
+        if (actionSlots[i].inFd == inFd && actionSlots[i].outFd == outFd && actionSlots[i].errFd == errFd) {
+            return &actionSlots[i].actions;
+        }
+    }
+
+    action_slot_t *slot = &actionSlots[nextVictim];
+    nextVictim = (nextVictim + 1) % ACTION_SLOTS;
+    if (slot->inFd != -2) {
+        posix_spawn_file_actions_destroy(&slot->actions);
+        slot->inFd = slot->outFd = -2;
+    }
+    if (posix_spawn_file_actions_init(&slot->actions) != 0) {
+        return NULL;
+    }
+    int err = 0;
+    if (inFd >= 0) {
+        err = posix_spawn_file_actions_adddup2(&slot->actions, inFd, STDIN_FILENO);
+    }
+    if (err == 0 && outFd >= 0) {
+        err = posix_spawn_file_actions_adddup2(&slot->actions, outFd, STDOUT_FILENO);
+    }
+    if (err == 0 && errFd >= 0) {
+        err = posix_spawn_file_actions_adddup2(&slot->actions, errFd, STDERR_FILENO);
+    }
+    if (err != 0) {
+        posix_spawn_file_actions_destroy(&slot->actions);
+        return NULL;
+    }
+    slot->inFd = inFd;
+    slot->outFd = outFd;
+    slot->errFd = errFd;
+    return &slot->actions;
+}
+
+/* Spawn path with argv, the redirections and pipe ends are handed over as dup2 file actions
+* The fds the caller passes in should be O_CLOEXEC so the child only keeps the dup'd copies
+*/
+int launch_spawn(const char *path, char **argv, int inFd, int outFd, pid_t pgroup, pid_t *pid) {
+    return launch_spawn_err(path, argv, inFd, outFd, -1, pgroup, pid);
+}
+
+int launch_spawn_err(const char *path, char **argv, int inFd, int outFd, int errFd, pid_t pgroup, pid_t *pid) {
+    posix_spawn_file_actions_t *actionsPtr = NULL;
+    posix_spawnattr_t attr;
+    int err = 0;
+
+    // The shell ignores SIGPIPE (builtin stages on threads get EPIPE instead), the program gets the default back
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    err = posix_spawnattr_init(&attr);
+    if (err != 0) {
+        return err;
+    }
+    short flags = POSIX_SPAWN_SETSIGDEF;
+    err = posix_spawnattr_setsigdefault(&attr, &pipeSignal);
+    if (err == 0 && pgroup >= 0) {
+        err = posix_spawnattr_setpgroup(&attr, pgroup);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    if (err == 0) {
+        err = posix_spawnattr_setflags(&attr, flags);
+    }
+    if (err != 0) {
+        posix_spawnattr_destroy(&attr);
+        return err;
+    }
+
+    if (inFd >= 0 || outFd >= 0 || errFd >= 0) {
+        actionsPtr = cachedFileActions(inFd, outFd, errFd);
+        if (actionsPtr == NULL) {
+            posix_spawnattr_destroy(&attr);
+            return ENOMEM;
+        }
+    }
+
+    // posix_spawn only comes back once the exec worked or failed, so err also covers a failed exec
+    err = posix_spawn(pid, path, actionsPtr, &attr, argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    return err;
+}
+
+/* Same contract as launch_spawn but with a full fork, a failed exec shows up as exit status 1 instead
+*/
+int launch_fork(const char *path, char **argv, int inFd, int outFd, pid_t pgroup, pid_t *pid) {
+    pid_t child = fork();
+    if (child < 0) {
+        return errno;
+    }
+    if (child == 0) {
+        signal(SIGPIPE, SIG_DFL);
+        if (pgroup >= 0) {
+            setpgid(0, pgroup);
+        }
+        if (inFd >= 0 && dup2(inFd, STDIN_FILENO) < 0) {
+            perror("dup2 input");
+            _exit(1);
+        }
+        if (outFd >= 0 && dup2(outFd, STDOUT_FILENO) < 0) {
+            perror("dup2 output");
+            _exit(1);
+        }
+        execv(path, argv);
+        perror("execv");
+        _exit(1);
+    }
+    if (pgroup >= 0) {
+        setpgid(child, pgroup ? pgroup : child); // Both sides do it so nobody races the child
+    }
+    *pid = child;
+    return 0;
+}
+
+/* launch_fork, but the child waits for the end of a pipe to close right before execv, which we do once attach is done
+* A failed exec shows up as exit status 1 here too
+*/
+int launch_fork_attach(const char *path, char **argv, int inFd, int outFd, pid_t pgroup,
+                       void (*attach)(pid_t pid, void *ctx), void *ctx, pid_t *pid) {
+    int sync[2];
+    if (pipe2(sync, O_CLOEXEC) < 0) {
+        return errno;
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        int err = errno;
+        close(sync[0]);
+        close(sync[1]);
+        return err;
+    }
+    if (child == 0) {
+        signal(SIGPIPE, SIG_DFL);
+        if (pgroup >= 0) {
+            setpgid(0, pgroup);
+        }
+        if (inFd >= 0 && dup2(inFd, STDIN_FILENO) < 0) {
+            perror("dup2 input");
+            _exit(1);
+        }
+        if (outFd >= 0 && dup2(outFd, STDOUT_FILENO) < 0) {
+            perror("dup2 output");
+            _exit(1);
+        }
+        close(sync[1]);
+        char c;
+        while (read(sync[0], &c, 1) < 0 && errno == EINTR) {
+        }
+        execv(path, argv);
+        perror("execv");
+        _exit(1);
+    }
+    if (pgroup >= 0) {
+        setpgid(child, pgroup ? pgroup : child);
+    }
+    close(sync[0]);
+    attach(child, ctx);
+    close(sync[1]); // Off it goes
+    *pid = child;
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <sys/types.h>
+
+/*
+ * Starting external programs
+ * inFd/outFd become the child's stdin/stdout, pass -1 to leave the shell's own fd in place
+ * pgroup is the process group to put the child in, 0 makes it the leader of a new one, -1 leaves it in ours
+ * Both return 0 and fill in pid on success, or an errno value if the program could not be started
+ */
+
+// posix_spawn (glibc does clone(CLONE_VM|CLONE_VFORK)), so no page tables get copied however big the shell gets
+int launch_spawn(const char *path, char **argv, int inFd, int outFd, pid_t pgroup, pid_t *pid);
+// The same with errFd as the child's stderr (-1 keeps ours)
+int launch_spawn_err(const char *path, char **argv, int inFd, int outFd, int errFd, pid_t pgroup, pid_t *pid);
+
+// The old fork + dup2 + execv path, kept for the benchmark and for anything that has to run code in the child
+int launch_fork(const char *path, char **argv, int inFd, int outFd, pid_t pgroup, pid_t *pid);
+// launch_fork with the child held right before execv until attach(pid, ctx) ran in the shell, for what has to be set up
+// on the child before its program starts (perf counters that are enabled on exec)
+int launch_fork_attach(const char *path, char **argv, int inFd, int outFd, pid_t pgroup,
+                       void (*attach)(pid_t pid, void *ctx), void *ctx, pid_t *pid);
+
+#endif
@@ -1,326 +1,553 @@
+#define _GNU_SOURCE // For pipe2
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h> 
 #include <fcntl.h>    
 #include <string.h>
-#include <ctype.h>
 #include <sys/wait.h> 
-#include <dirent.h> 
-#include "arraylist.h"
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "arena.h"
 #include "builtInCommands.h" 
+#include "pathcache.h"
+#include "launcher.h"
+#include "tokenizer.h"
+#include "command.h"
+#include "myshc.h"
+#include "reader.h"
+#include "wildcard.h"
+#include "jobs.h"
+#include "timing.h"
+#include "perf.h"
+#include "trace.h"
+#include "serve.h"
+#include "sched.h"
+#include "cache.h"
+#include "zerocopy.h"
 
-#define BUFLEN 1024 // Standard buffer length we can make this bigger
-#define wordArraySize 500 // The word array size for the tokenizer command
 int prevExitStatus = 0;  // Assume success is 0 by default
 int firstTimeRunning = 0; 
+arena_t lineArena;  // Everything parsed out of the current line lives here, reset once the line is done
+timing_t *lineTiming = NULL;  // Set while a line with the time prefix runs, the stages are measured into it
+perf_line_t *linePerf = NULL;  // Set while a line is counted (perfstat or MYSH_PERF), its programs get perf counters
 
-/*
- * The struct command where it will hold all the needed data when we process this within the function processCommand
- */
+// Every built in command and the function that runs it, "[" is test with a closing ]
+// ownProcess: in a pipeline it needs a forked child instead of a thread, it works on the job table, the terminal or process groups
+// readsStdin: it can read its stdin, which is the terminal when it is the first stage of a line (see runPipeline)
+typedef struct {
+    const char *name;
+    int (*run)(strvec_t *list);
+    int ownProcess;
+    int readsStdin;
+} builtin_entry_t;
 
-typedef struct command {
-    char *program;          // The name of the program, which is really the executable
-    arraylist_t *args;      // Arraylist of argument strings, for execv use args->data as it holds the string names
-    char *inputFile;        // Input redirection filename 
-    char *outputFile;       // Output redirection filename 
-    int pipePresent;        // Flag that shows if a pipe exists
-    struct command *next;   // When pipelines exist we need to seperate commands so we will use a linked list of commands
-    enum { NONE, AND, OR } condition;  // Conditional operator relative to previous command
-}command_t;
+static const builtin_entry_t builtinTable[] = {
+    {"cd", builtin_cd, 0, 0}, {"pwd", builtin_pwd, 0, 0}, {"exit", builtin_exit, 0, 0}, {"die", builtin_die, 0, 0},
+    {"which", builtin_which, 0, 0}, {"hash", builtin_hash, 0, 0}, {"rehash", builtin_rehash, 0, 0},
+    {"cat", builtin_cat, 0, 1}, {"tee", builtin_tee, 0, 1}, {"cp", builtin_cp, 0, 0}, {"jobs", builtin_jobs, 1, 0},
+    {"wait", builtin_wait, 1, 0}, {"fg", builtin_fg, 1, 0}, {"parallel", builtin_parallel, 1, 0},
+    {"echo", builtin_echo, 0, 0}, {"true", builtin_true, 0, 0}, {"false", builtin_false, 0, 0},
+    {"test", builtin_test, 0, 0}, {"[", builtin_test, 0, 0}, {"printf", builtin_printf, 0, 0}, {NULL, NULL, 0, 0}
+};
 
-/*
- * This function creates a new commandStructure
- * Allocates a new arraylist for arguments as well
- */
-command_t *createCommandStruct() {
-    command_t *cmd = malloc(sizeof(command_t));
-    if (cmd == NULL) {
-        perror("malloc failed in createCommandStruct");
-        return NULL;
-    }
-    cmd->program = NULL; 
-    // Allocate and initialize the arraylist to store argument tokens
-
-    cmd->args = malloc(sizeof(arraylist_t));
-    if (cmd->args == NULL) {
-        perror("malloc failed for args arraylist");
-        free(cmd);
-        return NULL;
-    }
-    if (al_init(cmd->args, 10) != 0) { 
-        fprintf(stderr, "Error initializing args arraylist\n");
-        free(cmd->args);
-        free(cmd);
-        return NULL;
-    }
-
-    cmd->inputFile = NULL;
-    cmd->outputFile = NULL;
-    cmd->pipePresent = 0;
-    cmd->next = NULL;
-    cmd->condition = NONE;
-    return cmd;
+static const builtin_entry_t *findBuiltIn(const char *cmd) {
+    for (const builtin_entry_t *b = builtinTable; b->name != NULL; b++) {
+        if (strcmp(cmd, b->name) == 0) {
+            return b;
+        }
+    }
+    return NULL;
 }
 
-/*
- * Free a command structure
- * Frees all allocated strings stored in the args arraylist with the destroy function, as well as any redirection strings and any piped commands
- */
+// Helper function to know if its built in or not
+int isBuiltInCommand(const char *cmd) {
+    return findBuiltIn(cmd) != NULL;
+}
 
-void freeCommandStruct(command_t *cmd) {
-    if (cmd == NULL){
-        return;
+// This will handle our built in commands, it will send to the built-in function we made
+// It uses cmd->program if it is set, otherwise it takes the first token in cmd->args->data.
+// Returns the exit status of the builtin
+int handleBuiltInCommands(command_t *cmd) {
+    const char *cmdName;
+
+    if (cmd->program != NULL) {
+        cmdName = cmd->program;
+    } else {
+        cmdName = cmd->args->data[0];
     }
-    if (cmd->program != NULL){
-        free(cmd->program);
+
+    const builtin_entry_t *builtin = findBuiltIn(cmdName);
+    if (builtin != NULL) {
+        return builtin->run(cmd->args);
     }
-    if (cmd->args != NULL){
-        al_destroy(cmd->args);  
-        free(cmd->args);
+    fprintf(stderr, "Unknown built-in command: %s\n", cmdName);
+    return 1;
+}
+
+// Find the executable for cmdName through the path cache, prints the error if it does not exist
+// Returns 1 if found and path is filled in, 0 otherwise
+int resolveExecutable(const char *cmdName, char *path, size_t pathlen) {
+    long long traceStart = trace_begin();
+    int found = pc_lookup(cmdName, path, pathlen);
+    trace_end("resolve", traceStart, cmdName);
+    if (found != 0) {
+        fprintf(stderr, "%s: command not found\n", cmdName);
+        return 0;
     }
-    if (cmd->inputFile != NULL){
-        free(cmd->inputFile);
+    return 1;
+}
+
+#define HERE_PIPE_MAX 4096 // A body this small fits in any pipe, so it can be written before anybody reads it
+
+/*
+ * An fd to read a here-doc or here-string from, O_CLOEXEC, without touching the filesystem
+ * A small body goes into a pipe, a bigger one into a memfd that is sealed once it is written so nobody can change it,
+ * the writes to it stay in memory and it is gone when the last fd is closed
+ * Returns the fd, or -1 with errno set
+ */
+static int openHereData(const char *data, size_t len) {
+    int fds[2];
+    if (len <= HERE_PIPE_MAX) {
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            return -1;
+        }
+        ssize_t n = (len > 0) ? write(fds[1], data, len) : 0;
+        int err = errno;
+        close(fds[1]);
+        if (n != (ssize_t)len) {
+            close(fds[0]);
+            errno = (n < 0) ? err : EIO;
+            return -1;
+        }
+        return fds[0];
     }
-    if (cmd->outputFile != NULL){
-        free(cmd->outputFile);
-    } 
-    if (cmd->next != NULL){
-        freeCommandStruct(cmd->next);
+    int fd = memfd_create("mysh-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return -1;
     }
-    
-    free(cmd);
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, data + done, len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0 || lseek(fd, 0, SEEK_SET) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
 /*
- * This function will add a token to the struct commands arguments arraylist
- * It will duplicate the token and adds it using al_append
+ * Open the < and > files of one command, O_CLOEXEC so only the child they get dup'd into keeps them
+ * A here-doc or here-string is the input instead of a file, see openHereData
+ * fdIn/fdOut are left at -1 when there is no redirection, returns 0 on success, 1 if a file could not be opened
  */
-
-void addTokenToArgs(command_t *cmd, const char *token) {
-    char *dup = strdup(token); //We will use stdup alot it just duplicates the string instead of us using malloc alot
-    if (!dup) {
-        perror("strdup failed in addTokenToArgs");
-        exit(EXIT_FAILURE);
+int openRedirections(command_t *cmd, int *fdIn, int *fdOut) {
+    *fdIn = -1;
+    *fdOut = -1;
+    if (cmd->hereData) {
+        *fdIn = openHereData(cmd->hereData, cmd->hereLen);
+        if (*fdIn < 0) {
+            perror("here-document");
+            return 1;
+        }
+    } else if (cmd->inputFile) {
+        *fdIn = open(cmd->inputFile, O_RDONLY | O_CLOEXEC);
+        if (*fdIn < 0) {
+            perror("open input");
+            return 1;
+        }
     }
-    if (al_append(cmd->args, dup) != 0) {
-        fprintf(stderr, "Failed to add token to args arraylist\n");
-        free(dup);
-        exit(EXIT_FAILURE);
+    if (cmd->outputFile) {
+        *fdOut = open(cmd->outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+        if (*fdOut < 0) {
+            perror("open output");
+            if (*fdIn != -1) {
+                close(*fdIn);
+                *fdIn = -1;
+            }
+            return 1;
+        }
     }
+    return 0;
 }
 
 /*
- * finalizeArgs--> it adds a null pointer to the end of our args arraylist
- * This mkaes sure that cmd->args->data is properly null-terminated so we dont get any errors
+ * Start one stage of a pipeline with inFd/outFd as its stdin/stdout (-1 keeps the shell's) in process group pgid
+ * External programs are spawned, a builtin that gets here (one with a process of its own, or any in a background line)
+ * needs a forked child so it can run our code
+ * pipes holds every pipe fd of the line, a forked child has to close all of them since it never execs
+ * Returns the pid, or -1 if nothing was started (the error is already printed)
  */
+pid_t launchStage(command_t *cmd, int inFd, int outFd, pid_t pgid, int *pipes, int pipeFdCount) {
+    const char *cmdName = (cmd->program != NULL) ? cmd->program : cmd->args->data[0];
 
-void finalizeArgs(command_t *cmd) {
-    if (al_append(cmd->args, NULL) != 0) {
-        fprintf(stderr, "Failed to finalize args arraylist\n");
-        exit(EXIT_FAILURE);
+    if (isBuiltInCommand(cmdName)) {
+        long long traceStart = trace_begin();
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return -1;
+        }
+        if (pid == 0) {
+            signal(SIGPIPE, SIG_DFL); // Dies on a closed pipe like a program would
+            setpgid(0, pgid);
+            if (inFd >= 0 && dup2(inFd, STDIN_FILENO) < 0) {
+                perror("dup2 (builtin stage)");
+                exit(1);
+            }
+            if (outFd >= 0 && dup2(outFd, STDOUT_FILENO) < 0) {
+                perror("dup2 (builtin stage)");
+                exit(1);
+            }
+            for (int i = 0; i < pipeFdCount; i++) {
+                close(pipes[i]);
+            }
+            exit(handleBuiltInCommands(cmd));
+        }
+        setpgid(pid, pgid ? pgid : pid); // Both sides do it so nobody races the child
+        trace_end("fork", traceStart, cmdName);
+        return pid;
     }
-}
 
-// Helper function to know if its built in or not
-int isBuiltInCommand(const char *cmd) {
-    return (strcmp(cmd, "cd") == 0 || strcmp(cmd, "pwd") == 0 ||
-            strcmp(cmd, "exit") == 0 || strcmp(cmd, "die") == 0 ||
-            strcmp(cmd, "which") == 0);
+    char executablePath[4096];
+    if (!resolveExecutable(cmdName, executablePath, sizeof(executablePath))) {
+        return -1;
+    }
+    pid_t pid;
+    long long traceStart = trace_begin();
+    int err;
+    perf_stage_t *counted = linePerf ? perf_stage(linePerf, cmd) : NULL;
+    if (counted != NULL) {
+        // The counters have to be on the child before it execs, so it is forked and waits for them
+        err = launch_fork_attach(executablePath, cmd->args->data, inFd, outFd, pgid, perf_attach, counted, &pid);
+    } else {
+        err = launch_spawn(executablePath, cmd->args->data, inFd, outFd, pgid, &pid); // fork and exec in one, posix_spawn
+    }
+    trace_end("spawn", traceStart, cmdName);
+    if (err != 0) {
+        fprintf(stderr, "execv: %s\n", strerror(err));
+        return -1;
+    }
+    return pid;
 }
 
-// This will handle our built in commands, it will send to the built-in function we made
-// It uses cmd->program if it is set, otherwise it takes the first token in cmd->args->data.
-void handleBuiltInCommands(command_t *cmd) {
-    const char *cmdName;
+/*
+ * A builtin pipeline stage running on a thread of the shell instead of a forked child
+ * It owns inFd and outFd and closes them when it is done, so the next stage sees EOF
+ */
+typedef struct {
+    command_t *cmd;     // NULL if the stage is not one
+    int index;          // Stage number, for time
+    int inFd;
+    int outFd;
+    int started;
+    int status;         // Exit status of the builtin
+    pid_t tid;          // For the trace
+    long long endNs;    // trace_now() when it finished, 0 when tracing is off
+    pthread_t thread;
+} stage_thread_t;
 
-    if (cmd->program != NULL) {
-        cmdName = cmd->program;
+static void *stageThread(void *arg) {
+    stage_thread_t *st = arg;
+    st->tid = gettid();
+    builtinIo.inFd = st->inFd;
+    builtinIo.outFd = st->outFd;
+    builtinIo.onThread = 1;
+    builtinIo.out = NULL; // Made when the builtin first prints
+    st->status = handleBuiltInCommands(st->cmd);
+    if (builtinIo.out != NULL && builtinIo.out != stderr) {
+        fclose(builtinIo.out); // Closes outFd too
     } else {
-        cmdName = cmd->args->data[0];
+        close(st->outFd);
+    }
+    close(st->inFd);
+    if (lineTiming) {
+        struct rusage ru;
+        getrusage(RUSAGE_THREAD, &ru);
+        ru.ru_maxrss = 0; // The shell's, not the stage's
+        timing_ended(lineTiming, st->index, st->status, &ru);
     }
+    st->endNs = trace_begin();
+    return NULL;
+}
 
-    if (strcmp(cmdName, "cd") == 0) {
-        builtin_cd(cmd->args);
-    } else if (strcmp(cmdName, "pwd") == 0) {
-        builtin_pwd(cmd->args);
-    } else if (strcmp(cmdName, "exit") == 0) {
-        builtin_exit(cmd->args);
-    } else if (strcmp(cmdName, "die") == 0) {
-        builtin_die(cmd->args);
-    } else if (strcmp(cmdName, "which") == 0) {
-        builtin_which(cmd->args);
+/*
+ * Start st on its thread with inFd/outFd as its stdin/stdout (-1 for the shell's own)
+ * The thread gets copies of them, the caller still closes what it passed in
+ * Returns 0 on success, 1 if it could not be started (the error is already printed)
+ */
+static int startStageThread(stage_thread_t *st, int inFd, int outFd) {
+    fflush(stdout); // What the shell printed so far comes before anything the stage writes to the same fd
+    st->inFd = fcntl(inFd >= 0 ? inFd : STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+    st->outFd = fcntl(outFd >= 0 ? outFd : STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (st->inFd < 0 || st->outFd < 0) {
+        perror("dup (builtin stage)");
     } else {
-        fprintf(stderr, "Unknown built-in command: %s\n", cmdName);
+        int err = pthread_create(&st->thread, NULL, stageThread, st);
+        if (err == 0) {
+            st->started = 1;
+            return 0;
+        }
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+    }
+    if (st->inFd >= 0) {
+        close(st->inFd);
+    }
+    if (st->outFd >= 0) {
+        close(st->outFd);
     }
+    return 1;
 }
 
-
 /*
-  executeCommand, the main functions, alot of test cases
-  Executes a single command, or a pipeline of two commands
-  - Conditional operators: if the command starts with and or "or" we decide whether to execute it based on firstTimeRunning global
-  -Pipelines: if cmd->pipePresent is set, we assume a two-command pipeline.
-  -Redirection: input and output redirection are done in the child processes 
-  -Built ins can be run with additional args we will handle them directly when no pipeline is involved. If they appear in a pipeline, we will fork them.
+ * Run a whole line of commands chained with next, one stage or many
+ *  - every pipe is made up front, then every stage is started before we wait on any of them
+ *  - the stages share one process group (led by the first one that started), which gets the terminal while it runs
+ *  - stage i reads pipe i-1 and writes pipe i, a < or > on a stage wins over its pipe so < on the first and > on the last work
+ *  - the stages are reaped in whatever order they finish, the exit status of the line is the one of the last stage
+ *  - a line ending in & does not get the terminal and is not waited for, it goes into the job table (jobs.c) instead
+ *  - builtin stages run on threads of the shell, started once every child is so no child inherits the fds they hold,
+ *    and joined after the children are reaped, only the ones that need a process of their own (jobs, fg...) and
+ *    every stage of a background line are forked
+ *  - at the prompt every builtin stage is forked too, a thread can not be stopped by ^Z without stopping the shell.
+ *    A ^Z there turns the line into a stopped job, in a script it stops the shell along with it (jobs_suspend)
+ *  - so is a first stage that would read the terminal, a thread is in the shell's process group and that group does
+ *    not have the terminal while the line runs
  */
-void executeCommand(command_t *cmd) {
-    //Conditional Execution--> can not run when it is the very first command
-    if (cmd->condition != NONE) {
-        //!This is the case where it is the very command
-        if(firstTimeRunning == 0){
-            fprintf(stdout, "Error: 'and' or 'or' command provided when this is the first command run. \n");
-            return;
-        }
-        if (cmd->condition == AND && prevExitStatus != 0) {
-            fprintf(stdout, "Skipping command due to 'and' condition (prevExitStatus = %d).\n", prevExitStatus);
-            return;
-        }
-        if (cmd->condition == OR && prevExitStatus == 0) {
-            fprintf(stdout, "Skipping command due to 'or' condition (prevExitStatus = %d).\n", prevExitStatus);
-            return;
-        }
+void runPipeline(command_t *cmd) {
+    int stageCount = 0;
+    for (command_t *c = cmd; c != NULL; c = c->next) {
+        stageCount++;
     }
-    firstTimeRunning = 1;
+    int pipeFdCount = 2 * (stageCount - 1);
+    int pipes[pipeFdCount > 0 ? pipeFdCount : 1];
+    pid_t pids[stageCount];
+    stage_thread_t threads[stageCount];
 
-    //Pipeline Execution
-    //Logic we need a pipe where one child writes data and the other reads it, use pipe and and dup to change the fd's
-    if (cmd->pipePresent && cmd->next) {
-        int pipefd[2];
-        if (pipe(pipefd) < 0) {
+    for (int i = 0; i < stageCount - 1; i++) {
+        if (pipe2(&pipes[2 * i], O_CLOEXEC) < 0) { // CLOEXEC so spawned children only keep the ends dup'd for them
             perror("pipe");
+            for (int j = 0; j < 2 * i; j++) {
+                close(pipes[j]);
+            }
             prevExitStatus = 1;
             return;
         }
-        
-        // Fork first child for the left command.
-        pid_t pid1 = fork();
-        if (pid1 < 0) { //Check for errors
-            perror("fork");
-            prevExitStatus = 1;
-            return;
+    }
+
+    pid_t pgid = 0;
+    int running = 0;
+    int jobControl = jobs_control();
+    long long stageStart[stageCount]; // For the trace, when each stage was started
+    command_t *stage = cmd;
+    for (int i = 0; i < stageCount; i++, stage = stage->next) {
+        pids[i] = -1;
+        threads[i].cmd = NULL;
+        threads[i].started = 0;
+        const builtin_entry_t *builtin = findBuiltIn(stage->program != NULL ? stage->program : stage->args->data[0]);
+        int readsTerminal = builtin != NULL && builtin->readsStdin && i == 0 && stage->inputFile == NULL &&
+                            stage->hereData == NULL && isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+        if (builtin != NULL && !builtin->ownProcess && !cmd->background && !jobControl && !readsTerminal) {
+            threads[i].cmd = stage; // Started below
+            threads[i].index = i;
+            continue;
         }
-        if (pid1 == 0) {
-            //We are now in child 1 we will execute the left side command
-            close(pipefd[0]);
-            if (dup2(pipefd[1], STDOUT_FILENO) < 0) { //Check for errors
-                perror("dup2 (child1)");
-                exit(1);
-            }
-            close(pipefd[1]);
-
-            //Based on the project we can assume pipeline subcommands have no redirection
-            const char *cmdName;
-            if (cmd->program != NULL) {
-                cmdName = cmd->program;
-            } else {
-                cmdName = cmd->args->data[0];
-            }
-            if (isBuiltInCommand(cmdName)) {
-                handleBuiltInCommands(cmd);
-                exit(0);
-            } else {
-                //If cmdName has no "/" we search in these directories
-                char executablePath[4096];
-                if (strchr(cmdName, '/')) { // strchr finds the first instance of this char within a string
-                    strncpy(executablePath, cmdName, sizeof(executablePath));
-                    executablePath[sizeof(executablePath)-1] = '\0';
-                } else {
-                    const char *dirs[] = {"/usr/local/bin", "/usr/bin", "/bin"};
-                    int found = 0;
-                    for (int i = 0; i < 3; i++) {
-                        strncpy(executablePath, dirs[i], sizeof(executablePath) - 1);
-                        executablePath[sizeof(executablePath) - 1] = '\0';  //Make sure the null is there
-                        strncat(executablePath, "/", sizeof(executablePath) - strlen(executablePath) - 1);
-                        strncat(executablePath, cmdName, sizeof(executablePath) - strlen(executablePath) - 1);
-                        if (access(executablePath, X_OK) == 0) {
-                            found = 1;
-                            break;
-                        }
-                    }
-                    if (!found) {
-                        fprintf(stderr, "%s: command not found\n", cmdName);
-                        exit(1);
-                    }
+        stageStart[i] = trace_begin();
+        int inFd = (i > 0) ? pipes[2 * (i - 1)] : -1;
+        int outFd = (i < stageCount - 1) ? pipes[2 * i + 1] : -1;
+        int fdIn, fdOut;
+        if (lineTiming) {
+            timing_started(lineTiming, i, -1);
+        }
+        if (openRedirections(stage, &fdIn, &fdOut) != 0) {
+            continue; // Counts as a failed stage, the ones around it still run and just see EOF / a closed pipe
+        }
+        pids[i] = launchStage(stage, fdIn != -1 ? fdIn : inFd, fdOut != -1 ? fdOut : outFd, pgid, pipes, pipeFdCount);
+        if (lineTiming) {
+            lineTiming->stages[i].pid = pids[i];
+        }
+        if (fdIn != -1) {
+            close(fdIn);
+        }
+        if (fdOut != -1) {
+            close(fdOut);
+        }
+        if (pids[i] > 0) {
+            running++;
+            if (pgid == 0) {
+                pgid = pids[i];
+                if (!cmd->background) {
+                    jobs_terminal(pgid);
                 }
-                execv(executablePath, cmd->args->data);  //Finally exec takes over
-                perror("execv failed in 1st child pipe process");
-                exit(1);
             }
         }
+    }
 
-        //Now we fork second child for the right side command
-        pid_t pid2 = fork();
-        if (pid2 < 0) {
-            perror("fork");
-            prevExitStatus = 1;
-            return;
+    int threadCount = 0;
+    stage = cmd;
+    for (int i = 0; i < stageCount; i++, stage = stage->next) {
+        if (threads[i].cmd == NULL) {
+            continue;
         }
-        if (pid2 == 0) {
-            close(pipefd[1]); // Close write end.
-            if (dup2(pipefd[0], STDIN_FILENO) < 0) {
-                perror("dup2 (child2)");
-                exit(1);
+        stageStart[i] = trace_begin();
+        if (lineTiming) {
+            timing_started(lineTiming, i, 0);
+        }
+        int inFd = (i > 0) ? pipes[2 * (i - 1)] : -1;
+        int outFd = (i < stageCount - 1) ? pipes[2 * i + 1] : -1;
+        int fdIn, fdOut;
+        if (openRedirections(stage, &fdIn, &fdOut) != 0) {
+            continue;
+        }
+        if (startStageThread(&threads[i], fdIn != -1 ? fdIn : inFd, fdOut != -1 ? fdOut : outFd) == 0) {
+            threadCount++;
+        }
+        if (fdIn != -1) {
+            close(fdIn);
+        }
+        if (fdOut != -1) {
+            close(fdOut);
+        }
+    }
+
+    // Parent keeps none of the pipe ends, otherwise the readers never see EOF
+    for (int i = 0; i < pipeFdCount; i++) {
+        close(pipes[i]);
+    }
+
+    if (cmd->background) {
+        jobs_add(cmd, pgid, pids, stageCount);
+        prevExitStatus = 0; // Starting it worked, its own status comes from wait or fg
+        return;
+    }
+
+    int lastStatus = 1 << 8; // Reads as exit status 1 if the last stage never started
+    int stopped = 0;
+    long long waitStart = trace_begin();
+    while (running > 0) {
+        int status;
+        struct rusage ru;
+        pid_t pid = wait4(-pgid, &status, WUNTRACED, &ru); // Same as waitpid, the rusage is for time
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            close(pipefd[0]);
-            
-            const char *cmdName;
-            if (cmd->next->program != NULL) {
-                cmdName = cmd->next->program;
-            } else {
-                cmdName = cmd->next->args->data[0];
+            perror("waitpid");
+            break;
+        }
+        if (WIFSTOPPED(status)) {
+            if (WSTOPSIG(status) == SIGTSTP || WSTOPSIG(status) == SIGSTOP) {
+                int job = jobs_suspend(cmd, pgid, pids, stageCount, lastStatus);
+                if (job > 0) {
+                    stopped = 1; // In the job table now, the shell goes back to the prompt
+                    break;
+                }
+                if (job == 0) {
+                    continue; // The shell was stopped along with it and both were woken up again
+                }
             }
-            if (isBuiltInCommand(cmdName)) {
-                handleBuiltInCommands(cmd->next);
-                exit(0);
-            } else {
-                char executablePath[4096];
-                if (strchr(cmdName, '/')) {
-                    strncpy(executablePath, cmdName, sizeof(executablePath));
-                    executablePath[sizeof(executablePath)-1] = '\0';
-                } else {
-                    const char *dirs[] = {"/usr/local/bin", "/usr/bin", "/bin"};
-                    int found = 0;
-                    for (int i = 0; i < 3; i++) {
-                        //Re-use our old code from before
-                        strncpy(executablePath, dirs[i], sizeof(executablePath) - 1);
-                        executablePath[sizeof(executablePath) - 1] = '\0'; 
-                        strncat(executablePath, "/", sizeof(executablePath) - strlen(executablePath) - 1);
-                        strncat(executablePath, cmdName, sizeof(executablePath) - strlen(executablePath) - 1);
-                        if (access(executablePath, X_OK) == 0) {
-                            found = 1;
-                            break;
-                        }
-                    }
-                    if (!found) {
-                        fprintf(stderr, "%s: command not found\n", cmdName);
-                        exit(1);
-                    }
+            // Touched the terminal before we handed it over, or there is no terminal to stop it with, keep it going
+            kill(-pgid, SIGCONT);
+            continue;
+        }
+        running--;
+        if (pid == pids[stageCount - 1]) {
+            lastStatus = status;
+        }
+        if (lineTiming) {
+            timing_reaped(lineTiming, pid, status, &ru);
+        }
+        if (linePerf) {
+            perf_reaped(linePerf, pid, &ru);
+        }
+        if (traceEnabled) {
+            // Every stage gets a track of its own in the trace, from its start until we reaped it
+            stage = cmd;
+            for (int i = 0; i < stageCount; i++, stage = stage->next) {
+                if (pids[i] == pid) {
+                    trace_emit("run", stageStart[i], trace_now(), pid, stage->args->data[0]);
                 }
-                execv(executablePath, cmd->next->args->data); //Finally exec takes over
-                perror("execv failed in second child pipe process"); //If it fails check
-                exit(1);
             }
         }
-        
-        // We are now done and were in the parent close pipe file descriptors
-        close(pipefd[0]);
-        close(pipefd[1]);
-        
-        // Wait for both children
-        int status;
-        waitpid(pid1, NULL, 0);
-        waitpid(pid2, &status, 0);
-        if (WIFEXITED(status)){
-            prevExitStatus = WEXITSTATUS(status);
+        for (int i = 0; i < stageCount; i++) {
+            if (pids[i] == pid) {
+                pids[i] = -1; // Only the stages still running go to the job table if the line gets stopped
+            }
         }
-        else{
-            prevExitStatus = 1;
+    }
+    for (int i = 0; i < stageCount && threadCount > 0; i++) {
+        if (!threads[i].started) {
+            continue;
         }
-        
+        pthread_join(threads[i].thread, NULL);
+        threadCount--;
+        if (i == stageCount - 1) {
+            lastStatus = (threads[i].status & 0xff) << 8;
+        }
+        if (traceEnabled) {
+            trace_emit("run", stageStart[i], threads[i].endNs, threads[i].tid, threads[i].cmd->args->data[0]);
+        }
+    }
+    trace_end("wait", waitStart, NULL);
+    jobs_terminal(getpgrp());
+    if (stopped) {
+        prevExitStatus = 128 + SIGTSTP; // Like bash
         return;
-    }  //----End of pipeline block---
+    }
 
-    //Single Command Execution, no pipeline exists
+    if (WIFEXITED(lastStatus)) {
+        prevExitStatus = WEXITSTATUS(lastStatus);
+    } else {
+        prevExitStatus = 1;
+    }
+}
+
+//Conditional Execution--> can not run when it is the very first command
+// Returns 1 if the line should run, otherwise it says why not
+int conditionAllows(command_t *cmd) {
+    if (cmd->condition != NONE) {
+        //!This is the case where it is the very command
+        if(firstTimeRunning == 0){
+            fprintf(stdout, "Error: 'and' or 'or' command provided when this is the first command run. \n");
+            return 0;
+        }
+        if (cmd->condition == AND && prevExitStatus != 0) {
+            fprintf(stdout, "Skipping command due to 'and' condition (prevExitStatus = %d).\n", prevExitStatus);
+            return 0;
+        }
+        if (cmd->condition == OR && prevExitStatus == 0) {
+            fprintf(stdout, "Skipping command due to 'or' condition (prevExitStatus = %d).\n", prevExitStatus);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+  executeCommand, the main functions, alot of test cases
+  Executes a single command, or a pipeline of any length
+  - Conditional operators: if the command starts with and or "or" we decide whether to execute it based on firstTimeRunning global
+  -Pipelines: the stages are linked through cmd->next and runPipeline starts all of them
+  -Redirection: input and output files are opened in the parent and handed to the child as its stdin/stdout
+  -Built ins can be run with additional args we will handle them directly when no pipeline is involved. If they appear in a pipeline, they run on a thread.
+ */
+void executeCommand(command_t *cmd) {
+    if (!conditionAllows(cmd)) {
+        return;
+    }
+    firstTimeRunning = 1;
 
     const char *cmdName;
     if (cmd->program != NULL) {
@@ -328,501 +555,573 @@ void executeCommand(command_t *cmd) {
     } else {
         cmdName = cmd->args->data[0];
     }
-    int isBuiltin = isBuiltInCommand(cmdName);
+
+    //Programs and pipelines of any length (builtin stages run on threads), and anything run in the background
+    if (cmd->next != NULL || cmd->background || !isBuiltInCommand(cmdName)) {
+        runPipeline(cmd);
+        return;
+    }
 
     //--->For built-in commands executed alone
-    if (isBuiltin) {
-        int saved_stdin = -1, saved_stdout = -1;
-        int fdIn = -1, fdOut = -1;
-        
-        if (cmd->inputFile) {
-            saved_stdin = dup(STDIN_FILENO);
-            fdIn = open(cmd->inputFile, O_RDONLY);
-            if (fdIn < 0) {
-                perror("open input");
-                prevExitStatus = 1;
-                return;
-            }
-            if (dup2(fdIn, STDIN_FILENO) < 0) {
-                perror("dup2 input");
-                close(fdIn);
-                prevExitStatus = 1;
-                return;
-            }
+    // Same redirections as a pipeline stage gets, dup2'd onto our own stdin/stdout and put back afterwards
+    int saved_stdin = -1, saved_stdout = -1;
+    int fdIn, fdOut;
+    if (openRedirections(cmd, &fdIn, &fdOut) != 0) {
+        prevExitStatus = 1;
+        return;
+    }
+    if (fdIn != -1) {
+        saved_stdin = dup(STDIN_FILENO);
+        if (dup2(fdIn, STDIN_FILENO) < 0) {
+            perror("dup2 input");
             close(fdIn);
-        }
-        if (cmd->outputFile) {
-            saved_stdout = dup(STDOUT_FILENO);
-            fdOut = open(cmd->outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0640);
-            if (fdOut < 0) {
-                perror("open output");
-                prevExitStatus = 1;
-                if (saved_stdin != -1) {
-                    dup2(saved_stdin, STDIN_FILENO);
-                    close(saved_stdin);
-                }
-                return;
-            }
-            if (dup2(fdOut, STDOUT_FILENO) < 0) {
-                perror("dup2 output");
+            if (fdOut != -1) {
                 close(fdOut);
-                prevExitStatus = 1;
-                if (saved_stdin != -1) {
-                    dup2(saved_stdin, STDIN_FILENO);
-                    close(saved_stdin);
-                }
-                return;
             }
-            close(fdOut);
-        }
-        
-        // Execute the builtIn command in the parent
-        handleBuiltInCommands(cmd);
-        prevExitStatus = 0; 
-        
-        //Restore original file descriptor because we need it later
-        if (saved_stdin != -1) {
-            dup2(saved_stdin, STDIN_FILENO);
             close(saved_stdin);
+            prevExitStatus = 1;
+            return;
         }
-        if (saved_stdout != -1) {
-            dup2(saved_stdout, STDOUT_FILENO);
+        close(fdIn);
+    }
+    if (fdOut != -1) {
+        saved_stdout = dup(STDOUT_FILENO);
+        if (dup2(fdOut, STDOUT_FILENO) < 0) {
+            perror("dup2 output");
+            close(fdOut);
             close(saved_stdout);
+            prevExitStatus = 1;
+            if (saved_stdin != -1) {
+                dup2(saved_stdin, STDIN_FILENO);
+                close(saved_stdin);
+            }
+            return;
         }
-        return;
+        close(fdOut);
     }
     
-    // Now for exec commands.
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("fork");
-        prevExitStatus = 1;
-        return;
+    // Execute the builtIn command in the parent
+    if (lineTiming) {
+        timing_self_begin(lineTiming);
     }
-    if (pid == 0) { 
-        // Child process--> handle redirection then exec.
-        if (cmd->inputFile) {
-            int fdIn = open(cmd->inputFile, O_RDONLY);
-            if (fdIn < 0) {
-                perror("open input");
-                exit(1);
-            }
-            if (dup2(fdIn, STDIN_FILENO) < 0) {
-                perror("dup2 input");
-                close(fdIn);
-                exit(1);
+    long long traceStart = trace_begin();
+    prevExitStatus = handleBuiltInCommands(cmd);
+    trace_end("builtin", traceStart, cmdName);
+    if (lineTiming) {
+        timing_self_end(lineTiming, prevExitStatus);
+    }
+    
+    //Restore original file descriptor because we need it later
+    if (saved_stdin != -1) {
+        dup2(saved_stdin, STDIN_FILENO);
+        close(saved_stdin);
+    }
+    if (saved_stdout != -1) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+    return;
+}
+
+
+/*
+ * Expand the wildcard words (*, ? or [...]) of every stage right before it runs, the parser (and a compiled script) keeps them as they were written
+ * Stages without one keep their argument list as it is, the others get a new one from lineArena
+ * A word that matches nothing is passed on as it is
+ */
+void expandWildcards(command_t *cmd) {
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next) {
+        strvec_t *words = stage->args;
+        unsigned int i;
+        for (i = 0; words->data[i] != NULL; i++) {
+            if (wild_has_magic(words->data[i])) {
+                break;
             }
-            close(fdIn);
         }
-        if (cmd->outputFile) {
-            int fdOut = open(cmd->outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0640);
-            if (fdOut < 0) {
-                perror("open output");
-                exit(1);
-            }
-            if (dup2(fdOut, STDOUT_FILENO) < 0) {
-                perror("dup2 output");
-                close(fdOut);
-                exit(1);
-            }
-            close(fdOut);
+        if (words->data[i] == NULL) {
+            continue;
         }
-        
-        // We now must get the correct executable path
-        char executablePath[4096];
-        if (strchr(cmdName, '/')) {
-            strncpy(executablePath, cmdName, sizeof(executablePath));
-            executablePath[sizeof(executablePath)-1] = '\0';
-        } else {
-            const char *dirs[] = {"/usr/local/bin", "/usr/bin", "/bin"};
-            int found = 0;
-            for (int i = 0; i < 3; i++) {
-                strncpy(executablePath, dirs[i], sizeof(executablePath) - 1);
-                executablePath[sizeof(executablePath) - 1] = '\0';  // Ensure null-termination.
-                strncat(executablePath, "/", sizeof(executablePath) - strlen(executablePath) - 1);
-                strncat(executablePath, cmdName, sizeof(executablePath) - strlen(executablePath) - 1);
-            
-                if (access(executablePath, X_OK) == 0) {
-                    found = 1;
-                    break;
-                }
-            }
-            if (!found) {
-                fprintf(stderr, "%s: command not found\n", cmdName);
-                exit(1);
+
+        // The words before the first pattern go over in one piece
+        stage->args = arena_alloc(&lineArena, sizeof(strvec_t));
+        if (stage->args == NULL) {
+            perror("arena_alloc failed in expandWildcards");
+            exit(EXIT_FAILURE);
+        }
+        strvec_init(stage->args, &lineArena);
+        if (strvec_reserve(stage->args, words->length + 8) != 0 || strvec_extend(stage->args, words->data, i) != 0) {
+            perror("arena_alloc failed in expandWildcards");
+            exit(EXIT_FAILURE);
+        }
+        for (; words->data[i] != NULL; i++) {
+            if (!wild_has_magic(words->data[i]) || wild_expand(words->data[i], &lineArena, stage->args) == 0) {
+                addTokenToArgs(stage, words->data[i]);
             }
         }
-        
-        // Call exec and then run it given the path we created
-        execv(executablePath, cmd->args->data);
-        perror("execv");
-        exit(1);
-    } else {
-        // Now in parent we must wait for the child to finish.
-        int status;
-        waitpid(pid, &status, 0);
-        if (WIFEXITED(status))
-            prevExitStatus = WEXITSTATUS(status);
-        else
-            prevExitStatus = 1;
-        return;
+        finalizeArgs(stage);
     }
 }
 
+/*
+ * Take a time [-j] off the front of the line, the rest of it runs as usual and gets measured
+ * Returns 0 without time, 1 for the text report, 2 for JSON (-j, or MYSH_TIME_FORMAT=json), -1 if nothing follows it
+ */
+int takeTimePrefix(command_t *cmd) {
+    char **words = cmd->args->data;
+    if (words[0] == NULL || strcmp(words[0], "time") != 0) {
+        return 0;
+    }
+    const char *format = getenv("MYSH_TIME_FORMAT");
+    int mode = (format != NULL && strcmp(format, "json") == 0) ? 2 : 1;
+    int skip = 1;
+    if (words[1] != NULL && strcmp(words[1], "-j") == 0) {
+        mode = 2;
+        skip = 2;
+    }
+    if (words[skip] == NULL) {
+        fprintf(stderr, "time: missing command\n");
+        return -1;
+    }
+    // The argument list is in lineArena and is not appended to anymore, so it can just start further on
+    cmd->args->data += skip;
+    cmd->args->length -= skip;
+    cmd->args->capacity -= skip;
+    return mode;
+}
 
-// ExpandWildcard-->If a word contains * we have to expand it by matching files in a directory
-// If a word contains a /, use the part before the last / as the directory, otherwise, search in the current directory
-void expandWildcard(command_t *cmd, const char *token) {
-    const char *slash = strrchr(token, '/');
-    char dirname[1024];
-    char pattern[1024];
+/*
+ * Take perfstat [-j] off the front of the line (after time) the same way
+ * Returns 0 if the line is not counted, 1 for the text report, 2 for JSON, -1 if no command follows it
+ * Without perfstat every line is counted when MYSH_PERF is set
+ */
+int takePerfPrefix(command_t *cmd) {
+    char **words = cmd->args->data;
+    if (words[0] == NULL || strcmp(words[0], "perfstat") != 0) {
+        return perf_env_mode();
+    }
+    int mode = (perf_env_mode() == 2) ? 2 : 1;
+    int skip = 1;
+    if (words[1] != NULL && strcmp(words[1], "-j") == 0) {
+        mode = 2;
+        skip = 2;
+    }
+    if (words[skip] == NULL) {
+        fprintf(stderr, "perfstat: missing command\n");
+        return -1;
+    }
+    cmd->args->data += skip;
+    cmd->args->length -= skip;
+    cmd->args->capacity -= skip;
+    return mode;
+}
 
-    if (slash) {
-        int dirlen = slash - token;
-        strncpy(dirname, token, dirlen);
-        dirname[dirlen] = '\0';
-        strcpy(pattern, slash + 1);
-    } else {
-        strcpy(dirname, ".");
-        strcpy(pattern, token);
+/*
+ * Take a cached [-i file]... off the front of the line (after time), the -i files go into inputs (from lineArena)
+ * Returns 0 without cached, 1 with it, 2 for cached -s (print the counters, nothing else), -1 if no command follows it
+ */
+int takeCachedPrefix(command_t *cmd, char ***inputs, int *inputCount) {
+    char **words = cmd->args->data;
+    if (words[0] == NULL || strcmp(words[0], "cached") != 0) {
+        return 0;
+    }
+    if (words[1] != NULL && strcmp(words[1], "-s") == 0 && words[2] == NULL) {
+        return 2;
     }
+    int skip = 1;
+    *inputCount = 0;
+    while (words[skip] != NULL && strcmp(words[skip], "-i") == 0 && words[skip + 1] != NULL) {
+        skip += 2;
+    }
+    if (words[skip] == NULL) {
+        fprintf(stderr, "cached: usage: cached [-i file]... command, or cached -s\n");
+        return -1;
+    }
+    *inputs = arena_alloc(&lineArena, (skip / 2 + 1) * sizeof(char *));
+    if (*inputs == NULL) {
+        perror("arena_alloc failed in takeCachedPrefix");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 2; i < skip; i += 2) {
+        (*inputs)[(*inputCount)++] = words[i];
+    }
+    cmd->args->data += skip;
+    cmd->args->length -= skip;
+    cmd->args->capacity -= skip;
+    return 1;
+}
 
-    // Find the * in the pattern.
-    char *asterisk = strchr(pattern, '*');
-    if (!asterisk) {
-        addTokenToArgs(cmd, token);
+/*
+ * A line with the cached prefix (cache.c): on a hit its > files and stdout come back out of the store and nothing runs,
+ * on a miss it runs with its stdout going into a memfd, which is copied out once the line is done and stored if it exited 0
+ * So the output of a cached line comes all at once at the end. A background line is just run
+ */
+void runCached(command_t *cmd, char **inputs, int inputCount) {
+    cache_id_t key;
+    if (cmd->background || cache_key(cmd, inputs, inputCount, &key) != 0) {
+        executeCommand(cmd);
+        return;
+    }
+    if (!conditionAllows(cmd)) {
+        return;
+    }
+    cmd->condition = NONE; // Checked already, whatever runs below must not look at it again
+    firstTimeRunning = 1;
+    if (cache_restore(&key, cmd) == 0) {
+        prevExitStatus = 0;
         return;
     }
 
-    // Split the pattern
-    *asterisk = '\0';  
-    char *before = pattern;         // Everything before * 
-    char *after = asterisk + 1;      // Everything after * 
-    //It might be empty too idk check later
-
-    DIR *dir = opendir(dirname);
-    if (!dir) {
-        addTokenToArgs(cmd, token);
+    int captured = memfd_create("mysh-cached", MFD_CLOEXEC);
+    int savedStdout = (captured >= 0) ? dup(STDOUT_FILENO) : -1;
+    if (savedStdout < 0) {
+        perror("cached");
+        if (captured >= 0) {
+            close(captured);
+        }
+        executeCommand(cmd);
         return;
     }
+    fflush(stdout);
+    dup2(captured, STDOUT_FILENO);
+    executeCommand(cmd);
+    fflush(stdout);
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
 
-    struct dirent *entry;
-    int matches = 0;
-    while ((entry = readdir(dir)) != NULL) {
-        if (before[0] != '.' && entry->d_name[0] == '.')
-            continue;
+    lseek(captured, 0, SEEK_SET);
+    if (zc_copy(captured, STDOUT_FILENO) != 0) {
+        perror("cached: stdout");
+    }
+    if (prevExitStatus == 0) {
+        cache_store(&key, cmd, captured);
+    }
+    close(captured);
+}
 
-        int len = strlen(entry->d_name);
-        int plen = strlen(before);
-        int slen = strlen(after);
+/*
+ * Run a parsed line, from parseCommand or from a compiled script
+ * Everything that depends on what ran before (and/or, wildcards) happens here and not in the parser
+ */
+void runCommand(command_t *commandHead) {
+    // Do not allow a conditional operator as the first command not allowed must be ran after some other failed or succeeded commands
+    if (firstTimeRunning == 0 && commandHead->startsWithCondition) {
+        fprintf(stderr, "Error: 'and' or 'or' command provided when this is the first command run\n");
+        return;
+    }
 
-        // The filename must be at least as long as the combined before and affter lines
-        if (len < plen + slen){
-            continue;
+    int timeMode = takeTimePrefix(commandHead);
+    if (timeMode < 0) {
+        prevExitStatus = 1;
+        return;
+    }
+    int perfMode = takePerfPrefix(commandHead);
+    if (perfMode < 0) {
+        prevExitStatus = 1;
+        return;
+    }
+    char **cacheInputs = NULL;
+    int cacheInputCount = 0;
+    int cacheMode = takeCachedPrefix(commandHead, &cacheInputs, &cacheInputCount);
+    if (cacheMode < 0) {
+        prevExitStatus = 1;
+        return;
+    }
+    if (cacheMode == 2) {
+        if (!conditionAllows(commandHead)) {
+            return;
         }
+        cache_stats(stdout);
+        prevExitStatus = 0;
+        firstTimeRunning = 1;
+        return;
+    }
+    long long traceStart = trace_begin();
+    expandWildcards(commandHead);
+    trace_end("glob", traceStart, NULL);
 
-        if (strncmp(entry->d_name, before, plen) != 0){
-            continue;
+    // If the program name wasnt given just use args[0]
+    if (commandHead->program == NULL) {
+        commandHead->program = commandHead->args->data[0];
+    }
+    
+    timing_t timing;
+    if (timeMode > 0 && timing_init(&timing, commandHead, &lineArena, timeMode == 2) == 0) {
+        lineTiming = &timing;
+    }
+    perf_line_t perf;
+    if (perfMode > 0 && !commandHead->background && perf_init(&perf, commandHead, &lineArena, perfMode == 2) == 0) {
+        linePerf = &perf;
+        for (int i = 0; i < perf.stageCount; i++) {
+            command_t *stage = perf.stages[i].cmd;
+            perf.stages[i].builtin = isBuiltInCommand(stage->program != NULL ? stage->program : stage->args->data[0]);
         }
+    }
 
-        if (slen > 0) {
-            if (strcmp(entry->d_name + len - slen, after) != 0){
-                continue;
-            }
-        }
+    // Execute the command (still working on it)
+    if (cacheMode) {
+        runCached(commandHead, cacheInputs, cacheInputCount);
+    } else {
+        executeCommand(commandHead);
+    }
 
-        // Only add the entry if it matches the pattern
-        char fullpath[2048];
-        if (strcmp(dirname, ".") == 0) {
-            strncpy(fullpath, entry->d_name, sizeof(fullpath) - 1);
-            fullpath[sizeof(fullpath) - 1] = '\0';
-        } else {
-            strncpy(fullpath, dirname, sizeof(fullpath) - 1);
-            fullpath[sizeof(fullpath) - 1] = '\0';
-            strncat(fullpath, "/", sizeof(fullpath) - strlen(fullpath) - 1);
-            strncat(fullpath, entry->d_name, sizeof(fullpath) - strlen(fullpath) - 1);
-        }
-        addTokenToArgs(cmd, fullpath);
-        matches++;
-        
+    if (lineTiming) {
+        timing_report(lineTiming);
+        lineTiming = NULL;
+    }
+    if (linePerf) {
+        perf_report(linePerf);
+        linePerf = NULL;
     }
+    
+    firstTimeRunning = 1; // Mark that a command has been executed.
+    // Nothing to free, the caller resets lineArena once we are back
+}
 
-    closedir(dir);
+// Where the here-doc bodies of a line come from, the lines after it in the same reader
+typedef struct {
+    reader_t *reader;
+    int interactive;
+} here_source_t;
 
-    // If no entries matched we just add the original word like usual
-    if (matches == 0){
-        addTokenToArgs(cmd, token);
+static char *nextHereLine(void *ctx, size_t *len) {
+    here_source_t *source = ctx;
+    if (source->interactive) {
+        printf("> ");
+        fflush(stdout);
     }
+    char *line = reader_next(source->reader, len);
+    if (line != NULL) {
+        traceLine++;
+    }
+    return line;
 }
 
-
-/* Here we will process the commands given the provided arraylist from the tokenizerFunction and build a command structure using the arraylist for the arguments, then we will send to execute
+/* Here we will process the tokens tok_split found in line, parse them into a command structure and run it
+ * here is where the bodies of its << here-docs are read from, NULL for a line out of a compiled script (it has none)
  */
- void processCommand(arraylist_t *list) {
-    if (list->length == 0) {
+void processCommand(toklist_t *tokens, char *line, here_source_t *here) {
+    if (tokens->length == 0) {
         return; // Nothing to process.
     }
     
-    // Do not allow a conditional operator as the first command not allowed must be ran after some other failed or succeeded commands
-    if (firstTimeRunning == 0 &&
-        (strcmp(list->data[0], "and") == 0 || strcmp(list->data[0], "or") == 0)) {
+    // Checked before parsing too, this error wins over any syntax error on the line
+    int conditionFirst = (firstTimeRunning == 0 &&
+        (tokens->data[0].kind == TOK_AND || tokens->data[0].kind == TOK_OR));
+    
+    command_t *commandHead = NULL;
+    if (!conditionFirst) {
+        long long traceStart = trace_begin();
+        commandHead = parseCommand(tokens, line, &lineArena);
+        trace_end("parse", traceStart, NULL);
+    }
+    // The bodies are read even if the line does not run, so they never run as commands
+    if (here != NULL && readHereDocs(commandHead, tokens, line, nextHereLine, here, &lineArena) != 0) {
+        return;
+    }
+    if (conditionFirst) {
         fprintf(stderr, "Error: 'and' or 'or' command provided when this is the first command run\n");
         return;
     }
-    
-    command_t *commandHead = createCommandStruct();
-    if (!commandHead) {
-        fprintf(stderr, "Failed to create command structure\n");
+    if (commandHead == NULL) {
         return;
     }
-    
-    command_t *ptr = commandHead; //Made a comand linked list for the pipe if it appears
-
-    // Process each token in the tokenized input.
-    for (int i = 0; i < list->length; i++) {
-        char *token = list->data[i];
-        
-        if (strcmp(token, "<") == 0) {  // If word == >
-            i++;  // Move to the filename.
-            if (i < list->length) {
-                ptr->inputFile = strdup(list->data[i]);
-                if (!ptr->inputFile) {
-                    perror("strdup failed for inputFile");
-                    freeCommandStruct(commandHead);
-                    return;
-                }
-            } else {
-                fprintf(stderr, "Syntax error: missing input file after '<'\n");
-                freeCommandStruct(commandHead);
-                return;
+    runCommand(commandHead);
+}
+
+
+/*
+So this reads the lines either from batch mode or interactive moden which we then send to tok_split to seperate the words into token slices, after that we send it to a processing command where the actual program begins
+The reader hands out every line in place, in the mapped script or in its read buffer, so nothing is copied before the tokenizer sees it
+*/
+void process_lines(reader_t *reader, toklist_t *tokens, int interactive) {
+    char *line;
+    size_t linelen;
+
+    here_source_t here = {reader, interactive};
+    long long readStart = trace_begin();
+    while ((line = reader_next(reader, &linelen)) != NULL) {
+        traceLine++;
+        trace_end("read", readStart, NULL);
+        long long lineStart = trace_begin();
+        // A << body comes out of the same reader and reading it can move the buffer the line is in, so that line gets a copy
+        if (memmem(line, linelen, "<<", 2) != NULL) {
+            char *copy = arena_alloc(&lineArena, linelen + 1);
+            if (copy != NULL) {
+                memcpy(copy, line, linelen);
+                line = copy;
             }
         }
-        else if (strcmp(token, ">") == 0) {  // If word == >
-            i++;  // Move to the filename.
-            if (i < list->length) {
-                ptr->outputFile = strdup(list->data[i]);
-                if (!ptr->outputFile) {
-                    perror("strdup failed for outputFile");
-                    freeCommandStruct(commandHead);
-                    return;
-                }
-            } else {
-                fprintf(stderr, "Error: missing output file after '>'\n");
-                freeCommandStruct(commandHead);
-                return;
-            }
+        // At this point the line is complete and it holds a complete command
+        // Tokenize it, the tokens are slices of line so it has to stay put until the command is done
+        if (tok_split(tokens, line, linelen) != 0) {
+            perror("Problem with token list allocation");
         }
-        else if (strcmp(token, "|") == 0) {  // If token == |
-            ptr->pipePresent = 1;
-            ptr->next = createCommandStruct();
-            if (!ptr->next) { 
-                fprintf(stderr, "Pipeline has no next command; failed to proceed\n");
-                freeCommandStruct(commandHead);
-                return;
-            }
-            ptr = ptr->next; 
+        trace_end("tokenize", lineStart, NULL);
+
+        processCommand(tokens, line, &here);
+        arena_reset(&lineArena); // Everything the line allocated is gone in one go
+        trace_end("line", lineStart, NULL);
+
+        // For interactive mode we must print the prompt for the next command, not after a last line without a newline
+        // Jobs that finished in the meantime are reported first, a script only reaps them and keeps them for wait
+        if (interactive && !reader->partial) {
+            jobs_notify();
+            printf("mysh> ");
+            fflush(stdout);
+        } else {
+            jobs_collect(0);
         }
-        else if (strcmp(token, "and") == 0 || strcmp(token, "or") == 0) {  //Handle conditional operators
-            if (ptr != commandHead) {
-                fprintf(stderr, "Error: conditional operator cannot appear after a pipe\n");
-                freeCommandStruct(commandHead);
-                return;
-            }
-            ptr->condition = (strcmp(token, "and") == 0) ? AND : OR;
+        readStart = trace_begin(); // After the prompt, so an interactive read is the time spent typing
+    }
+}
+
+/*
+ * The loop for a compiled script, the lines come out of the .myshc already parsed and only have to run
+ * Lines that were kept as text go through the tokenizer and the parser like in process_lines
+ */
+void run_compiled(myshc_t *compiled, toklist_t *tokens) {
+    command_t *cmd;
+    char *raw;
+    unsigned int rawLen;
+    int kind;
+    long long loadStart = trace_begin();
+    while ((kind = myshc_next(compiled, &lineArena, &cmd, &raw, &rawLen)) != MYSHC_END) {
+        traceLine++;
+        trace_end("load", loadStart, NULL);
+        long long lineStart = trace_begin();
+        if (kind == MYSHC_DAMAGED) {
+            fprintf(stderr, "Error: compiled script is damaged, run mysh --compile again\n");
+            break;
         }
-        else {  // Now just as reguar besides the * stuff strchr looks for it at once
-            if (strchr(token, '*') != NULL) {
-                expandWildcard(ptr, token);
-            } else {
-                addTokenToArgs(ptr, token);
+        if (kind == MYSHC_PARSED) {
+            runCommand(cmd);
+        } else {
+            if (tok_split(tokens, raw, rawLen) != 0) {
+                perror("Problem with token list allocation");
             }
+            processCommand(tokens, raw, NULL);
         }
+        arena_reset(&lineArena);
+        jobs_collect(0);
+        trace_end("line", lineStart, NULL);
+        loadStart = trace_begin();
     }
-    
-    // Finalize the argument list by appending a NULL pointer.
-    finalizeArgs(commandHead);
-    
-    if (commandHead->args->data[0] == NULL) {
-        fprintf(stderr, "Error: missing command after conditional operator.\n");
-        freeCommandStruct(commandHead);
-        return;
+}
+
+// Main--> we set up input, set interactive mode or batch mode and and process the line
+/*
+ * One mysh --serve request, in a worker that already has the client's stdin/stdout/stderr and directory
+ * path is run like mysh path (from its .myshc if that is up to date), or with path NULL the script text is in fd
+ * Returns the status of the last command, which is what the client exits with
+ */
+static int serveScript(const char *path, int fd, void *ctx) {
+    toklist_t *tokens = ctx;
+    myshc_t compiled;
+    if (path != NULL && myshc_open(path, &compiled) == 0) {
+        run_compiled(&compiled, tokens);
+        myshc_close(&compiled);
+        return prevExitStatus;
     }
-    
-    // If the program name wasnt given just use arraylist[0]
-    if (commandHead->program == NULL && commandHead->args->data[0] != NULL) {
-        commandHead->program = strdup(commandHead->args->data[0]);
-        if (!commandHead->program) {
-            perror("strdup failed for program name");
-            freeCommandStruct(commandHead);
-            return;
+    if (path != NULL) {
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror("open");
+            return EXIT_FAILURE;
         }
     }
-    
-    // Make sure no conditioals come after piping
-    command_t *temp = commandHead->next;
-    while (temp != NULL) {
-        if (temp->condition != NONE) {
-            fprintf(stderr, "Error: conditional operator cannot appear after a pipe\n");
-            freeCommandStruct(commandHead);
-            return;
-        }
-        temp = temp->next;
+    reader_t reader;
+    if (reader_open(&reader, fd) != 0) {
+        perror("Problem with reader allocation");
+        return EXIT_FAILURE;
     }
-    
-    // Execute the command (still working on it)
-    executeCommand(commandHead);
-    
-    firstTimeRunning = 1; // Mark that a command has been executed.
-    
+    process_lines(&reader, tokens, 0);
+    reader_close(&reader);
+    close(fd);
+    return prevExitStatus;
+}
 
-    freeCommandStruct(commandHead); //Finally finish up and head back to processing lines
+/*
+ * One line of a mysh -P script (and its here-doc bodies), run through process_lines like any script
+ * In a forked shell it gets the status of the line before it and whether anything ran, which it would have had
+ * if the lines had run one after the other
+ */
+static int runScriptLine(const char *text, size_t len, int prevStatus, int ran, void *ctx) {
+    prevExitStatus = prevStatus;
+    firstTimeRunning = ran;
+    int fd = memfd_create("mysh-line", MFD_CLOEXEC);
+    if (fd < 0 || write(fd, text, len) != (ssize_t)len || lseek(fd, 0, SEEK_SET) != 0) {
+        perror("mysh -P");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return prevExitStatus;
+    }
+    return serveScript(NULL, fd, ctx);
 }
 
+int main(int argc, char *argv[]) {
+    const char *tracePath = getenv("MYSH_TRACE");
+    if (tracePath != NULL && *tracePath != '\0') {
+        trace_open(tracePath); // Tracing just stays off if the file can not be made
+    }
 
-void seperateWords (char *command, arraylist_t *list, int linelen) {
-    int insideAWord = 0;         // 0 = not inside a token or  1 = inside a token
-    char wordArray[wordArraySize];
-    int wordIndex = 0;       
-    
-    // Clear any previous tokens that was made by a previous command
-    al_clear(list);
-    
-    for (int i = 0; i < linelen; i++) {
-        char c = command[i];
-        
-        // If # is encountered, stop processing the rest as it is the beginning of a comment
-        if (c == '#') {
-            break;
-        }
-        
-        if (isspace(c)) {
-            // end of word if we're currently in one.
-            if (insideAWord) {
-                wordArray[wordIndex] = '\0';
-                int token_len = wordIndex;  
-                char *dup = malloc(token_len + 1);  // +1 for the null terminator.
-                if (!dup) {
-                    perror("malloc error on duplicate string in tokenize_command");
-                    return;
-                }
-                strcpy(dup, wordArray);
-                // Add the word to the array list
-                if (al_append(list, dup) != 0) {
-                    fprintf(stderr, "Failed to add token to the array list\n");
-                    free(dup);
-                    return;
-                }
-        
-                // Reset for the next word
-                wordIndex = 0;
-                insideAWord = 0;
-            }
-        } else {
-            // Add the character to the buffer
-            if (wordIndex < wordArraySize - 1) {
-                wordArray[wordIndex++] = c;
-            }
-            insideAWord = 1;
-        }
+    // mysh --compile script only writes script.myshc, nothing runs
+    if (argc > 2 && strcmp(argv[1], "--compile") == 0) {
+        return myshc_compile(argv[2]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-    
-    // If a token was being built at the end of the command we must finish it
-    if (insideAWord) {
-        wordArray[wordIndex] = '\0';
-        int token_len = wordIndex;
-        char *dup = malloc(token_len + 1);
-        if (!dup) {
-            perror("malloc");
-            return;
-        }
-        strcpy(dup, wordArray);
-        
-        if (al_append(list, dup) != 0){
-            fprintf(stderr, "Failed to add token to the array list\n");
-            free(dup);
-            return;
+
+    // mysh --serve sock [workers] runs scripts for mysh-client, the startup below is done once and every worker inherits it
+    if (argc > 2 && strcmp(argv[1], "--serve") == 0) {
+        signal(SIGPIPE, SIG_IGN);
+        toklist_t tokens;
+        if (arena_init(&lineArena, 16 * 1024) != 0 || tok_init(&tokens, 40) != 0) {
+            perror("Problem with line arena allocation");
+            exit(EXIT_FAILURE);
         }
+        int status = serve_main(argv[2], argc > 3 ? atoi(argv[3]) : 0, serveScript, &tokens);
+        tok_destroy(&tokens);
+        arena_destroy(&lineArena);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-}
-
 
-/*
-So this reads the lines either from batch mode or interactive moden which we then send to tokenize command to seperate the words in an array list, after that we send it to a processing command where the actual program begins
-*/
-void process_lines(int fd, arraylist_t *list, int interactive) {
-    int n = 0;
-    char buf[BUFLEN];
-    int pos;
-    char *line = NULL;
-    int linelen = 0;
-    int bytes;
-    int segstart, seglen;
-
-    while ((bytes = read(fd, buf, BUFLEN)) > 0) {
-     
-        segstart = 0;
-        for (pos = 0; pos < bytes; pos++) {
-            if (buf[pos] == '\n') {
-                seglen = pos - segstart;
-                line = realloc(line, linelen + seglen + 1);
-                if (!line) {
-                    perror("realloc");
-                    exit(EXIT_FAILURE);
-                }
-                memcpy(line + linelen, buf + segstart, seglen);
-                linelen += seglen;
-                line[linelen] = '\0';
-                
-                // At this point the line is complete and it holds a complete command
-                // Tokenize it
-                seperateWords(line, list, linelen);
-
-                processCommand(list);
-
-                // For interactive mode we must print the prompt for the next command
-                if (interactive) {
-                    printf("mysh> ");
-                    fflush(stdout);
-                }
-                      
-                // Clean up for the next command
-                free(line);
-                line = NULL;
-                linelen = 0;
-                n++;
-                segstart = pos + 1;
+    // mysh -P [-j N] script runs the lines that do not depend on each other at the same time (sched.h)
+    if (argc > 1 && strcmp(argv[1], "-P") == 0) {
+        int jobs = 0, i = 2;
+        if (i < argc && strncmp(argv[i], "-j", 2) == 0) {
+            const char *n = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            char *end;
+            jobs = strtol(n, &end, 10);
+            if (*n == '\0' || *end != '\0' || jobs < 1) {
+                fprintf(stderr, "mysh: -j expects a number of jobs\n");
+                return EXIT_FAILURE;
             }
+            i++;
         }
-        if (segstart < pos) {
-            seglen = pos - segstart;
-            line = realloc(line, linelen + seglen);
-            if (!line) {
-                perror("realloc");
-                exit(EXIT_FAILURE);
-            }
-            memcpy(line + linelen, buf + segstart, seglen);
-            linelen += seglen;
+        if (i >= argc) {
+            fprintf(stderr, "mysh: usage: mysh -P [-j N] script\n");
+            return EXIT_FAILURE;
         }
-    }
-    // Process any leftover command without a newline
-    if (line && linelen > 0) {
-        line = realloc(line, linelen + 1);
-        if (!line) {
-            perror("realloc");
+        // Lines run side by side, so none of them gets the terminal
+        jobs_init(0, 0);
+        signal(SIGPIPE, SIG_IGN);
+        toklist_t tokens;
+        if (arena_init(&lineArena, 16 * 1024) != 0 || tok_init(&tokens, 40) != 0) {
+            perror("Problem with line arena allocation");
             exit(EXIT_FAILURE);
         }
-        line[linelen] = '\0';
-        seperateWords(line, list, linelen);
-        processCommand(list);
-        free(line);
+        int status = sched_main(argv[i], jobs, runScriptLine, &tokens);
+        tok_destroy(&tokens);
+        arena_destroy(&lineArena);
+        return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-}
-
-// Main--> we set up input, set interactive mode or batch mode and and process the line
-int main(int argc, char *argv[]) {
     int fd;
-    if (argc > 1) {
+    myshc_t compiled;
+    int useCompiled = 0;
+    if (argc > 1 && myshc_open(argv[1], &compiled) == 0) {
+        useCompiled = 1; // An up to date script.myshc is mapped, the script itself is not read at all
+        fd = -1;
+    } else if (argc > 1) {
         fd = open(argv[1], O_RDONLY);
         if (fd < 0) {
             perror("open");
@@ -832,20 +1131,22 @@ int main(int argc, char *argv[]) {
         fd = STDIN_FILENO;
     }
     
-    int interactive = isatty(fd);
+    int interactive = !useCompiled && isatty(fd);
+    jobs_init(interactive, isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp());
+    signal(SIGPIPE, SIG_IGN); // A builtin stage writing to a pipe nobody reads anymore gets EPIPE instead of killing the shell
     if (interactive) {
         printf("Welcome to my shell!\n");
     }
     
-    // Initialize the array list
-    arraylist_t *list = malloc(sizeof(arraylist_t));
-    if (!list) {
-        perror("malloc");
-        perror("Problem with arraylist allocation");
+    // Initialize the line arena and the token list
+    if (arena_init(&lineArena, 16 * 1024) != 0) {
+        perror("Problem with line arena allocation");
+        exit(EXIT_FAILURE);
     }
-    if (al_init(list, 40) != 0) {
-        fprintf(stderr, "Error initializing array list\n");
-        perror("Problem with arraylist declaration");
+    toklist_t tokens;
+    if (tok_init(&tokens, 40) != 0) {
+        fprintf(stderr, "Error initializing token list\n");
+        perror("Problem with token list allocation");
     }
     
     // For interactive mode
@@ -854,18 +1155,29 @@ int main(int argc, char *argv[]) {
         fflush(stdout);
     }
     
-    process_lines(fd, list, interactive); //Our one loop
+    if (useCompiled) {
+        run_compiled(&compiled, &tokens);
+        myshc_close(&compiled);
+    } else {
+        reader_t reader;
+        if (reader_open(&reader, fd) != 0) {
+            perror("Problem with reader allocation");
+            exit(EXIT_FAILURE);
+        }
+        process_lines(&reader, &tokens, interactive); //Our one loop
+        reader_close(&reader);
+    }
     
     if (interactive) {
         printf("Good bye! Exiting my shell\n");
     }
 
-    if (fd != STDIN_FILENO) { //If in batch mode
+    if (fd != STDIN_FILENO && fd != -1) { //If in batch mode
         close(fd);
     }
 
-    al_destroy(list);
-    free(list);
+    tok_destroy(&tokens);
+    arena_destroy(&lineArena);
     
     return 0;
 } ///
\ No newline at end of file
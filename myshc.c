@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "myshc.h"
+
+/*
+ * Layout: a header, then one record per line that has something to run (blank and comment lines are dropped)
+ * Numbers are LEB128 varints, so nearly all of them take one byte, and nothing is aligned
+ *   parsed line: kind | condition << 2 | startsWithCondition << 4 | background << 5, stage count, then per stage
+ *                argument count << 3 | flags (STAGE_IN/STAGE_OUT/STAGE_HERE), the < file, the > file, the here-doc or
+ *                here-string body and the arguments as strings
+ *   raw line:    kind, then the line as a string
+ *   string:      length, the bytes and a '\0', so the loader can point into the map
+ */
+
+#define STAGE_IN  1
+#define STAGE_OUT 2
+#define STAGE_HERE 4
+
+typedef struct {
+    char magic[8];          // "MYSHC" and zeros
+    uint32_t version;
+    uint32_t byteOrder;     // 0x01020304 as the compiling machine wrote it
+    uint64_t sourceSize;    // The script this was compiled from, it has to still look like this
+    int64_t sourceMtimeSec;
+    int64_t sourceMtimeNsec;
+} myshc_header_t;
+
+static const char myshcMagic[8] = "MYSHC";
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} outbuf_t;
+
+static int out_put(outbuf_t *out, const void *bytes, size_t len) {
+    if (out->length + len > out->capacity) {
+        size_t newcap = out->capacity ? out->capacity : 4096;
+        while (newcap < out->length + len) {
+            newcap *= 2;
+        }
+        char *grown = realloc(out->data, newcap);
+        if (grown == NULL) {
+            return 1;
+        }
+        out->data = grown;
+        out->capacity = newcap;
+    }
+    memcpy(out->data + out->length, bytes, len);
+    out->length += len;
+    return 0;
+}
+
+static int out_varint(outbuf_t *out, uint32_t v) {
+    unsigned char bytes[5];
+    int n = 0;
+    while (v >= 0x80) {
+        bytes[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    bytes[n++] = v;
+    return out_put(out, bytes, n);
+}
+
+// The '\0' is written as part of the string so the loader can hand out pointers into the map as they are
+static int out_string(outbuf_t *out, const char *s, size_t len) {
+    return out_varint(out, len) || out_put(out, s, len) || out_put(out, "", 1);
+}
+
+static int out_command(outbuf_t *out, command_t *cmd) {
+    uint32_t stages = 0;
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next) {
+        stages++;
+    }
+    int err = out_varint(out, MYSHC_PARSED | cmd->condition << 2 | cmd->startsWithCondition << 4 | cmd->background << 5) ||
+              out_varint(out, stages);
+    for (command_t *stage = cmd; stage != NULL && !err; stage = stage->next) {
+        uint32_t flags = (stage->inputFile ? STAGE_IN : 0) | (stage->outputFile ? STAGE_OUT : 0) | (stage->hereData ? STAGE_HERE : 0);
+        uint32_t argc = stage->args->length - 1; // Not the NULL at the end
+        err = out_varint(out, argc << 3 | flags);
+        if (!err && stage->inputFile) {
+            err = out_string(out, stage->inputFile, strlen(stage->inputFile));
+        }
+        if (!err && stage->outputFile) {
+            err = out_string(out, stage->outputFile, strlen(stage->outputFile));
+        }
+        if (!err && stage->hereData) {
+            err = out_string(out, stage->hereData, stage->hereLen);
+        }
+        for (uint32_t i = 0; i < argc && !err; i++) {
+            err = out_string(out, stage->args->data[i], strlen(stage->args->data[i]));
+        }
+    }
+    return err;
+}
+
+// Read all of fd, returns NULL on an error
+static char *read_all(int fd, size_t *lenOut) {
+    size_t cap = 64 * 1024, len = 0;
+    char *buf = malloc(cap + 1);
+    if (buf == NULL) {
+        return NULL;
+    }
+    for (;;) {
+        if (len == cap) {
+            cap *= 2;
+            char *grown = realloc(buf, cap + 1);
+            if (grown == NULL) {
+                free(buf);
+                return NULL;
+            }
+            buf = grown;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            free(buf);
+            return NULL;
+        }
+        len += n;
+    }
+    *lenOut = len;
+    return buf;
+}
+
+// The lines after the one being compiled, for the here-doc bodies
+typedef struct {
+    const char *text;
+    size_t len;
+    size_t *start;
+} text_lines_t;
+
+static char *nextTextLine(void *ctx, size_t *len) {
+    text_lines_t *lines = ctx;
+    size_t start = *lines->start;
+    if (start >= lines->len) {
+        return NULL;
+    }
+    const char *nl = memchr(lines->text + start, '\n', lines->len - start);
+    *len = (nl ? (size_t)(nl - lines->text) : lines->len) - start;
+    *lines->start = start + *len + 1;
+    return (char *)lines->text + start;
+}
+
+/* Parse every line of script and write script.myshc, through a temporary file so a running mysh never sees half of it
+* Lines that do not parse print their error now and are kept as text
+* Returns 0 for success, 1 on an error (already printed)
+*/
+int myshc_compile(const char *script) {
+    int fd = open(script, O_RDONLY);
+    if (fd < 0) {
+        perror(script);
+        return 1;
+    }
+    struct stat st;
+    size_t len;
+    char *text = NULL;
+    if (fstat(fd, &st) != 0 || (text = read_all(fd, &len)) == NULL) {
+        perror(script);
+        close(fd);
+        return 1;
+    }
+    close(fd);
+
+    myshc_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, myshcMagic, sizeof(header.magic));
+    header.version = MYSHC_VERSION;
+    header.byteOrder = 0x01020304;
+    header.sourceSize = st.st_size;
+    header.sourceMtimeSec = st.st_mtim.tv_sec;
+    header.sourceMtimeNsec = st.st_mtim.tv_nsec;
+
+    outbuf_t out = {NULL, 0, 0};
+    arena_t arena = {NULL, NULL, 0, 0};
+    toklist_t tokens;
+    char *line = malloc(len + 1); // Big enough for any line, the tokenizer writes into it
+    int err = (tok_init(&tokens, 40) != 0 || line == NULL || arena_init(&arena, 16 * 1024) != 0);
+    if (!err) {
+        err = out_put(&out, &header, sizeof(header));
+    }
+
+    int lineNumber = 0;
+    size_t start = 0;
+    text_lines_t rest = {text, len, &start};
+    while (start < len && !err) {
+        size_t lineStart = start;
+        char *nl = memchr(text + start, '\n', len - start);
+        size_t linelen = (nl ? (size_t)(nl - text) : len) - start;
+        lineNumber++;
+        memcpy(line, text + start, linelen);
+        start += linelen + 1; // Any here-doc bodies are read from here on
+        if (tok_split(&tokens, line, linelen) != 0) {
+            err = 1;
+            break;
+        }
+        if (tokens.length > 0) {
+            command_t *cmd = parseCommand(&tokens, line, &arena);
+            int commandLine = lineNumber;
+            size_t bodyStart = start;
+            if (readHereDocs(cmd, &tokens, line, nextTextLine, &rest, &arena) != 0) {
+                err = 1;
+                break;
+            }
+            for (size_t i = bodyStart; i < start && i < len; i++) {
+                lineNumber += (text[i] == '\n');
+            }
+            if (cmd != NULL) {
+                err = out_command(&out, cmd);
+            } else {
+                // The bodies are dropped, a line that does not parse never runs
+                fprintf(stderr, "%s:%d: kept as text, it will give the same error when it runs\n", script, commandLine);
+                err = out_varint(&out, MYSHC_RAW) || out_string(&out, text + lineStart, linelen);
+            }
+        }
+        arena_reset(&arena);
+    }
+    tok_destroy(&tokens);
+    arena_destroy(&arena);
+    free(line);
+    free(text);
+    if (err) {
+        fprintf(stderr, "%s: out of memory while compiling\n", script);
+        free(out.data);
+        return 1;
+    }
+
+    char path[4096], tmp[4096];
+    snprintf(path, sizeof(path), "%s%s", script, MYSHC_SUFFIX);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(tmp);
+        free(out.data);
+        return 1;
+    }
+    size_t written = 0;
+    while (written < out.length) {
+        ssize_t n = write(fd, out.data + written, out.length - written);
+        if (n < 0) {
+            perror(tmp);
+            close(fd);
+            unlink(tmp);
+            free(out.data);
+            return 1;
+        }
+        written += n;
+    }
+    free(out.data);
+    if (close(fd) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        unlink(tmp);
+        return 1;
+    }
+    return 0;
+}
+
+/* Map script.myshc if it is there, newer than script and was compiled from the script as it is now
+* Returns 0 if c is ready for myshc_next, 1 if the script has to be read the normal way
+*/
+int myshc_open(const char *script, myshc_t *c) {
+    char path[4096];
+    struct stat src, st;
+    snprintf(path, sizeof(path), "%s%s", script, MYSHC_SUFFIX);
+    if (stat(script, &src) != 0) {
+        return 1;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(myshc_header_t) ||
+        st.st_mtim.tv_sec < src.st_mtim.tv_sec ||
+        (st.st_mtim.tv_sec == src.st_mtim.tv_sec && st.st_mtim.tv_nsec < src.st_mtim.tv_nsec)) {
+        close(fd);
+        return 1;
+    }
+    c->map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (c->map == MAP_FAILED) {
+        return 1;
+    }
+    c->size = st.st_size;
+    c->pos = sizeof(myshc_header_t);
+
+    myshc_header_t *header = (myshc_header_t *)c->map;
+    if (memcmp(header->magic, myshcMagic, sizeof(header->magic)) != 0 || header->version != MYSHC_VERSION ||
+        header->byteOrder != 0x01020304 || header->sourceSize != (uint64_t)src.st_size ||
+        header->sourceMtimeSec != src.st_mtim.tv_sec || header->sourceMtimeNsec != src.st_mtim.tv_nsec) {
+        myshc_close(c);
+        return 1;
+    }
+    return 0;
+}
+
+static int in_varint(myshc_t *c, uint32_t *v) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (c->pos >= c->size) {
+            return 1;
+        }
+        unsigned char byte = c->map[c->pos++];
+        result |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Points straight into the map, the '\0' is already there
+static int in_string(myshc_t *c, char **s, unsigned int *lenOut) {
+    uint32_t len;
+    if (in_varint(c, &len) != 0 || len >= c->size - c->pos || c->map[c->pos + len] != '\0') {
+        return 1;
+    }
+    *s = c->map + c->pos;
+    if (lenOut != NULL) {
+        *lenOut = len;
+    }
+    c->pos += (size_t)len + 1;
+    return 0;
+}
+
+static int in_stage(myshc_t *c, command_t *stage) {
+    uint32_t word;
+    if (in_varint(c, &word) != 0) {
+        return 1;
+    }
+    uint32_t argc = word >> 3;
+    if ((word & STAGE_IN) && in_string(c, &stage->inputFile, NULL) != 0) {
+        return 1;
+    }
+    if ((word & STAGE_OUT) && in_string(c, &stage->outputFile, NULL) != 0) {
+        return 1;
+    }
+    unsigned int hereLen;
+    if (word & STAGE_HERE) {
+        if (in_string(c, &stage->hereData, &hereLen) != 0) {
+            return 1;
+        }
+        stage->hereLen = hereLen;
+    }
+    for (uint32_t i = 0; i < argc; i++) {
+        char *arg;
+        if (in_string(c, &arg, NULL) != 0) {
+            return 1;
+        }
+        addTokenToArgs(stage, arg);
+    }
+    finalizeArgs(stage);
+    return argc == 0; // The parser never lets a stage without a command through
+}
+
+/* Load the next line, the command_t's come from arena and their strings point into the map
+* MYSHC_PARSED fills in cmd, MYSHC_RAW fills in raw/rawLen with the line as written (writable, '\0' at raw[rawLen])
+* MYSHC_END at the end of the file, MYSHC_DAMAGED if the file does not make sense
+*/
+int myshc_next(myshc_t *c, arena_t *arena, command_t **cmd, char **raw, unsigned int *rawLen) {
+    uint32_t word, stages;
+    if (c->pos >= c->size) {
+        return MYSHC_END;
+    }
+    if (in_varint(c, &word) != 0) {
+        return MYSHC_DAMAGED;
+    }
+    if (word == MYSHC_RAW) {
+        return in_string(c, raw, rawLen) == 0 ? MYSHC_RAW : MYSHC_DAMAGED;
+    }
+    uint32_t condition = (word >> 2) & 3;
+    if ((word & 3) != MYSHC_PARSED || word >> 6 != 0 || condition > OR || in_varint(c, &stages) != 0 || stages == 0) {
+        return MYSHC_DAMAGED;
+    }
+    command_t *head = NULL, *prev = NULL;
+    for (uint32_t i = 0; i < stages; i++) {
+        command_t *stage = createCommandStruct(arena);
+        if (stage == NULL || in_stage(c, stage) != 0) {
+            return MYSHC_DAMAGED;
+        }
+        if (prev != NULL) {
+            prev->pipePresent = 1;
+            prev->next = stage;
+        } else {
+            head = stage;
+        }
+        prev = stage;
+    }
+    head->condition = condition;
+    head->startsWithCondition = (word >> 4) & 1;
+    head->background = (word >> 5) & 1;
+    *cmd = head;
+    return MYSHC_PARSED;
+}
+
+void myshc_close(myshc_t *c) {
+    munmap(c->map, c->size);
+    c->map = NULL;
+    c->size = c->pos = 0;
+}
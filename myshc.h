@@ -0,0 +1,34 @@
+#ifndef MYSHC_H
+#define MYSHC_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "command.h"
+
+/*
+ * Compiled batch scripts, mysh --compile script writes script.myshc next to it
+ * The file holds every line already parsed (the command_t chain, flattened), so running it again skips reading,
+ * tokenizing and parsing, loading a line is just pointing a few command_t's into the mapped file
+ * Lines that did not parse are kept as text and go through the normal path when they run, so their error shows up at the right time
+ * Wildcards are kept as written and still expand when the line runs, here-doc bodies are stored with the line they belong to
+ * The format is native byte order and word size, it is meant for the machine that compiled it
+ */
+
+#define MYSHC_VERSION 3
+#define MYSHC_SUFFIX ".myshc"
+
+// What myshc_next found
+enum { MYSHC_END, MYSHC_PARSED, MYSHC_RAW, MYSHC_DAMAGED };
+
+typedef struct {
+    char *map;      // The whole file, MAP_PRIVATE and writable so raw lines can be tokenized in place
+    size_t size;
+    size_t pos;     // Next record
+} myshc_t;
+
+int myshc_compile(const char *script);
+int myshc_open(const char *script, myshc_t *c);
+int myshc_next(myshc_t *c, arena_t *arena, command_t **cmd, char **raw, unsigned int *rawLen);
+void myshc_close(myshc_t *c);
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "serve.h"
+
+/*
+ * mysh-client, runs a script on a mysh --serve server as if it was ./mysh script
+ * The script reads our stdin and writes our stdout/stderr itself (the fds are passed over the socket),
+ * all we do is wait for the exit status and exit with it
+ * usage: mysh-client sock script    a script file, relative to our directory
+ *        mysh-client sock -c text   the script text itself
+ *        mysh-client sock           the script text from stdin
+ */
+
+static void usage(void) {
+    fprintf(stderr, "usage: mysh-client sock [script | -c text]\n");
+    exit(2);
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// All of stdin, malloc'd
+static char *read_stdin(size_t *len) {
+    size_t cap = 4096;
+    char *buf = malloc(cap);
+    *len = 0;
+    for (;;) {
+        if (buf == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        ssize_t n = read(STDIN_FILENO, buf + *len, cap - *len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+        if (n == 0) {
+            return buf;
+        }
+        *len += n;
+        if (*len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 4 || (argc == 4 && strcmp(argv[2], "-c") != 0) || (argc == 3 && strcmp(argv[2], "-c") == 0)) {
+        usage();
+    }
+    serve_request_t req = {SERVE_MAGIC, SERVE_PATH, 0, 0};
+    const char *body;
+    size_t bodyLen;
+    if (argc == 4) {
+        req.kind = SERVE_TEXT;
+        body = argv[3];
+        bodyLen = strlen(body);
+    } else if (argc == 3) {
+        body = argv[2];
+        bodyLen = strlen(body);
+    } else {
+        req.kind = SERVE_TEXT;
+        body = read_stdin(&bodyLen);
+    }
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        return EXIT_FAILURE;
+    }
+    req.cwdLen = strlen(cwd);
+    req.bodyLen = bodyLen;
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "mysh-client: socket path too long: %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, argv[1]);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // The header carries our stdin, stdout and stderr
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+    ssize_t sent;
+    do {
+        sent = sendmsg(sock, &msg, 0);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0 || ((size_t)sent < sizeof(req) && write_all(sock, (char *)&req + sent, sizeof(req) - sent) != 0)
+        || write_all(sock, cwd, req.cwdLen) != 0 || write_all(sock, body, bodyLen) != 0) {
+        perror("mysh-client: send");
+        return EXIT_FAILURE;
+    }
+
+    int32_t status;
+    size_t got = 0;
+    while (got < sizeof(status)) {
+        ssize_t n = read(sock, (char *)&status + got, sizeof(status) - got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "mysh-client: the server closed the connection before the script finished\n");
+            return EXIT_FAILURE;
+        }
+        got += n;
+    }
+    close(sock);
+    return status & 0xff;
+}
@@ -0,0 +1,308 @@
+#define _GNU_SOURCE // For memfd_create
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include "parallel.h"
+#include "pathcache.h"
+#include "launcher.h"
+#include "zerocopy.h"
+#include "jobs.h"
+
+#define PAR_MAX_FAILED 101
+
+typedef struct {
+    pid_t pid;      // 0 when the slot is free
+    int pidfd;      // -1 if the kernel has no pidfd_open, the slot is polled with waitpid then
+    int outFd;      // memfds, emptied and kept for the next job in the slot
+    int errFd;
+} par_slot_t;
+
+typedef struct {
+    par_slot_t *slots;
+    int slotCount;
+    int running;
+    int failed;
+    int interrupted;    // A job died of ^C, nothing new is started
+    pid_t pgid;         // All the jobs share one group so ^C reaches all of them, the first job leads it
+    int ownTerminal;    // Our group has the terminal, so the jobs get it, not so in a line that runs in the background
+} par_state_t;
+
+static void par_usage(void) {
+    fprintf(stderr, "parallel: usage: parallel [-j N] command [args] ::: inputs...\n");
+}
+
+// word with every {} replaced by input, malloc'd, or word itself if it has no {}
+static char *par_fill(char *word, const char *input) {
+    const char *p = strstr(word, "{}");
+    if (p == NULL) {
+        return word;
+    }
+    size_t inputLen = strlen(input), count = 0;
+    for (; p != NULL; p = strstr(p + 2, "{}")) {
+        count++;
+    }
+    char *filled = malloc(strlen(word) + count * inputLen + 1);
+    if (filled == NULL) {
+        return NULL;
+    }
+    char *out = filled;
+    const char *from = word;
+    for (p = strstr(from, "{}"); p != NULL; p = strstr(from, "{}")) {
+        memcpy(out, from, p - from);
+        out += p - from;
+        memcpy(out, input, inputLen);
+        out += inputLen;
+        from = p + 2;
+    }
+    strcpy(out, from);
+    return filled;
+}
+
+// Copy what the job in slot wrote to our stdout and stderr and empty the memfds for the next job
+static void par_flush(par_slot_t *slot) {
+    fflush(stdout);
+    fflush(stderr);
+    if (lseek(slot->outFd, 0, SEEK_SET) == 0 && zc_copy(slot->outFd, STDOUT_FILENO) != 0) {
+        perror("parallel: output");
+    }
+    if (lseek(slot->errFd, 0, SEEK_SET) == 0 && zc_copy(slot->errFd, STDERR_FILENO) != 0) {
+        perror("parallel: output");
+    }
+    // The next job has to start writing at 0 again, or it leaves a hole of zeros in front of its output
+    if (ftruncate(slot->outFd, 0) != 0 || ftruncate(slot->errFd, 0) != 0 ||
+        lseek(slot->outFd, 0, SEEK_SET) != 0 || lseek(slot->errFd, 0, SEEK_SET) != 0) {
+        perror("parallel: ftruncate");
+    }
+}
+
+static void par_status(par_state_t *st, int status) {
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        st->failed++;
+    }
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+        st->interrupted = 1;
+    }
+}
+
+/* The job in slot has exited (its pidfd said so), take its status and print its output
+* The group leader is only looked at with WNOWAIT, its zombie keeps the pgid around for the jobs still to come
+*/
+static void par_finish(par_state_t *st, par_slot_t *slot) {
+    int status;
+    if (slot->pid == st->pgid) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_PID, slot->pid, &info, WEXITED | WNOWAIT | WNOHANG) != 0 || info.si_pid == 0) {
+            return;
+        }
+        status = (info.si_code == CLD_EXITED) ? (info.si_status & 0xff) << 8 : (info.si_status & 0x7f);
+    } else if (waitpid(slot->pid, &status, WNOHANG) != slot->pid) {
+        return;
+    }
+    par_status(st, status);
+    par_flush(slot);
+    if (slot->pidfd >= 0) {
+        close(slot->pidfd);
+        slot->pidfd = -1;
+    }
+    slot->pid = 0;
+    st->running--;
+}
+
+/* Start template with input in slot, returns 0 if it is running
+* A job that can not start counts as failed and its error goes through the slot's memfds like any other output
+*/
+static int par_start(par_state_t *st, par_slot_t *slot, char **template, int templateCount, int hasBraces, const char *input) {
+    char *argv[templateCount + 2];
+    int argc = 0, result = 1;
+    for (int i = 0; i < templateCount; i++) {
+        argv[argc] = par_fill(template[i], input);
+        if (argv[argc] == NULL) {
+            perror("malloc failed in parallel");
+            break;
+        }
+        argc++;
+    }
+    if (argc == templateCount) {
+        if (!hasBraces) {
+            argv[argc++] = (char *)input;
+        }
+        argv[argc] = NULL;
+
+        char path[4096];
+        int err = 0;
+        if (pc_lookup(argv[0], path, sizeof(path)) != 0) {
+            dprintf(slot->errFd, "%s: command not found\n", argv[0]);
+        } else if ((err = launch_spawn_err(path, argv, -1, slot->outFd, slot->errFd, st->pgid, &slot->pid)) != 0) {
+            dprintf(slot->errFd, "execv: %s\n", strerror(err));
+        } else {
+            result = 0;
+        }
+    }
+    for (int i = 0; i < templateCount && i < argc; i++) {
+        if (argv[i] != template[i]) {
+            free(argv[i]);
+        }
+    }
+    if (result != 0) {
+        slot->pid = 0;
+        st->failed++;
+        par_flush(slot);
+        return 1;
+    }
+
+    if (st->pgid == 0) {
+        st->pgid = slot->pid;
+        if (st->ownTerminal) {
+            jobs_terminal(st->pgid);
+        }
+    }
+    slot->pidfd = syscall(SYS_pidfd_open, slot->pid, 0);
+    st->running++;
+    return 0;
+}
+
+/* The parallel builtin, see parallel.h
+* Returns the number of failed jobs (at most 101), or 1 for a usage error
+*/
+int par_run(strvec_t *list) {
+    char **args = list->data;
+    int argCount = list->length - 1;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+    if (i < argCount && strncmp(args[i], "-j", 2) == 0) {
+        const char *n = args[i][2] ? args[i] + 2 : (i + 1 < argCount ? args[++i] : "");
+        char *end;
+        jobs = strtol(n, &end, 10);
+        if (*n == '\0' || *end != '\0' || jobs < 1) {
+            fprintf(stderr, "parallel: -j expects a number of jobs\n");
+            return 1;
+        }
+        i++;
+    }
+    char **template = &args[i];
+    int templateCount = 0;
+    while (i < argCount && strcmp(args[i], ":::") != 0) {
+        templateCount++;
+        i++;
+    }
+    if (templateCount == 0 || i == argCount) {
+        par_usage();
+        return 1;
+    }
+    char **inputs = &args[i + 1];
+    int inputCount = argCount - i - 1;
+    if (inputCount == 0) {
+        return 0;
+    }
+    int hasBraces = 0;
+    for (int t = 0; t < templateCount; t++) {
+        hasBraces |= (strstr(template[t], "{}") != NULL);
+    }
+    if (jobs > inputCount) {
+        jobs = inputCount;
+    }
+
+    par_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.ownTerminal = (tcgetpgrp(STDIN_FILENO) == getpgrp()); // -1 when stdin is not a terminal
+    st.slotCount = jobs;
+    st.slots = calloc(jobs, sizeof(par_slot_t));
+    struct pollfd *pfds = calloc(jobs, sizeof(struct pollfd));
+    par_slot_t **polled = calloc(jobs, sizeof(par_slot_t *));
+    if (st.slots == NULL || pfds == NULL || polled == NULL) {
+        perror("calloc failed in parallel");
+        free(st.slots);
+        free(pfds);
+        free(polled);
+        return 1;
+    }
+    int ready;
+    for (ready = 0; ready < st.slotCount; ready++) {
+        st.slots[ready].pidfd = st.slots[ready].outFd = st.slots[ready].errFd = -1;
+    }
+    for (ready = 0; ready < st.slotCount; ready++) {
+        par_slot_t *slot = &st.slots[ready];
+        slot->outFd = memfd_create("parallel-out", MFD_CLOEXEC);
+        slot->errFd = memfd_create("parallel-err", MFD_CLOEXEC);
+        if (slot->outFd < 0 || slot->errFd < 0) {
+            perror("parallel: memfd_create");
+            break;
+        }
+    }
+
+    int next = 0;
+    while (ready == st.slotCount && (st.running > 0 || (next < inputCount && !st.interrupted))) {
+        // Every free slot gets the next input
+        for (int s = 0; s < st.slotCount && next < inputCount && !st.interrupted; s++) {
+            if (st.slots[s].pid == 0) {
+                par_start(&st, &st.slots[s], template, templateCount, hasBraces, inputs[next++]);
+            }
+        }
+        if (st.running == 0) {
+            continue;
+        }
+
+        int count = 0, unpolled = 0;
+        for (int s = 0; s < st.slotCount; s++) {
+            if (st.slots[s].pid == 0) {
+                continue;
+            }
+            if (st.slots[s].pidfd < 0) {
+                unpolled = 1;
+                continue;
+            }
+            pfds[count].fd = st.slots[s].pidfd;
+            pfds[count].events = POLLIN;
+            polled[count++] = &st.slots[s];
+        }
+        int n = poll(pfds, count, unpolled ? 10 : -1);
+        if (n < 0 && errno != EINTR) {
+            perror("parallel: poll");
+            break;
+        }
+        for (int p = 0; p < count && n > 0; p++) {
+            if (pfds[p].revents) {
+                par_finish(&st, polled[p]);
+            }
+        }
+        for (int s = 0; unpolled && s < st.slotCount; s++) {
+            if (st.slots[s].pid != 0 && st.slots[s].pidfd < 0) {
+                par_finish(&st, &st.slots[s]);
+            }
+        }
+    }
+
+    if (st.pgid > 0) {
+        while (waitpid(st.pgid, NULL, 0) < 0 && errno == EINTR) {
+        }
+        if (st.ownTerminal) {
+            jobs_terminal(getpgrp());
+        }
+    }
+    for (int s = 0; s < st.slotCount; s++) {
+        if (st.slots[s].outFd >= 0) {
+            close(st.slots[s].outFd);
+        }
+        if (st.slots[s].errFd >= 0) {
+            close(st.slots[s].errFd);
+        }
+    }
+    free(st.slots);
+    free(pfds);
+    free(polled);
+    if (ready != st.slotCount) {
+        return 1;
+    }
+    if (next < inputCount) {
+        st.failed += inputCount - next; // Never started after a ^C
+    }
+    return st.failed > PAR_MAX_FAILED ? PAR_MAX_FAILED : st.failed;
+}
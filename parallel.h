@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "vec.h"
+
+/*
+ * parallel [-j N] command args ::: inputs...
+ * Runs command once per input, with every {} in its words replaced by the input (or the input added at the end
+ * when there is no {}), keeping up to N of them running at once (one per CPU by default)
+ * A new one starts as soon as one finishes, the children are watched through their pidfds with poll
+ * Every job writes its stdout and stderr into its own memfds, which are copied out whole once the job is done,
+ * so the output of two jobs never gets mixed. The exit status is how many jobs failed, up to 101 like GNU parallel
+ */
+
+int par_run(strvec_t *list);
+
+#endif
@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "pathcache.h"
+
+#define PC_DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin" // What we searched before PATH was honored
+#define PC_INITIAL_CAPACITY 64 // Must stay a power of two
+
+/*
+ * One directory out of $PATH, along with the stamp we saw the last time we checked it
+ */
+typedef struct {
+    char *path;
+    int exists;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+} pc_dir_t;
+
+/*
+ * One slot in the hash table, name == NULL means the slot is empty
+ * path == NULL is a negative entry (command not found), dir == -1 is an entry pinned with hash -p
+ */
+typedef struct {
+    char *name;
+    char *path;
+    unsigned int hits;
+    int dir;
+} pc_entry_t;
+
+static char *pcPathVar = NULL;   // The $PATH value the directory list was built from
+static char *pcDirBuf = NULL;    // Copy of it split on ':', the dir paths point in here
+static pc_dir_t *pcDirs = NULL;
+static int pcDirCount = 0;
+static pc_entry_t *pcTable = NULL;
+static unsigned int pcCapacity = 0;
+static unsigned int pcCount = 0;
+static pthread_mutex_t pcLock = PTHREAD_MUTEX_INITIALIZER; // Builtin pipeline stages (which, hash...) run on threads
+
+// FNV-1a, good enough for command names
+static unsigned int pc_hash(const char *s) {
+    unsigned int h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Stat one directory into its stamp, returns 1 if the stamp is different from what we had
+static int pc_stamp_dir(pc_dir_t *d) {
+    struct stat st;
+    if (stat(d->path, &st) != 0) {
+        int changed = d->exists;
+        d->exists = 0;
+        return changed;
+    }
+    int changed = !d->exists || d->dev != st.st_dev || d->ino != st.st_ino ||
+                  d->mtime.tv_sec != st.st_mtim.tv_sec || d->mtime.tv_nsec != st.st_mtim.tv_nsec;
+    d->exists = 1;
+    d->dev = st.st_dev;
+    d->ino = st.st_ino;
+    d->mtime = st.st_mtim;
+    return changed;
+}
+
+// Free every entry in the table but keep the table itself around
+static void pc_drop_all(void) {
+    for (unsigned int i = 0; i < pcCapacity; i++) {
+        if (pcTable[i].name != NULL) {
+            free(pcTable[i].name);
+            free(pcTable[i].path);
+            pcTable[i].name = NULL;
+            pcTable[i].path = NULL;
+        }
+    }
+    pcCount = 0;
+}
+
+// Rebuild the directory list if $PATH is not the one we cached, everything we resolved before is thrown out
+static int pc_sync_path(void) {
+    const char *var = getenv("PATH");
+    if (var == NULL) {
+        var = PC_DEFAULT_PATH;
+    }
+    if (pcPathVar != NULL && strcmp(pcPathVar, var) == 0) {
+        return 0;
+    }
+
+    char *saved = strdup(var);
+    char *copy = strdup(var);
+    if (!saved || !copy) {
+        perror("strdup failed in pc_sync_path");
+        free(saved);
+        free(copy);
+        return 1;
+    }
+    int count = 1;
+    for (const char *p = var; *p; p++) {
+        if (*p == ':') {
+            count++;
+        }
+    }
+    pc_dir_t *dirs = calloc(count, sizeof(pc_dir_t));
+    if (!dirs) {
+        perror("calloc failed in pc_sync_path");
+        free(saved);
+        free(copy);
+        return 1;
+    }
+
+    // Split on ':' in place, an empty component means the current directory like POSIX says
+    char *start = copy;
+    for (int i = 0; i < count; i++) {
+        char *colon = strchr(start, ':');
+        if (colon) {
+            *colon = '\0';
+        }
+        dirs[i].path = (*start == '\0') ? "." : start;
+        pc_stamp_dir(&dirs[i]);
+        start = colon ? colon + 1 : start + strlen(start);
+    }
+
+    pc_drop_all();
+    free(pcDirs);
+    free(pcPathVar);
+    free(pcDirBuf);
+    pcDirs = dirs;
+    pcDirCount = count;
+    pcPathVar = saved;
+    pcDirBuf = copy;
+    return 0;
+}
+
+// Linear probing, returns the slot holding name or the empty slot where it would go
+static pc_entry_t *pc_slot(const char *name) {
+    unsigned int mask = pcCapacity - 1;
+    unsigned int i = pc_hash(name) & mask;
+    while (pcTable[i].name != NULL && strcmp(pcTable[i].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &pcTable[i];
+}
+
+static int pc_grow(void) {
+    unsigned int oldCap = pcCapacity;
+    pc_entry_t *old = pcTable;
+    unsigned int newCap = oldCap ? oldCap * 2 : PC_INITIAL_CAPACITY;
+    pc_entry_t *table = calloc(newCap, sizeof(pc_entry_t));
+    if (!table) {
+        perror("calloc failed in pc_grow");
+        return 1;
+    }
+    pcTable = table;
+    pcCapacity = newCap;
+    for (unsigned int i = 0; i < oldCap; i++) {
+        if (old[i].name != NULL) {
+            *pc_slot(old[i].name) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+// Store a lookup result, path may be NULL to remember that the name was not found
+static pc_entry_t *pc_insert(const char *name, const char *path, int dir) {
+    if ((pcCount + 1) * 4 > pcCapacity * 3 && pc_grow() != 0) {
+        return NULL;
+    }
+    pc_entry_t *e = pc_slot(name);
+    if (e->name == NULL) {
+        e->name = strdup(name);
+        if (!e->name) {
+            perror("strdup failed in pc_insert");
+            return NULL;
+        }
+        pcCount++;
+    } else {
+        free(e->path);
+    }
+    e->path = NULL;
+    if (path != NULL) {
+        e->path = strdup(path);
+        if (!e->path) {
+            perror("strdup failed in pc_insert");
+        }
+    }
+    e->hits = 0;
+    e->dir = dir;
+    return e;
+}
+
+/*
+ * Make sure the entry can still be trusted, a hit in directory k is only valid while directories 0..k
+ * look the same (something new could shadow it), a miss depends on all of them
+ * Returns 1 if anything changed, in that case the whole table was flushed
+ */
+static int pc_stale(const pc_entry_t *e) {
+    if (e->path != NULL && e->dir < 0) {
+        return 0;  // Pinned with hash -p, it stays until hash -r
+    }
+    int upto = (e->path == NULL) ? pcDirCount - 1 : e->dir;
+    int changed = 0;
+    for (int i = 0; i <= upto; i++) {
+        changed |= pc_stamp_dir(&pcDirs[i]);
+    }
+    if (changed) {
+        pc_drop_all();
+    }
+    return changed;
+}
+
+/* Resolve name to the executable that execv should run, written into path
+* Names with a / are used as is like before, everything else goes through the cache
+* Returns 0 if found, 1 if the command does not exist
+*/
+static int pc_find(const char *name, char *path, size_t pathlen) {
+    if (strchr(name, '/')) {
+        strncpy(path, name, pathlen - 1);
+        path[pathlen - 1] = '\0';
+        return 0;
+    }
+    if (pc_sync_path() != 0) {
+        return 1;
+    }
+    if (pcCapacity == 0 && pc_grow() != 0) {
+        return 1;
+    }
+
+    pc_entry_t *e = pc_slot(name);
+    if (e->name == NULL || pc_stale(e)) {
+        // Not cached (or just flushed) so walk PATH like the old code did
+        int dir = -1;
+        char candidate[4096];
+        for (int i = 0; i < pcDirCount; i++) {
+            int n = snprintf(candidate, sizeof(candidate), "%s/%s", pcDirs[i].path, name);
+            if (n < 0 || (size_t)n >= sizeof(candidate)) {
+                continue;
+            }
+            if (access(candidate, X_OK) == 0) {
+                dir = i;
+                break;
+            }
+        }
+        e = pc_insert(name, dir >= 0 ? candidate : NULL, dir);
+        if (e == NULL) {
+            return 1;
+        }
+    }
+
+    e->hits++;
+    if (e->path == NULL) {
+        return 1;
+    }
+    strncpy(path, e->path, pathlen - 1);
+    path[pathlen - 1] = '\0';
+    return 0;
+}
+
+int pc_lookup(const char *name, char *path, size_t pathlen) {
+    pthread_mutex_lock(&pcLock);
+    int result = pc_find(name, path, pathlen);
+    pthread_mutex_unlock(&pcLock);
+    return result;
+}
+
+void pc_clear(void) {
+    pthread_mutex_lock(&pcLock);
+    pc_drop_all();
+    pthread_mutex_unlock(&pcLock);
+}
+
+/* Pin name to path (hash -p), it will not be revalidated until the table is cleared
+*/
+static int pc_pin(const char *name, const char *path) {
+    if (pc_sync_path() != 0) {
+        return 1;
+    }
+    if (pcCapacity == 0 && pc_grow() != 0) {
+        return 1;
+    }
+    return pc_insert(name, path, -1) == NULL;
+}
+
+int pc_add(const char *name, const char *path) {
+    pthread_mutex_lock(&pcLock);
+    int result = pc_pin(name, path);
+    pthread_mutex_unlock(&pcLock);
+    return result;
+}
+
+/* Print the table, reusable prints it as hash -p commands that can be fed back in
+*/
+static void pc_dump(FILE *out, int reusable) {
+    if (pcCount == 0) {
+        fprintf(out, "hash: hash table empty\n");
+        return;
+    }
+    if (!reusable) {
+        fprintf(out, "hits\tcommand\n");
+    }
+    for (unsigned int i = 0; i < pcCapacity; i++) {
+        pc_entry_t *e = &pcTable[i];
+        if (e->name == NULL) {
+            continue;
+        }
+        if (reusable) {
+            if (e->path != NULL) {
+                fprintf(out, "hash -p %s %s\n", e->path, e->name);
+            } else {
+                fprintf(out, "# %s: not found\n", e->name);
+            }
+        } else if (e->path != NULL) {
+            fprintf(out, "%4u\t%s\n", e->hits, e->path);
+        } else {
+            fprintf(out, "%4u\t%s (not found)\n", e->hits, e->name);
+        }
+    }
+    fflush(out);
+}
+
+void pc_print(FILE *out, int reusable) {
+    pthread_mutex_lock(&pcLock);
+    pc_dump(out, reusable);
+    pthread_mutex_unlock(&pcLock);
+}
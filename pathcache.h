@@ -0,0 +1,18 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Shell wide cache of executable lookups, so we dont walk $PATH with access() for every command
+ * Names are resolved against $PATH (falls back to /usr/local/bin:/usr/bin:/bin when PATH is unset)
+ * Misses are cached too, and every entry is dropped when a PATH directory changes (dev, inode or mtime)
+ */
+
+int pc_lookup(const char *name, char *path, size_t pathlen);
+int pc_add(const char *name, const char *path);
+void pc_clear(void);
+void pc_print(FILE *out, int reusable);
+
+#endif
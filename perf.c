@@ -0,0 +1,312 @@
+#define _GNU_SOURCE // For syscall
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf.h"
+
+typedef struct {
+    const char *name;       // For the text report
+    const char *key;        // For the JSON one
+    uint32_t type;
+    uint64_t config;
+    int kernel;             // Counted in the kernel too, context switches only ever happen there
+} perf_event_t;
+
+static const perf_event_t perfEvents[PERF_COUNTERS] = {
+    {"cycles", "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0},
+    {"instructions", "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0},
+    {"cache-misses", "cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, 0},
+    {"context-switches", "context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, 1},
+};
+
+static int perfMode = -1;       // MYSH_PERF, -1 until it was looked at
+static pid_t perfPid;           // The shell that prints the totals, not a forked child of it
+static int perfMissing = 0;     // Counters the kernel will never give us, not asked for again
+static int perfNoted = 0;       // Counters we already said something about
+static perf_counts_t perfTotal;
+static int perfTotalStages = 0;
+
+static void perf_json_string(const char *s) {
+    fputc('"', stderr);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(stderr, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(stderr, "\\u%04x", c);
+        } else {
+            fputc(c, stderr);
+        }
+    }
+    fputc('"', stderr);
+}
+
+static void perf_json_counts(const perf_counts_t *c) {
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (c->have & (1 << i)) {
+            fprintf(stderr, ",\"%s\":%llu", perfEvents[i].key, c->value[i]);
+        } else {
+            fprintf(stderr, ",\"%s\":null", perfEvents[i].key);
+        }
+    }
+}
+
+static void perf_text_counts(const perf_counts_t *c) {
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (c->have & (1 << i)) {
+            fprintf(stderr, "%s%s %llu", i ? ", " : "", perfEvents[i].name, c->value[i]);
+        } else {
+            fprintf(stderr, "%s%s -", i ? ", " : "", perfEvents[i].name);
+        }
+    }
+    if ((c->have & (1 << PERF_CYCLES)) && (c->have & (1 << PERF_INSTRUCTIONS)) && c->value[PERF_CYCLES] > 0) {
+        fprintf(stderr, ", ipc %.2f", (double)c->value[PERF_INSTRUCTIONS] / c->value[PERF_CYCLES]);
+    }
+    fputc('\n', stderr);
+}
+
+static void perf_add(perf_counts_t *to, const perf_counts_t *c) {
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (c->have & (1 << i)) {
+            to->value[i] += c->value[i];
+        }
+    }
+    to->have |= c->have;
+}
+
+// The totals over every stage the shell counted, when it exits with MYSH_PERF set
+static void perf_exit(void) {
+    if (getpid() != perfPid || perfTotalStages == 0) {
+        return;
+    }
+    fflush(stdout);
+    if (perfMode == 2) {
+        fprintf(stderr, "{\"total\":true,\"programs\":%d", perfTotalStages);
+        perf_json_counts(&perfTotal);
+        fprintf(stderr, "}\n");
+    } else {
+        fprintf(stderr, "perf total over %d programs: ", perfTotalStages);
+        perf_text_counts(&perfTotal);
+    }
+}
+
+/* MYSH_PERF: 0 when it is not set (or 0), 2 for json, 1 for anything else
+* The first call that finds it set arranges for the totals to be printed when the shell exits
+*/
+int perf_env_mode(void) {
+    if (perfMode < 0) {
+        const char *env = getenv("MYSH_PERF");
+        if (env == NULL || *env == '\0' || strcmp(env, "0") == 0) {
+            perfMode = 0;
+        } else {
+            perfMode = (strcmp(env, "json") == 0) ? 2 : 1;
+            perfPid = getpid();
+            atexit(perf_exit);
+        }
+    }
+    return perfMode;
+}
+
+/* Get ready to count the line cmd, the stages come from arena
+* Returns 0 for success, 1 if the arena is out of memory
+*/
+int perf_init(perf_line_t *p, command_t *cmd, arena_t *arena, int json) {
+    p->json = json;
+    p->stageCount = 0;
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next) {
+        p->stageCount++;
+    }
+    p->stages = arena_alloc(arena, p->stageCount * sizeof(perf_stage_t));
+    if (p->stages == NULL) {
+        return 1;
+    }
+    int i = 0;
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next, i++) {
+        perf_stage_t *s = &p->stages[i];
+        memset(s, 0, sizeof(perf_stage_t));
+        s->name = stage->args->data[0];
+        s->cmd = stage;
+        s->pid = -1;
+        s->group = -1;
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            s->fds[c] = -1;
+        }
+    }
+    return 0;
+}
+
+// The stage of p that runs stage, NULL if there is none
+perf_stage_t *perf_stage(perf_line_t *p, command_t *stage) {
+    for (int i = 0; i < p->stageCount; i++) {
+        if (p->stages[i].cmd == stage) {
+            return &p->stages[i];
+        }
+    }
+    return NULL;
+}
+
+// Say once which counters we do not get and why, the ones that will never work are not asked for again
+static void perf_missing(int failed, int err) {
+    if (err == EACCES || err == EPERM || err == ENOENT || err == ENODEV || err == EOPNOTSUPP || err == ENOSYS) {
+        perfMissing |= failed;
+    }
+    // Context switches are in the rusage anyway
+    failed &= ~(perfNoted | (1 << PERF_CONTEXT_SWITCHES));
+    if (failed == 0) {
+        return;
+    }
+    perfNoted |= failed;
+    fprintf(stderr, "perf:");
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (failed & (1 << i)) {
+            fprintf(stderr, " %s", perfEvents[i].name);
+        }
+    }
+    fprintf(stderr, " not counted: %s", strerror(err));
+    if (err == EACCES || err == EPERM) {
+        FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        int level;
+        if (f != NULL && fscanf(f, "%d", &level) == 1) {
+            fprintf(stderr, " (perf_event_paranoid is %d)", level);
+        }
+        if (f != NULL) {
+            fclose(f);
+        }
+    }
+    fputc('\n', stderr);
+}
+
+/* Open the counters of a stage on pid, called by the launcher while the child waits right before execv
+* The group is disabled until the exec, so only the program is counted and not the fork's leftovers of the shell
+*/
+void perf_attach(pid_t pid, void *ctx) {
+    perf_stage_t *s = ctx;
+    s->pid = pid;
+    int failed = 0, err = 0;
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (perfMissing & (1 << i)) {
+            continue;
+        }
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perfEvents[i].type;
+        attr.config = perfEvents[i].config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = 1;
+        attr.exclude_kernel = !perfEvents[i].kernel;
+        attr.exclude_hv = 1;
+        attr.disabled = (s->group < 0);
+        attr.enable_on_exec = (s->group < 0);
+        int fd = syscall(SYS_perf_event_open, &attr, pid, -1, s->group < 0 ? -1 : s->fds[s->group], PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) {
+            err = failed ? err : errno; // The first one says it best, the others usually fail the same way
+            failed |= 1 << i;
+            continue;
+        }
+        s->fds[i] = fd;
+        if (s->group < 0) {
+            s->group = i;
+        }
+    }
+    if (failed) {
+        perf_missing(failed, err);
+    }
+}
+
+static void perf_close(perf_stage_t *s) {
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (s->fds[i] >= 0) {
+            close(s->fds[i]);
+            s->fds[i] = -1;
+        }
+    }
+}
+
+/* The stage with pid was reaped, read its counters (scaled up if the kernel had to share the PMU with other groups)
+* Without a context switch counter the ones from its rusage are taken
+*/
+void perf_reaped(perf_line_t *p, pid_t pid, const struct rusage *ru) {
+    for (int i = 0; i < p->stageCount; i++) {
+        perf_stage_t *s = &p->stages[i];
+        if (s->pid != pid || s->reaped) {
+            continue;
+        }
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            uint64_t v[3]; // Value, time enabled, time running
+            if (s->fds[c] < 0 || read(s->fds[c], v, sizeof(v)) != sizeof(v)) {
+                continue;
+            }
+            s->counts.value[c] = (v[2] > 0 && v[2] < v[1]) ? (unsigned long long)((double)v[0] * v[1] / v[2]) : v[0];
+            s->counts.have |= 1 << c;
+        }
+        if (!(s->counts.have & (1 << PERF_CONTEXT_SWITCHES))) {
+            s->counts.value[PERF_CONTEXT_SWITCHES] = ru->ru_nvcsw + ru->ru_nivcsw;
+            s->counts.have |= 1 << PERF_CONTEXT_SWITCHES;
+        }
+        perf_close(s);
+        s->reaped = 1;
+        return;
+    }
+}
+
+/* Print the report for the line that just ran, one line per stage and a total one for the whole line, and add it to the totals
+* Nothing if none of its stages was counted (skipped by and/or, only builtins)
+*/
+void perf_report(perf_line_t *p) {
+    perf_counts_t line;
+    memset(&line, 0, sizeof(line));
+    int counted = 0;
+    for (int i = 0; i < p->stageCount; i++) {
+        perf_stage_t *s = &p->stages[i];
+        perf_close(s); // A stage that never got reaped
+        if (s->reaped) {
+            perf_add(&line, &s->counts);
+            counted++;
+        }
+    }
+    if (counted == 0) {
+        return;
+    }
+    perf_add(&perfTotal, &line);
+    perfTotalStages += counted;
+    fflush(stdout);
+
+    if (p->json) {
+        fprintf(stderr, "{\"programs\":%d", counted);
+        perf_json_counts(&line);
+        fprintf(stderr, ",\"stages\":[");
+        for (int i = 0; i < p->stageCount; i++) {
+            perf_stage_t *s = &p->stages[i];
+            fprintf(stderr, "%s{\"cmd\":", i ? "," : "");
+            perf_json_string(s->name);
+            fprintf(stderr, ",\"pid\":%d,\"builtin\":%s,\"counted\":%s", (int)s->pid, s->builtin ? "true" : "false",
+                    s->reaped ? "true" : "false");
+            perf_json_counts(&s->counts);
+            fprintf(stderr, "}");
+        }
+        fprintf(stderr, "]}\n");
+        return;
+    }
+
+    if (p->stageCount == 1) {
+        perf_text_counts(&line);
+        return;
+    }
+    for (int i = 0; i < p->stageCount; i++) {
+        perf_stage_t *s = &p->stages[i];
+        fprintf(stderr, "  %-12s ", s->name);
+        if (s->reaped) {
+            perf_text_counts(&s->counts);
+        } else {
+            fprintf(stderr, "not counted (%s)\n", s->builtin ? "builtin" : "did not start");
+        }
+    }
+    fprintf(stderr, "%-14s ", "total");
+    perf_text_counts(&line);
+}
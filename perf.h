@@ -0,0 +1,52 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "arena.h"
+#include "command.h"
+
+/*
+ * Hardware counters for the perfstat prefix and for every line with MYSH_PERF set: cycles, instructions and cache misses
+ * (user space only) and context switches for every program a line runs, through perf_event_open
+ * Every stage that is counted is forked instead of spawned and waits right before execv until its counters are open:
+ * one group on its pid, enabled on exec and inherited by whatever it starts, so the counts are the program and its
+ * children and nothing of the shell. They are read when the stage is reaped
+ * A counter the kernel will not give us (no PMU in a VM, perf_event_paranoid too high) is left out with a note the first
+ * time, context switches then come from wait4's rusage, which has them too. Builtins are not counted
+ * The report goes to stderr like time, as text or as one line of JSON (perfstat -j, MYSH_PERF=json), and with
+ * MYSH_PERF set the shell prints the totals over everything it counted when it exits
+ */
+
+enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_CACHE_MISSES, PERF_CONTEXT_SWITCHES, PERF_COUNTERS };
+
+typedef struct {
+    unsigned long long value[PERF_COUNTERS];
+    int have;               // Bit i is set when counter i was counted
+} perf_counts_t;
+
+typedef struct {
+    const char *name;
+    command_t *cmd;
+    pid_t pid;              // -1 until it is started counted, builtins never are
+    int fds[PERF_COUNTERS]; // -1 for a counter that could not be opened, fds[group] leads the others
+    int group;
+    int builtin;            // Set by the shell, the report says why the stage was not counted
+    int reaped;
+    perf_counts_t counts;
+} perf_stage_t;
+
+typedef struct {
+    int json;
+    int stageCount;
+    perf_stage_t *stages;
+} perf_line_t;
+
+int perf_env_mode(void);
+int perf_init(perf_line_t *p, command_t *cmd, arena_t *arena, int json);
+perf_stage_t *perf_stage(perf_line_t *p, command_t *stage);
+void perf_attach(pid_t pid, void *stage);
+void perf_reaped(perf_line_t *p, pid_t pid, const struct rusage *ru);
+void perf_report(perf_line_t *p);
+
+#endif
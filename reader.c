@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "reader.h"
+#include "scan.h"
+
+static long long reader_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Pick the backend for fd, mmap for a regular file that is not empty, the read buffer for everything else
+* Returns 0 for success, 1 if the buffer could not be allocated
+*/
+int reader_open(reader_t *r, int fd) {
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->stats = getenv("MYSH_READER_STATS") != NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        // Start from where the fd is, like read() would have
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        if (offset < 0) {
+            offset = 0;
+        }
+        void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            r->mapped = 1;
+            r->data = map;
+            r->size = st.st_size;
+            r->pos = (offset < st.st_size) ? offset : st.st_size;
+            return 0;
+        }
+        // Some files (like /proc ones) can not be mapped, they get read like a pipe
+    }
+
+    const char *size = getenv("MYSH_READ_SIZE");
+    r->readSize = (size != NULL && atol(size) > 0) ? (size_t)atol(size) : READER_READ_SIZE;
+    r->capacity = r->readSize + 1;
+    r->data = malloc(r->capacity);
+    if (r->data == NULL) {
+        return 1;
+    }
+    return 0;
+}
+
+static char *reader_next_mapped(reader_t *r, size_t *len) {
+    if (r->pos >= r->size) {
+        return NULL;
+    }
+    char *line = r->data + r->pos;
+    size_t nl = scan_newline(line, r->size - r->pos);
+    if (nl < r->size - r->pos) {
+        *len = nl;
+        r->pos += *len + 1;
+        r->bytes += *len + 1;
+        return line; // The newline becomes the '\0'
+    }
+    // Last line without a newline, line[len] would be past the end of the file
+    *len = r->size - r->pos;
+    r->pos = r->size;
+    r->bytes += *len;
+    r->partial = 1;
+    free(r->tail);
+    r->tail = malloc(*len + 1);
+    if (r->tail == NULL) {
+        perror("malloc failed in reader_next");
+        return NULL;
+    }
+    memcpy(r->tail, line, *len);
+    r->tail[*len] = '\0';
+    return r->tail;
+}
+
+static char *reader_next_buffered(reader_t *r, size_t *len) {
+    size_t scanned = r->pos; // Nothing between pos and scanned has a newline, so a partial line is never searched twice
+    for (;;) {
+        size_t nl = scanned + scan_newline(r->data + scanned, r->size - scanned);
+        if (nl < r->size) {
+            char *line = r->data + r->pos;
+            *len = nl - r->pos;
+            r->pos += *len + 1;
+            r->bytes += *len + 1;
+            return line;
+        }
+        scanned = r->size;
+        if (r->eof) {
+            if (r->pos < r->size) {
+                // Last line without a newline, the buffer always keeps one byte free for its '\0'
+                char *line = r->data + r->pos;
+                *len = r->size - r->pos;
+                r->pos = r->size;
+                r->bytes += *len;
+                r->partial = 1;
+                return line;
+            }
+            return NULL;
+        }
+
+        // Slide the partial line to the front, then grow only if it still does not leave room for a whole read
+        if (r->pos > 0) {
+            memmove(r->data, r->data + r->pos, r->size - r->pos);
+            r->size -= r->pos;
+            scanned -= r->pos;
+            r->pos = 0;
+        }
+        if (r->capacity - r->size < r->readSize + 1) {
+            size_t newcap = r->capacity * 2;
+            while (newcap - r->size < r->readSize + 1) {
+                newcap *= 2;
+            }
+            char *grown = realloc(r->data, newcap);
+            if (grown == NULL) {
+                perror("realloc failed in reader_next");
+                return NULL;
+            }
+            r->data = grown;
+            r->capacity = newcap;
+        }
+
+        ssize_t n = read(r->fd, r->data + r->size, r->readSize);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            n = 0;
+        }
+        if (n == 0) {
+            r->eof = 1;
+        }
+        r->size += n;
+    }
+}
+
+/* The next line, without its newline, NULL once there are no more lines
+* The line is writable and line[len] can be written too, it stays valid until the next call
+*/
+char *reader_next(reader_t *r, size_t *len) {
+    long long start = r->stats ? reader_now_ns() : 0;
+    char *line = r->mapped ? reader_next_mapped(r, len) : reader_next_buffered(r, len);
+    if (line != NULL) {
+        r->lines++;
+    }
+    if (r->stats) {
+        r->busyNs += reader_now_ns() - start;
+    }
+    return line;
+}
+
+void reader_close(reader_t *r) {
+    if (r->stats) {
+        double secs = r->busyNs / 1e9;
+        fprintf(stderr, "reader: %s, %llu bytes, %llu lines in %.6f s (%.1f MB/s, %.0f lines/s)\n",
+                r->mapped ? "mmap" : "read", r->bytes, r->lines, secs,
+                secs > 0 ? r->bytes / secs / (1024 * 1024) : 0.0, secs > 0 ? r->lines / secs : 0.0);
+    }
+    if (r->mapped) {
+        munmap(r->data, r->size);
+    } else {
+        free(r->data);
+    }
+    free(r->tail);
+    r->data = r->tail = NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+
+/*
+ * Hands out the lines of the script (or of stdin) one at a time, in place, without copying them around
+ * Two ways to get the bytes:
+ *  - a regular file is mapped with mmap (MAP_PRIVATE so we can write into it) and split at the newlines where it is
+ *  - pipes and terminals are read into a buffer that only grows when one line does not fit, MYSH_READ_SIZE sets how much one read asks for
+ * A line always has one writable byte after it (the newline it had, or space in the buffer) so the tokenizer can put its '\0' there
+ * With MYSH_READER_STATS set, reader_close prints how many bytes and lines went through and how fast
+ */
+
+#define READER_READ_SIZE (64 * 1024) // Default bytes per read() for pipes and terminals
+
+typedef struct {
+    int fd;
+    int mapped;             // 1 for the mmap backend
+    char *data;             // The mapping, or the read buffer
+    size_t size;            // Bytes in the mapping, or bytes in the buffer
+    size_t capacity;        // Size of the read buffer
+    size_t pos;             // Start of the next line
+    size_t readSize;
+    int eof;                // read() said there is nothing more
+    int partial;            // The last line handed out had no newline, it was the end of the input
+    char *tail;             // mmap only, a last line without a newline gets copied here so it has room for the '\0'
+    unsigned long long bytes;
+    unsigned long long lines;
+    long long busyNs;       // Time spent inside reader_next, so the commands we run do not count
+    int stats;
+} reader_t;
+
+int reader_open(reader_t *r, int fd);
+char *reader_next(reader_t *r, size_t *len);
+void reader_close(reader_t *r);
+
+#endif
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+static inline int scan_is_space(unsigned char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+// Scalar versions, also used for the last few bytes the vector ones can not load a whole register for
+
+static size_t newline_scalar(const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '\n') {
+            return i;
+        }
+    }
+    return len;
+}
+
+// The stop bits are whitespace, '#' and '\0', bytes past len count as '\0'
+static uint64_t classify_scalar(const char *s, size_t len, uint64_t *stop) {
+    uint64_t space = 0, stops = 0;
+    size_t n = len < 64 ? len : 64;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = s[i];
+        if (scan_is_space(c)) {
+            space |= 1ULL << i;
+            stops |= 1ULL << i;
+        } else if (c == '#' || c == '\0') {
+            stops |= 1ULL << i;
+        }
+    }
+    if (n < 64) {
+        stops |= ~0ULL << n;
+    }
+    *stop = stops;
+    return space;
+}
+
+#ifdef __SSE2__
+// 0xff in every byte of x that is whitespace, \t..\r is one unsigned range so (x - 9) <= 4 covers it
+static inline __m128i space_sse2(__m128i x) {
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+    __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8('\r' - '\t')), t);
+    return _mm_or_si128(ctl, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+
+static size_t newline_sse2(const char *s, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + newline_scalar(s + i, len - i);
+}
+
+static uint64_t classify_sse2(const char *s, size_t len, uint64_t *stop) {
+    char pad[64];
+    if (len < 64) {
+        // Never load past the end of the line, the zeros in pad are stop bytes that are not whitespace
+        memset(pad, 0, sizeof(pad));
+        memcpy(pad, s, len);
+        s = pad;
+    }
+    uint64_t space = 0, stops = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + 16 * i));
+        __m128i sp = space_sse2(x);
+        __m128i st = _mm_or_si128(sp, _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('#')),
+                                                   _mm_cmpeq_epi8(x, _mm_setzero_si128())));
+        space |= (uint64_t)(_mm_movemask_epi8(sp) & 0xffff) << (16 * i);
+        stops |= (uint64_t)(_mm_movemask_epi8(st) & 0xffff) << (16 * i);
+    }
+    *stop = stops;
+    return space;
+}
+
+#endif
+
+#ifdef SCAN_X86
+// Built for AVX2 on their own, the rest of mysh stays plain x86 and these only run when the CPU says it has AVX2
+__attribute__((target("avx2"))) static inline __m256i space_avx2(__m256i x) {
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8('\r' - '\t')), t);
+    return _mm256_or_si256(ctl, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2"))) static size_t newline_avx2(const char *s, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + newline_scalar(s + i, len - i);
+}
+
+__attribute__((target("avx2"))) static uint64_t classify_avx2(const char *s, size_t len, uint64_t *stop) {
+    char pad[64];
+    if (len < 64) {
+        memset(pad, 0, sizeof(pad));
+        memcpy(pad, s, len);
+        s = pad;
+    }
+    uint64_t space = 0, stops = 0;
+    for (int i = 0; i < 2; i++) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(s + 32 * i));
+        __m256i sp = space_avx2(x);
+        __m256i st = _mm256_or_si256(sp, _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('#')),
+                                                         _mm256_cmpeq_epi8(x, _mm256_setzero_si256())));
+        space |= (uint64_t)(unsigned int)_mm256_movemask_epi8(sp) << (32 * i);
+        stops |= (uint64_t)(unsigned int)_mm256_movemask_epi8(st) << (32 * i);
+    }
+    *stop = stops;
+    return space;
+}
+
+#endif
+
+static const scan_impl_t scanKernels[] = {
+    {"scalar", newline_scalar, classify_scalar},
+#ifdef __SSE2__
+    {"sse2", newline_sse2, classify_sse2},
+#endif
+#ifdef SCAN_X86
+    {"avx2", newline_avx2, classify_avx2},
+#endif
+};
+#define SCAN_KERNEL_COUNT (sizeof(scanKernels) / sizeof(scanKernels[0]))
+
+static int scan_supported(const char *name) {
+#ifdef SCAN_X86
+    if (strcmp(name, "avx2") == 0) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return 1; // scalar always works and sse2 is only in the table when the compiler can count on it
+}
+
+/* Switch every scan function to the kernels called name, NULL picks the best one the CPU has
+* Returns 0 for success, 1 if there is no such kernel or the CPU can not run it (nothing changes then)
+*/
+int scan_select(const char *name) {
+    for (int i = SCAN_KERNEL_COUNT - 1; i >= 0; i--) {
+        if ((name == NULL || strcmp(name, scanKernels[i].name) == 0) && scan_supported(scanKernels[i].name)) {
+            scanImpl = scanKernels[i];
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Until the first call scanImpl points at these, they pick the kernels and then hand the call on to them
+static void scan_resolve(void) {
+    const char *forced = getenv("MYSH_SCAN");
+    if (forced == NULL || scan_select(forced) != 0) {
+        if (forced != NULL) {
+            fprintf(stderr, "MYSH_SCAN=%s is not available here, picking one\n", forced);
+        }
+        scan_select(NULL);
+    }
+}
+
+static size_t newline_resolve(const char *s, size_t len) {
+    scan_resolve();
+    return scanImpl.newline(s, len);
+}
+
+static uint64_t classify_resolve(const char *s, size_t len, uint64_t *stop) {
+    scan_resolve();
+    return scanImpl.classify(s, len, stop);
+}
+
+scan_impl_t scanImpl = {"unresolved", newline_resolve, classify_resolve};
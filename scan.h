@@ -0,0 +1,35 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The byte scanning loops the reader and the tokenizer spend their time in, 16 (SSE2) or 32 (AVX2) bytes at a time
+ * The kernels are picked the first time one is used, from what the CPU supports (MYSH_SCAN=scalar/sse2/avx2 forces one)
+ * Whitespace is what isspace() takes in the C locale: space, \t \n \v \f \r
+ * Nothing past s[len - 1] is ever read, so the last line of a mapped file is safe
+ */
+
+typedef struct {
+    const char *name;
+    size_t (*newline)(const char *s, size_t len);       // First '\n'
+    uint64_t (*classify)(const char *s, size_t len, uint64_t *stop); // Bit i set for whitespace in s[0..64), see scan_classify
+} scan_impl_t;
+
+extern scan_impl_t scanImpl;
+
+int scan_select(const char *name);
+
+static inline size_t scan_newline(const char *s, size_t len) {
+    return scanImpl.newline(s, len);
+}
+
+/* Look at the next 64 bytes at once, returns the whitespace bits and puts the bits for whitespace, '#' and '\0' in *stop
+* Bytes past len count as '\0', so they are stop bits but not whitespace, nothing past len is read
+*/
+static inline uint64_t scan_classify(const char *s, size_t len, uint64_t *stop) {
+    return scanImpl.classify(s, len, stop);
+}
+
+#endif
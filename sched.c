@@ -0,0 +1,558 @@
+#define _GNU_SOURCE // For memfd_create and strchrnul
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include "sched.h"
+#include "arena.h"
+#include "vec.h"
+#include "tokenizer.h"
+#include "command.h"
+#include "wildcard.h"
+#include "zerocopy.h"
+
+#define SCHED_SEGMENT 256 // Lines looked at in one go, the next ones are only parsed once all of these are done
+
+enum { SCHED_WAITING, SCHED_RUNNING, SCHED_DONE };
+
+// What a program does with its words and stdin, for the ones we know. Anything else reads and writes its words
+enum {
+    SCHED_READS = 1,        // Only reads the files it is given
+    SCHED_NO_STDIN = 2,     // Never reads stdin, the others do when they get no file
+    SCHED_CWD = 4,          // With no file it reads the directory
+    SCHED_SHELL = 8,        // Changes the shell, the line runs in mysh itself
+    SCHED_BARRIER = 16      // Runs other commands, what they touch can not be known
+};
+
+typedef struct {
+    const char *name;
+    int flags;
+} sched_prog_t;
+
+static const sched_prog_t schedTable[] = {
+    {"cat", SCHED_READS}, {"wc", SCHED_READS}, {"grep", SCHED_READS}, {"head", SCHED_READS}, {"tail", SCHED_READS},
+    {"cut", SCHED_READS}, {"md5sum", SCHED_READS}, {"sha1sum", SCHED_READS}, {"sha256sum", SCHED_READS},
+    {"ls", SCHED_READS | SCHED_NO_STDIN | SCHED_CWD}, {"du", SCHED_READS | SCHED_NO_STDIN | SCHED_CWD},
+    {"cmp", SCHED_READS | SCHED_NO_STDIN}, {"diff", SCHED_READS | SCHED_NO_STDIN}, {"stat", SCHED_READS | SCHED_NO_STDIN},
+    {"file", SCHED_READS | SCHED_NO_STDIN}, {"echo", SCHED_READS | SCHED_NO_STDIN}, {"printf", SCHED_READS | SCHED_NO_STDIN},
+    {"test", SCHED_READS | SCHED_NO_STDIN}, {"[", SCHED_READS | SCHED_NO_STDIN}, {"pwd", SCHED_READS | SCHED_NO_STDIN},
+    {"which", SCHED_READS | SCHED_NO_STDIN}, {"true", SCHED_READS | SCHED_NO_STDIN}, {"false", SCHED_READS | SCHED_NO_STDIN},
+    {"sleep", SCHED_READS | SCHED_NO_STDIN}, {"date", SCHED_READS | SCHED_NO_STDIN},
+    {"basename", SCHED_READS | SCHED_NO_STDIN}, {"dirname", SCHED_READS | SCHED_NO_STDIN},
+    {"cp", SCHED_NO_STDIN}, {"mv", SCHED_NO_STDIN}, {"rm", SCHED_NO_STDIN}, {"mkdir", SCHED_NO_STDIN},
+    {"rmdir", SCHED_NO_STDIN}, {"touch", SCHED_NO_STDIN}, {"ln", SCHED_NO_STDIN}, {"chmod", SCHED_NO_STDIN},
+    {"cd", SCHED_SHELL}, {"exit", SCHED_SHELL}, {"die", SCHED_SHELL}, {"hash", SCHED_SHELL}, {"rehash", SCHED_SHELL},
+    {"jobs", SCHED_SHELL}, {"wait", SCHED_SHELL}, {"fg", SCHED_SHELL},
+    {"sh", SCHED_BARRIER}, {"bash", SCHED_BARRIER}, {"dash", SCHED_BARRIER}, {"mysh", SCHED_BARRIER},
+    {"make", SCHED_BARRIER}, {"env", SCHED_BARRIER}, {"xargs", SCHED_BARRIER}, {"find", SCHED_BARRIER},
+    {"nice", SCHED_BARRIER}, {"nohup", SCHED_BARRIER}, {"timeout", SCHED_BARRIER}, {"sudo", SCHED_BARRIER},
+    {"python", SCHED_BARRIER}, {"python3", SCHED_BARRIER}, {"perl", SCHED_BARRIER},
+    {NULL, 0}
+};
+
+typedef struct {
+    size_t start;       // The line and its here-doc bodies in the script text
+    size_t len;
+    int barrier;        // Waits for every line before it, every line after it waits for it
+    int inShell;        // Runs in mysh itself, once every line before it is done
+    int usesStdin;      // Reads the shell's stdin
+    int condition;      // and/or, needs the status of the line right before it
+    int ran;            // A line before it ran a command (firstTimeRunning)
+    strvec_t *reads;    // Absolute paths, see sched_path
+    strvec_t *writes;
+    int state;
+    int status;
+    pid_t pid;
+    int pidfd;          // -1 if the kernel has no pidfd_open, the line is polled with waitpid then
+    int outFd;          // memfds with what it wrote, until it is its turn to be printed
+    int errFd;
+} sched_line_t;
+
+typedef struct {
+    const char *text;
+    size_t len;
+    size_t pos;         // Start of the first line not parsed yet
+    sched_line_t lines[SCHED_SEGMENT];
+    int count;
+    int printed;        // Lines of the segment whose output is out
+    int running;
+    int jobs;
+    int lastStatus;     // Status of the last line of the segments before
+    int anyRan;
+    arena_t paths;      // Everything the segment's lines need, reset for the next segment
+    arena_t parse;      // The command of the line being looked at
+    toklist_t tokens;
+    char *line;
+    sched_run_t run;
+    void *ctx;
+} sched_state_t;
+
+// The lines after the one being parsed, for the here-doc bodies
+typedef struct {
+    const char *text;
+    size_t len;
+    size_t *start;
+} sched_text_t;
+
+static char *sched_next_line(void *ctx, size_t *len) {
+    sched_text_t *lines = ctx;
+    size_t start = *lines->start;
+    if (start >= lines->len) {
+        return NULL;
+    }
+    const char *nl = memchr(lines->text + start, '\n', lines->len - start);
+    *len = (nl ? (size_t)(nl - lines->text) : lines->len) - start;
+    *lines->start = start + *len + 1;
+    return (char *)lines->text + start;
+}
+
+static const sched_prog_t *sched_find(const char *program) {
+    const char *base = strrchr(program, '/');
+    base = base ? base + 1 : program;
+    for (const sched_prog_t *p = schedTable; p->name != NULL; p++) {
+        if (strcmp(base, p->name) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* word as an absolute path with no . or .. left in it, a wildcard cuts it off at the directory it is matched in
+ * Only the words are looked at, not the files, so a symlink is just another name
+ */
+static char *sched_path(arena_t *arena, const char *cwd, const char *word) {
+    size_t len = (word[0] == '/') ? 0 : strlen(cwd);
+    char *path = arena_alloc(arena, len + strlen(word) + 3);
+    if (path == NULL) {
+        return NULL;
+    }
+    memcpy(path, cwd, len);
+    if (len == 1) {
+        len = 0; // cwd is /
+    }
+    for (const char *p = word; *p != '\0'; ) {
+        const char *end = strchrnul(p, '/');
+        size_t n = end - p;
+        if (n == 2 && p[0] == '.' && p[1] == '.') {
+            while (len > 0 && path[len - 1] != '/') {
+                len--;
+            }
+            if (len > 0) {
+                len--;
+            }
+        } else if (n > 0 && !(n == 1 && p[0] == '.')) {
+            path[len] = '/';
+            memcpy(path + len + 1, p, n);
+            path[len + 1 + n] = '\0';
+            if (wild_has_magic(path + len + 1)) {
+                break;
+            }
+            len += n + 1;
+        }
+        p = (*end == '/') ? end + 1 : end;
+    }
+    if (len == 0) {
+        path[len++] = '/';
+    }
+    path[len] = '\0';
+    return path;
+}
+
+static void sched_add(sched_state_t *st, sched_line_t *l, strvec_t *to, const char *cwd, const char *word) {
+    char *path = sched_path(&st->paths, cwd, word);
+    if (path == NULL || strvec_push(to, path) != 0) {
+        l->barrier = 1;
+    }
+}
+
+/* Skip the time, perfstat and cached prefixes of the first stage, the -i files of cached are read
+ * Returns the index of the program in args
+ */
+static int sched_prefixes(sched_state_t *st, sched_line_t *l, char **args, const char *cwd) {
+    int i = 0;
+    if (args[i] != NULL && strcmp(args[i], "time") == 0) {
+        i++;
+        if (args[i] != NULL && strcmp(args[i], "-j") == 0) {
+            i++;
+        }
+    }
+    if (args[i] != NULL && strcmp(args[i], "perfstat") == 0) {
+        i++;
+        if (args[i] != NULL && strcmp(args[i], "-j") == 0) {
+            i++;
+        }
+    }
+    if (args[i] != NULL && strcmp(args[i], "cached") == 0) {
+        i++;
+        while (args[i] != NULL && args[i][0] == '-') {
+            if (strcmp(args[i], "-i") == 0 && args[i + 1] != NULL) {
+                sched_add(st, l, l->reads, cwd, args[++i]);
+            }
+            i++;
+        }
+    }
+    return i;
+}
+
+// Work out what line reads and writes, cmd is NULL when it did not parse
+static void sched_analyze(sched_state_t *st, sched_line_t *l, command_t *cmd, const char *cwd) {
+    l->reads = arena_alloc(&st->paths, sizeof(strvec_t));
+    l->writes = arena_alloc(&st->paths, sizeof(strvec_t));
+    if (cmd == NULL || l->reads == NULL || l->writes == NULL) {
+        l->barrier = 1;
+        return;
+    }
+    strvec_init(l->reads, &st->paths);
+    strvec_init(l->writes, &st->paths);
+    l->condition = (cmd->condition != NONE);
+    l->inShell = cmd->background;
+
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next) {
+        char **args = stage->args->data;
+        int i = (stage == cmd) ? sched_prefixes(st, l, args, cwd) : 0;
+        int flags = 0, words = 0;
+        if (args[i] != NULL) {
+            const sched_prog_t *prog = sched_find(args[i]);
+            flags = prog ? prog->flags : (strchr(args[i], '/') ? SCHED_BARRIER : 0);
+            for (int a = i + 1; args[a] != NULL; a++) {
+                if (args[a][0] == '-') {
+                    continue; // An option, or - for stdin
+                }
+                words++;
+                sched_add(st, l, (flags & SCHED_READS) ? l->reads : l->writes, cwd, args[a]);
+            }
+        }
+        l->inShell |= (flags & SCHED_SHELL) != 0;
+        l->barrier |= (flags & SCHED_BARRIER) != 0;
+        if (words == 0 && (flags & SCHED_CWD)) {
+            sched_add(st, l, l->reads, cwd, ".");
+        }
+        if (stage->inputFile != NULL) {
+            sched_add(st, l, l->reads, cwd, stage->inputFile);
+        }
+        if (stage->outputFile != NULL) {
+            sched_add(st, l, l->writes, cwd, stage->outputFile);
+        }
+        // Only the first stage can get the shell's stdin, the others read their pipe
+        if (stage == cmd && stage->inputFile == NULL && stage->hereDelim == NULL && stage->hereData == NULL &&
+            words == 0 && !(flags & SCHED_NO_STDIN)) {
+            l->usesStdin = 1;
+        }
+    }
+}
+
+// a and b are the same path or one of them is under the other
+static int sched_overlap(const char *a, const char *b) {
+    size_t la = strlen(a), lb = strlen(b);
+    const char *shorter = (la <= lb) ? a : b, *longer = (la <= lb) ? b : a;
+    size_t n = (la <= lb) ? la : lb;
+    return strncmp(shorter, longer, n) == 0 && (longer[n] == '\0' || longer[n] == '/' || n == 1);
+}
+
+static int sched_touches(const strvec_t *paths, const char *path) {
+    for (unsigned int i = 0; i < paths->length; i++) {
+        if (sched_overlap(paths->data[i], path)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether a and b have to run one after the other
+static int sched_conflict(const sched_line_t *a, const sched_line_t *b) {
+    if (a->barrier || b->barrier || a->inShell || b->inShell || (a->usesStdin && b->usesStdin)) {
+        return 1;
+    }
+    for (unsigned int i = 0; i < a->writes->length; i++) {
+        if (sched_touches(b->reads, a->writes->data[i]) || sched_touches(b->writes, a->writes->data[i])) {
+            return 1;
+        }
+    }
+    for (unsigned int i = 0; i < b->writes->length; i++) {
+        if (sched_touches(a->reads, b->writes->data[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Parse the next lines of the script into st->lines, up to SCHED_SEGMENT of them or up to and with a line that runs in the shell
+ * The parser's errors are not printed here, the line prints them when it runs, in its place in the output
+ * Returns 0 for success, 1 on an error (already printed)
+ */
+static int sched_parse(sched_state_t *st) {
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("mysh -P: getcwd");
+        return 1;
+    }
+    arena_reset(&st->paths);
+    st->count = 0;
+    st->printed = 0;
+
+    fflush(stderr);
+    int savedStderr = dup(STDERR_FILENO);
+    int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (savedStderr >= 0 && devNull >= 0) {
+        dup2(devNull, STDERR_FILENO);
+    }
+    int err = 0;
+    sched_text_t rest = {st->text, st->len, &st->pos};
+    while (st->pos < st->len && st->count < SCHED_SEGMENT) {
+        size_t start = st->pos;
+        const char *nl = memchr(st->text + start, '\n', st->len - start);
+        size_t linelen = (nl ? (size_t)(nl - st->text) : st->len) - start;
+        memcpy(st->line, st->text + start, linelen);
+        st->pos += linelen + 1; // Any here-doc bodies are read from here on
+        if (tok_split(&st->tokens, st->line, linelen) != 0) {
+            err = 1;
+            break;
+        }
+        if (st->tokens.length == 0) {
+            continue;
+        }
+        // Same as processCommand, an and/or line before anything ran is an error and does not get parsed
+        int conditionFirst = (!st->anyRan &&
+            (st->tokens.data[0].kind == TOK_AND || st->tokens.data[0].kind == TOK_OR));
+        command_t *cmd = conditionFirst ? NULL : parseCommand(&st->tokens, st->line, &st->parse);
+        int hereFailed = (readHereDocs(cmd, &st->tokens, st->line, sched_next_line, &rest, &st->parse) != 0);
+        if (st->pos > st->len) {
+            st->pos = st->len;
+        }
+
+        sched_line_t *l = &st->lines[st->count++];
+        memset(l, 0, sizeof(*l));
+        l->start = start;
+        l->len = st->pos - start;
+        l->ran = st->anyRan;
+        l->pidfd = l->outFd = l->errFd = -1;
+        sched_analyze(st, l, hereFailed ? NULL : cmd, cwd);
+        st->anyRan |= (cmd != NULL && !hereFailed);
+        arena_reset(&st->parse);
+        if (l->inShell) {
+            break; // The lines after it are looked at once it ran, from the directory it left us in
+        }
+    }
+    if (savedStderr >= 0) {
+        dup2(savedStderr, STDERR_FILENO);
+        close(savedStderr);
+    }
+    if (devNull >= 0) {
+        close(devNull);
+    }
+    if (err) {
+        perror("Problem with token list allocation");
+    }
+    return err;
+}
+
+static int sched_ready(sched_state_t *st, int i) {
+    sched_line_t *l = &st->lines[i];
+    if (l->condition && i > 0 && st->lines[i - 1].state != SCHED_DONE) {
+        return 0;
+    }
+    for (int j = st->printed; j < i; j++) {
+        if (st->lines[j].state != SCHED_DONE && sched_conflict(&st->lines[j], l)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Copy out what the lines that are done wrote, in script order, up to the first one that is not done yet
+static void sched_flush(sched_state_t *st) {
+    while (st->printed < st->count && st->lines[st->printed].state == SCHED_DONE) {
+        sched_line_t *l = &st->lines[st->printed++];
+        if (l->outFd < 0) {
+            continue; // It ran in the shell and wrote straight out
+        }
+        fflush(stdout);
+        fflush(stderr);
+        if (lseek(l->outFd, 0, SEEK_SET) == 0 && zc_copy(l->outFd, STDOUT_FILENO) != 0) {
+            perror("mysh -P: output");
+        }
+        if (lseek(l->errFd, 0, SEEK_SET) == 0 && zc_copy(l->errFd, STDERR_FILENO) != 0) {
+            perror("mysh -P: output");
+        }
+        close(l->outFd);
+        close(l->errFd);
+        l->outFd = l->errFd = -1;
+    }
+}
+
+/* Start line i, in a forked shell with its output going into memfds, or in the shell itself if it has to
+ * A line that can not get its memfds or its fork is turned into one that runs in the shell, once everything before it is done
+ */
+static void sched_start(sched_state_t *st, int i) {
+    sched_line_t *l = &st->lines[i];
+    int prevStatus = (i > 0 && st->lines[i - 1].state == SCHED_DONE) ? st->lines[i - 1].status : st->lastStatus;
+    if (l->inShell) {
+        sched_flush(st); // Everything before it is done, so all of that gets out first
+        l->status = st->run(st->text + l->start, l->len, prevStatus, l->ran, st->ctx);
+        l->state = SCHED_DONE;
+        return;
+    }
+
+    l->outFd = memfd_create("mysh-P-out", MFD_CLOEXEC);
+    l->errFd = memfd_create("mysh-P-err", MFD_CLOEXEC);
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = (l->outFd >= 0 && l->errFd >= 0) ? fork() : -1;
+    if (pid < 0) {
+        perror("mysh -P");
+        if (l->outFd >= 0) {
+            close(l->outFd);
+        }
+        if (l->errFd >= 0) {
+            close(l->errFd);
+        }
+        l->outFd = l->errFd = -1;
+        l->inShell = 1;
+        return;
+    }
+    if (pid == 0) {
+        dup2(l->outFd, STDOUT_FILENO);
+        dup2(l->errFd, STDERR_FILENO);
+        int status = st->run(st->text + l->start, l->len, prevStatus, l->ran, st->ctx);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(status & 0xff); // Nothing of the shell's own (the trace buffer) is written out twice
+    }
+    l->pid = pid;
+    l->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    l->state = SCHED_RUNNING;
+    st->running++;
+}
+
+static void sched_finish(sched_state_t *st, sched_line_t *l) {
+    int status;
+    if (waitpid(l->pid, &status, WNOHANG) != l->pid) {
+        return;
+    }
+    l->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    if (l->pidfd >= 0) {
+        close(l->pidfd);
+        l->pidfd = -1;
+    }
+    l->state = SCHED_DONE;
+    st->running--;
+}
+
+// Run the lines sched_parse found, the ones that are ready start as long as there are free jobs, then we wait for one to finish
+static void sched_segment(sched_state_t *st) {
+    struct pollfd pfds[SCHED_SEGMENT];
+    sched_line_t *polled[SCHED_SEGMENT];
+    while (st->printed < st->count) {
+        for (int i = st->printed; i < st->count && st->running < st->jobs; i++) {
+            if (st->lines[i].state == SCHED_WAITING && sched_ready(st, i)) {
+                sched_start(st, i);
+            }
+        }
+        sched_flush(st);
+        if (st->running == 0) {
+            continue;
+        }
+
+        int count = 0, unpolled = 0;
+        for (int i = st->printed; i < st->count; i++) {
+            if (st->lines[i].state != SCHED_RUNNING) {
+                continue;
+            }
+            if (st->lines[i].pidfd < 0) {
+                unpolled = 1;
+                continue;
+            }
+            pfds[count].fd = st->lines[i].pidfd;
+            pfds[count].events = POLLIN;
+            polled[count++] = &st->lines[i];
+        }
+        int n = poll(pfds, count, unpolled ? 10 : -1);
+        if (n < 0 && errno != EINTR) {
+            perror("mysh -P: poll");
+            n = 0;
+            unpolled = 1; // Fall back to looking at every line with waitpid
+        }
+        for (int p = 0; p < count && n > 0; p++) {
+            if (pfds[p].revents) {
+                sched_finish(st, polled[p]);
+            }
+        }
+        for (int i = st->printed; unpolled && i < st->count; i++) {
+            if (st->lines[i].state == SCHED_RUNNING) {
+                sched_finish(st, &st->lines[i]);
+            }
+        }
+    }
+    if (st->count > 0) {
+        st->lastStatus = st->lines[st->count - 1].status;
+    }
+}
+
+/* mysh -P, see sched.h
+ * jobs below 1 means one per CPU. Returns 0, or 1 if the script could not be read
+ */
+int sched_main(const char *script, int jobs, sched_run_t run, void *ctx) {
+    int fd = open(script, O_RDONLY);
+    if (fd < 0) {
+        perror(script);
+        return 1;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        perror(script);
+        close(fd);
+        return 1;
+    }
+    if (sb.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    char *text = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        perror(script);
+        return 1;
+    }
+
+    sched_state_t *st = calloc(1, sizeof(sched_state_t));
+    char *line = malloc(sb.st_size + 1); // Big enough for any line, the tokenizer writes into it
+    int err = (st == NULL || line == NULL);
+    if (err) {
+        perror("mysh -P");
+    } else {
+        st->text = text;
+        st->len = sb.st_size;
+        st->line = line;
+        st->run = run;
+        st->ctx = ctx;
+        st->jobs = (jobs > 0) ? jobs : sysconf(_SC_NPROCESSORS_ONLN);
+        if (st->jobs < 1) {
+            st->jobs = 1;
+        }
+        err = (tok_init(&st->tokens, TOK_INLINE) != 0 || arena_init(&st->paths, 16 * 1024) != 0 ||
+               arena_init(&st->parse, 16 * 1024) != 0);
+        if (err) {
+            perror("mysh -P");
+        }
+    }
+    while (!err && st->pos < st->len) {
+        err = sched_parse(st);
+        sched_segment(st); // What did parse before an error still runs
+    }
+    if (st != NULL) {
+        tok_destroy(&st->tokens);
+        arena_destroy(&st->paths);
+        arena_destroy(&st->parse);
+    }
+    free(st);
+    free(line);
+    munmap(text, sb.st_size);
+    return err;
+}
@@ -0,0 +1,31 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stddef.h>
+
+/*
+ * mysh -P [-j N] script runs the lines of a script that do not depend on each other at the same time, up to N at once
+ * (one per CPU by default). Every line is parsed up front and gets the paths it reads and writes, all of them absolute:
+ *  - < files are read, > files are written
+ *  - the words of a command are paths too, read for the programs in schedTable that only read their arguments (cat, wc,
+ *    grep, ls...), read and written for any other program. A word with a wildcard is its directory (test/x*.log is test)
+ *  - a path covers everything under it, so writing out/a.txt is in the way of ls out
+ * Two lines depend on each other when one writes what the other reads or writes, or both read the shell's stdin,
+ * and an and/or line depends on the line right before it for its status. A line only starts when every line before it
+ * that it depends on is done
+ * What can not be worked out is a barrier that waits for everything before it and that everything after it waits for:
+ * a line that does not parse, a program that runs other commands (sh, make, xargs, find...) or a path to a program
+ * Lines that change the shell itself (cd, exit, die, hash, rehash, jobs, wait, fg, or a line that ends with &) run in
+ * the shell once every line before them is done, and the lines after them are only looked at then, with the directory
+ * the shell really ended up in
+ * Every other line runs in a forked shell with its stdout and stderr in memfds, copied out once it and every line
+ * before it are done, so the output comes in script order
+ */
+
+// Runs text (one line and its here-doc bodies) in this process, with prevStatus as the status of the line before it
+// ran is 0 if no command ran before it. Returns the status of the line
+typedef int (*sched_run_t)(const char *text, size_t len, int prevStatus, int ran, void *ctx);
+
+int sched_main(const char *script, int jobs, sched_run_t run, void *ctx);
+
+#endif
@@ -0,0 +1,319 @@
+#define _GNU_SOURCE // For accept4, memfd_create and on_exit
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "serve.h"
+#include "jobs.h"
+
+#define SERVE_MAX_WORKERS 256
+#define SERVE_RETRY_MS 100      // How often slots a fork failed for are tried again
+
+static volatile sig_atomic_t serveStopping = 0;
+static int serveConn = -1;  // The worker's connection, the status goes back on it at exit
+static pid_t servePid;      // The worker itself, children it forks for builtins must not answer the client
+
+static void serve_stop(int sig) {
+    (void)sig;
+    serveStopping = 1;
+}
+
+static int serve_read_all(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// on_exit handler of a worker, so exit and die inside the script answer the client too
+static void serve_finish(int status, void *arg) {
+    (void)arg;
+    if (getpid() != servePid || serveConn < 0) {
+        return;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    int32_t code = status;
+    ssize_t n;
+    do {
+        n = write(serveConn, &code, sizeof(code));
+    } while (n < 0 && errno == EINTR);
+    close(serveConn);
+    serveConn = -1;
+}
+
+/* The header and the client's 3 fds, they come in the same message
+* Returns 0 with fds filled in, 1 if the request is not one of ours
+*/
+static int serve_recv_header(int conn, serve_request_t *req, int fds[3]) {
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = {req, sizeof(*req)};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+        n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return 1;
+    }
+
+    fds[0] = fds[1] = fds[2] = -1;
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    if (c != NULL && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS
+        && c->cmsg_len == CMSG_LEN(3 * sizeof(int))) {
+        memcpy(fds, CMSG_DATA(c), 3 * sizeof(int));
+    }
+    // The header itself might have come in pieces, only the first one carries fds
+    if ((size_t)n < sizeof(*req) && serve_read_all(conn, (char *)req + n, sizeof(*req) - n) != 0) {
+        n = 0;
+    }
+    if (n == 0 || fds[0] < 0 || req->magic != SERVE_MAGIC || (req->kind != SERVE_TEXT && req->kind != SERVE_PATH)
+        || req->cwdLen == 0 || req->cwdLen > 4096 || req->bodyLen > SERVE_MAX_BODY) {
+        for (int i = 0; i < 3; i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// The script text as an fd the reader can mmap like any script file
+static int serve_text_fd(const char *text, size_t len) {
+    int fd = memfd_create("mysh-serve", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, text + done, len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/* One worker, waits for one client, runs its script and exits with the script's status
+* Never returns
+*/
+static void serve_worker(int sock, serve_run_t run, void *ctx, const sigset_t *mask) {
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    sigprocmask(SIG_SETMASK, mask, NULL); // A SIGTERM that came in the meantime kills us right here
+
+    int conn;
+    do {
+        conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+    } while (conn < 0 && errno == EINTR);
+    if (conn < 0) {
+        perror("accept");
+        _exit(EXIT_FAILURE);
+    }
+    close(sock);
+
+    serve_request_t req;
+    int fds[3];
+    if (serve_recv_header(conn, &req, fds) != 0) {
+        _exit(EXIT_FAILURE); // Nothing to answer to, the server just forks the next one
+    }
+    char *cwd = malloc(req.cwdLen + 1);
+    char *body = malloc(req.bodyLen + 1);
+    if (cwd == NULL || body == NULL || serve_read_all(conn, cwd, req.cwdLen) != 0
+        || serve_read_all(conn, body, req.bodyLen) != 0) {
+        _exit(EXIT_FAILURE);
+    }
+    cwd[req.cwdLen] = '\0';
+    body[req.bodyLen] = '\0';
+
+    // From here on the script's output is the client's
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] != i) {
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+    }
+    servePid = getpid();
+    serveConn = conn;
+    on_exit(serve_finish, NULL);
+
+    if (chdir(cwd) != 0) {
+        perror(cwd);
+        exit(EXIT_FAILURE);
+    }
+    jobs_init(0, 0);
+
+    if (req.kind == SERVE_PATH) {
+        exit(run(body, -1, ctx));
+    }
+    int fd = serve_text_fd(body, req.bodyLen);
+    if (fd < 0) {
+        perror("memfd_create");
+        exit(EXIT_FAILURE);
+    }
+    free(body);
+    exit(run(NULL, fd, ctx));
+}
+
+// The stop signals are blocked until the worker has its own handlers back, otherwise a kill that comes
+// right after the fork would only run serve_stop in the worker and it would go on waiting for a client
+static pid_t serve_fork(int sock, serve_run_t run, void *ctx) {
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGHUP);
+    sigprocmask(SIG_BLOCK, &block, &old);
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        serve_worker(sock, run, ctx, &old);
+    }
+    int err = errno;
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    errno = err;
+    return pid;
+}
+
+/* Start a worker in every empty slot (-1), a fork that fails (EAGAIN at the process limit) leaves its slot empty
+* for the next call, that is said once until the pool is full again
+* Returns how many slots are still empty
+*/
+static int serve_fill(pid_t *pids, int workers, int sock, serve_run_t run, void *ctx) {
+    static int complained = 0;
+    int empty = 0;
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) {
+            continue;
+        }
+        pids[i] = serve_fork(sock, run, ctx);
+        if (pids[i] < 0) {
+            if (!complained) {
+                perror("fork (mysh --serve keeps trying)");
+                complained = 1;
+            }
+            empty++;
+        }
+    }
+    if (empty == 0) {
+        complained = 0;
+    }
+    return empty;
+}
+
+/*
+ * The server, everything the shell sets up at startup has to be done before this so the workers inherit it
+ * workers <= 0 means one per CPU (at least 2). Runs until SIGTERM, SIGINT or SIGHUP, then the workers are killed and the socket removed
+ * Returns 0, or 1 if the socket could not be set up
+ */
+int serve_main(const char *sockPath, int workers, serve_run_t run, void *ctx) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(sockPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "mysh: socket path too long: %s\n", sockPath);
+        return 1;
+    }
+    strcpy(addr.sun_path, sockPath);
+    if (workers <= 0) {
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+        if (workers < 2) {
+            workers = 2; // So one is still waiting while the other gets replaced
+        }
+    }
+    if (workers < 1) {
+        workers = 1;
+    } else if (workers > SERVE_MAX_WORKERS) {
+        workers = SERVE_MAX_WORKERS;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(sockPath); // Left over from a server that did not get to clean up
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, 128) != 0) {
+        perror(sockPath);
+        close(sock);
+        return 1;
+    }
+
+    // No SA_RESTART, waitpid has to come back so we notice
+    struct sigaction sa = {0};
+    sa.sa_handler = serve_stop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    pid_t pids[SERVE_MAX_WORKERS];
+    for (int i = 0; i < workers; i++) {
+        pids[i] = -1;
+    }
+    int empty = serve_fill(pids, workers, sock, run, ctx);
+    fprintf(stderr, "mysh: serving %s with %d workers\n", sockPath, workers);
+
+    while (!serveStopping) {
+        // With empty slots we only look for a finished worker and try the forks again every SERVE_RETRY_MS
+        int status;
+        pid_t pid = waitpid(-1, &status, empty ? WNOHANG : 0);
+        if (pid < 0 && errno == EINTR) {
+            continue;
+        }
+        if (pid < 0 && !(errno == ECHILD && empty)) {
+            break;
+        }
+        if (pid <= 0) {
+            usleep(SERVE_RETRY_MS * 1000); // A stop signal cuts it short
+            empty = serve_fill(pids, workers, sock, run, ctx);
+            continue;
+        }
+        // A worker is done with its client (or died), a fresh one takes its place
+        for (int i = 0; i < workers; i++) {
+            if (pids[i] == pid) {
+                pids[i] = -1;
+                break;
+            }
+        }
+        empty = serve_fill(pids, workers, sock, run, ctx);
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+        // Reap all of them
+    }
+    close(sock);
+    unlink(sockPath);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdint.h>
+
+/*
+ * mysh --serve sock [workers] keeps a pool of shells that already did their startup, waiting on a Unix socket
+ * mysh-client (myshclient.c) connects, sends its working directory and a script (a path or the text itself),
+ * and hands over its own stdin/stdout/stderr with SCM_RIGHTS, so the script reads and writes the client's fds directly
+ * and nothing has to be copied back. When the script is done the worker sends one int32, the exit status, and exits,
+ * the server forks a fresh worker in its place so every request starts from the same clean state
+ *
+ * A request is a serve_request_t, then cwdLen bytes of directory, then bodyLen bytes of path or script text,
+ * the 3 fds ride along on the first byte of it
+ */
+
+#define SERVE_MAGIC 0x6873796d // "mysh"
+#define SERVE_MAX_BODY (64 * 1024 * 1024)
+
+enum { SERVE_TEXT = 1, SERVE_PATH = 2 };
+
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;      // SERVE_TEXT or SERVE_PATH
+    uint32_t cwdLen;
+    uint32_t bodyLen;
+} serve_request_t;
+
+// Runs one script in a worker, path is a script file or NULL and then fd has the text, returns the exit status
+typedef int (*serve_run_t)(const char *path, int fd, void *ctx);
+
+int serve_main(const char *sockPath, int workers, serve_run_t run, void *ctx);
+
+#endif
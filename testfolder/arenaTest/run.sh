@@ -0,0 +1,27 @@
+#!/bin/sh
+# Runs the lines in simplecommands.txt 10 times and then 1000 times with malloccount.so preloaded
+# Once the first line has sized the arena and the line buffer a line should not malloc at all, so both counts should be the same
+# Run from the top of the repo after make: sh testfolder/arenaTest/run.sh
+
+dir=testfolder/arenaTest
+gcc -shared -fPIC -O2 $dir/malloccount.c -o /tmp/malloccount.so || exit 1
+
+for n in 10 1000; do
+    rm -f /tmp/arenaTest$n.txt
+    i=0
+    while [ $i -lt $n ]; do
+        cat $dir/simplecommands.txt >> /tmp/arenaTest$n.txt
+        i=$((i + 1))
+    done
+done
+
+short=$(cd $dir && LD_PRELOAD=/tmp/malloccount.so ../../mysh /tmp/arenaTest10.txt 2>&1 >/dev/null | grep allocations)
+long=$(cd $dir && LD_PRELOAD=/tmp/malloccount.so ../../mysh /tmp/arenaTest1000.txt 2>&1 >/dev/null | grep allocations)
+echo "10 times:   $short"
+echo "1000 times: $long"
+if [ "$short" = "$long" ]; then
+    echo "Test passed, no malloc per line"
+else
+    echo "Test failed, the count grows with the number of lines"
+    exit 1
+fi
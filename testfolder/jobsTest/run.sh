@@ -0,0 +1,21 @@
+#!/bin/sh
+# Types lines into an interactive mysh, script gives it a pty so the shell has a terminal like at a real prompt
+# A line that runs in the background must leave the terminal with the shell: once the job is done the prompt
+# still has to read the next line instead of failing with an Input/output error
+# Run from the top of the repo after make: sh testfolder/jobsTest/run.sh
+
+status=0
+for line in 'parallel -j 2 sleep {} ::: 1 1 &' 'sleep 1 | cat &'; do
+    out=$( (echo "$line"; sleep 2; echo 'echo still here'; sleep 1; echo exit; sleep 1) | script -qfc ./mysh /dev/null | tr -d '\r')
+    if echo "$out" | grep -q '^still here'; then
+        echo "passed: $line"
+    else
+        echo "failed: $line"
+        echo "$out"
+        status=1
+    fi
+done
+if [ $status -eq 0 ]; then
+    echo "Test passed, the shell kept the terminal"
+fi
+exit $status
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "timing.h"
+
+static long long timing_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long timing_us(struct timeval tv) {
+    return (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/* Get ready to time the line cmd (its wildcards already expanded), the stages come from arena
+* Returns 0 for success, 1 if the arena is out of memory
+*/
+int timing_init(timing_t *t, command_t *cmd, arena_t *arena, int json) {
+    t->json = json;
+    t->stageCount = 0;
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next) {
+        t->stageCount++;
+    }
+    t->stages = arena_alloc(arena, t->stageCount * sizeof(timing_stage_t));
+    if (t->stages == NULL) {
+        return 1;
+    }
+    int i = 0;
+    for (command_t *stage = cmd; stage != NULL; stage = stage->next, i++) {
+        memset(&t->stages[i], 0, sizeof(timing_stage_t));
+        t->stages[i].name = stage->args->data[0];
+        t->stages[i].pid = -1;
+        t->stages[i].status = 1 << 8; // Exit status 1 if it never starts
+    }
+    t->startNs = timing_now();
+    t->endNs = 0;
+    return 0;
+}
+
+void timing_started(timing_t *t, int stage, pid_t pid) {
+    t->stages[stage].pid = pid;
+    t->stages[stage].startNs = timing_now();
+}
+
+void timing_reaped(timing_t *t, pid_t pid, int status, const struct rusage *ru) {
+    for (int i = 0; i < t->stageCount; i++) {
+        if (t->stages[i].pid == pid) {
+            t->stages[i].endNs = timing_now();
+            t->stages[i].status = status;
+            t->stages[i].ru = *ru;
+            return;
+        }
+    }
+}
+
+// A builtin stage that ran on a thread of the shell, called by that thread with its RUSAGE_THREAD
+void timing_ended(timing_t *t, int stage, int exitStatus, const struct rusage *ru) {
+    t->stages[stage].endNs = timing_now();
+    t->stages[stage].status = (exitStatus & 0xff) << 8;
+    t->stages[stage].ru = *ru;
+}
+
+void timing_self_begin(timing_t *t) {
+    getrusage(RUSAGE_SELF, &t->selfBefore);
+    t->stages[0].pid = 0;
+    t->stages[0].startNs = timing_now();
+}
+
+void timing_self_end(timing_t *t, int exitStatus) {
+    struct rusage after;
+    getrusage(RUSAGE_SELF, &after);
+    timing_stage_t *s = &t->stages[0];
+    s->endNs = timing_now();
+    s->status = (exitStatus & 0xff) << 8;
+    long long user = timing_us(after.ru_utime) - timing_us(t->selfBefore.ru_utime);
+    long long sys = timing_us(after.ru_stime) - timing_us(t->selfBefore.ru_stime);
+    s->ru.ru_utime.tv_sec = user / 1000000;
+    s->ru.ru_utime.tv_usec = user % 1000000;
+    s->ru.ru_stime.tv_sec = sys / 1000000;
+    s->ru.ru_stime.tv_usec = sys % 1000000;
+    s->ru.ru_maxrss = after.ru_maxrss;
+}
+
+// Exit status the way prevExitStatus counts it, -1 for a stage that never got reaped (a background line)
+static int timing_exit(const timing_stage_t *s) {
+    if (s->endNs == 0) {
+        return -1;
+    }
+    return WIFEXITED(s->status) ? WEXITSTATUS(s->status) : 1;
+}
+
+static void timing_json_string(const char *s) {
+    fputc('"', stderr);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(stderr, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(stderr, "\\u%04x", c);
+        } else {
+            fputc(c, stderr);
+        }
+    }
+    fputc('"', stderr);
+}
+
+/* Print the report for the line that just ran, one line per stage and one for the whole line, nothing if it never ran
+* User and system time of the line are the sums over its stages, max RSS the biggest one
+*/
+void timing_report(timing_t *t) {
+    int ran = 0;
+    for (int i = 0; i < t->stageCount; i++) {
+        ran |= (t->stages[i].startNs != 0);
+    }
+    if (!ran) {
+        return; // Skipped by and/or
+    }
+    t->endNs = timing_now();
+    long long user = 0, sys = 0;
+    long maxrss = 0;
+    for (int i = 0; i < t->stageCount; i++) {
+        timing_stage_t *s = &t->stages[i];
+        user += timing_us(s->ru.ru_utime);
+        sys += timing_us(s->ru.ru_stime);
+        if (s->ru.ru_maxrss > maxrss) {
+            maxrss = s->ru.ru_maxrss;
+        }
+    }
+    timing_stage_t *last = &t->stages[t->stageCount - 1];
+    fflush(stdout);
+
+    if (t->json) {
+        fprintf(stderr, "{\"real_ns\":%lld,\"user_us\":%lld,\"sys_us\":%lld,\"maxrss_kb\":%ld,\"status\":%d,\"stages\":[",
+                t->endNs - t->startNs, user, sys, maxrss, timing_exit(last));
+        for (int i = 0; i < t->stageCount; i++) {
+            timing_stage_t *s = &t->stages[i];
+            fprintf(stderr, "%s{\"cmd\":", i ? "," : "");
+            timing_json_string(s->name);
+            fprintf(stderr, ",\"pid\":%d,\"real_ns\":%lld,\"user_us\":%lld,\"sys_us\":%lld,\"maxrss_kb\":%ld,\"status\":%d}",
+                    (int)s->pid, s->endNs ? s->endNs - s->startNs : 0, timing_us(s->ru.ru_utime),
+                    timing_us(s->ru.ru_stime), s->ru.ru_maxrss, timing_exit(s));
+        }
+        fprintf(stderr, "]}\n");
+        return;
+    }
+
+    // A single stage only gets its own line when there is something to say about it that the total does not
+    int detail = t->stageCount > 1 || last->pid < 0 || last->endNs == 0;
+    for (int i = 0; i < t->stageCount && detail; i++) {
+        timing_stage_t *s = &t->stages[i];
+        if (s->pid < 0) {
+            fprintf(stderr, "  %-12s did not start\n", s->name);
+        } else if (s->endNs == 0) {
+            fprintf(stderr, "  %-12s still running\n", s->name);
+        } else {
+            fprintf(stderr, "  %-12s real %.3fs  user %.3fs  sys %.3fs  maxrss %ld KB  status %d\n", s->name,
+                    (s->endNs - s->startNs) / 1e9, timing_us(s->ru.ru_utime) / 1e6, timing_us(s->ru.ru_stime) / 1e6,
+                    s->ru.ru_maxrss, timing_exit(s));
+        }
+    }
+    fprintf(stderr, "real %.3fs  user %.3fs  sys %.3fs  maxrss %ld KB\n",
+            (t->endNs - t->startNs) / 1e9, user / 1e6, sys / 1e6, maxrss);
+}
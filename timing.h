@@ -0,0 +1,43 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "arena.h"
+#include "command.h"
+
+/*
+ * What the time prefix measures for one line: wall time for the line and for every stage (from its start until it
+ * was reaped), and user/system time and max RSS from wait4 for the stages that are children
+ * A builtin that runs inside the shell gets the difference of getrusage(RUSAGE_SELF) around it instead,
+ * its max RSS is the shell's own since that one can not be diffed
+ * The report goes to stderr like bash's time, as text or as one line of JSON
+ */
+
+typedef struct {
+    const char *name;
+    pid_t pid;              // 0 for a builtin that ran in the shell (alone or on a thread), -1 if the stage never started
+    int status;             // Wait status
+    long long startNs;
+    long long endNs;        // 0 until it is reaped
+    struct rusage ru;
+} timing_stage_t;
+
+typedef struct {
+    int json;
+    int stageCount;
+    timing_stage_t *stages;
+    long long startNs;
+    long long endNs;
+    struct rusage selfBefore;   // Around a builtin run in the shell
+} timing_t;
+
+int timing_init(timing_t *t, command_t *cmd, arena_t *arena, int json);
+void timing_started(timing_t *t, int stage, pid_t pid);
+void timing_reaped(timing_t *t, pid_t pid, int status, const struct rusage *ru);
+void timing_ended(timing_t *t, int stage, int exitStatus, const struct rusage *ru);
+void timing_self_begin(timing_t *t);
+void timing_self_end(timing_t *t, int exitStatus);
+void timing_report(timing_t *t);
+
+#endif
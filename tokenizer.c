@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "tokenizer.h"
+#include "scan.h"
+
+static token_kind_t tok_kind(const char *s, unsigned int len) {
+    if (len == 1) {
+        switch (s[0]) {
+            case '<': return TOK_LT;
+            case '>': return TOK_GT;
+            case '|': return TOK_PIPE;
+            case '&': return TOK_AMP;
+        }
+    } else if (s[0] == '<' && s[1] == '<') {
+        return (len >= 3 && s[2] == '<') ? TOK_HERESTR : TOK_HEREDOC;
+    } else if (len == 2 && s[0] == 'o' && s[1] == 'r') {
+        return TOK_OR;
+    } else if (len == 3 && s[0] == 'a' && s[1] == 'n' && s[2] == 'd') {
+        return TOK_AND;
+    }
+    return TOK_WORD;
+}
+
+/* The list keeps its storage between lines, so once it has seen the longest line it never mallocs again
+* Up to TOK_INLINE tokens fit in the list itself, cap is how many it should have room for from the start
+* Returns 0 for success, 1 if the storage could not be allocated
+*/
+int tok_init(toklist_t *l, unsigned int cap) {
+    tokvec_init(l, NULL);
+    return tokvec_reserve(l, cap);
+}
+
+int tok_destroy(toklist_t *l) {
+    tokvec_destroy(l);
+    return 0;
+}
+
+static inline int tok_push(toklist_t *l, unsigned int offset, unsigned int length, token_kind_t kind) {
+    token_t t = {offset, length, kind};
+    return tokvec_push(l, t);
+}
+
+/* Replace the tokens in list with the ones in line[0..linelen), a # starts a comment that runs to the end of the line
+* line has to be writable and line[linelen] has to exist, the '\0' after the last token goes there
+* scan_classify gives us 64 bytes of whitespace and stop bits at once, the words are then found by counting bits
+* Tokens can be any length. Returns 0 for success, 1 if the list could not grow (the tokens found so far are kept)
+*/
+int tok_split(toklist_t *l, char *line, unsigned int linelen) {
+    l->length = 0;
+    line[linelen] = '\0';
+
+    unsigned int base = 0;  // Where the block the masks describe starts
+    uint64_t stop;
+    uint64_t space = scan_classify(line, linelen, &stop);
+    unsigned int i = 0;
+    unsigned int start = 0;
+    int inWord = 0;
+    for (;;) {
+        // Outside a word we look for the next byte that is not whitespace, inside one for the next stop byte
+        uint64_t bits = (inWord ? stop : ~space) >> (i - base);
+        if (bits == 0) {
+            i = base + 64;
+        } else {
+            i += __builtin_ctzll(bits);
+            if (!inWord) {
+                if (i >= linelen || line[i] == '#' || line[i] == '\0') {
+                    return 0; // '#', the end of the line, or a stray '\0' which ends the line like it used to
+                }
+                start = i;
+                inWord = 1;
+            } else {
+                // A '#' right after a word ends the line too
+                int last = (i >= linelen || line[i] == '#' || line[i] == '\0');
+                line[i] = '\0';
+                if (tok_push(l, start, i - start, tok_kind(line + start, i - start)) != 0) {
+                    return 1;
+                }
+                if (last) {
+                    return 0;
+                }
+                inWord = 0;
+                i++;
+            }
+        }
+        if (i - base >= 64) {
+            base += 64;
+            space = scan_classify(line + base, linelen - base, &stop);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include "vec.h"
+
+/*
+ * Splits a line into tokens without copying anything
+ * A token is a slice of the line (offset and length) with its kind already worked out, so the parser can switch
+ * on the kind instead of strcmp'ing every word against < > | & and or. The byte after every token is overwritten
+ * with a '\0', so line + offset is also a normal C string that can go straight into argv
+ */
+
+// TOK_HEREDOC is << (or <<EOF with the word stuck on), TOK_HERESTR is <<< (or <<<word)
+typedef enum { TOK_WORD, TOK_LT, TOK_GT, TOK_PIPE, TOK_AND, TOK_OR, TOK_AMP, TOK_HEREDOC, TOK_HERESTR } token_kind_t;
+
+typedef struct {
+    unsigned int offset;    // Where the token starts in the line
+    unsigned int length;    // Bytes in the token, not counting the '\0' we put after it
+    token_kind_t kind;
+} token_t;
+
+// The tokens of the current line, a line with more than TOK_INLINE of them moves to malloc'd storage that is then kept
+#define TOK_INLINE 40
+VEC_DEFINE(tokvec, token_t, TOK_INLINE)
+typedef tokvec_t toklist_t;
+
+int tok_init(toklist_t *list, unsigned int cap);
+int tok_destroy(toklist_t *list);
+int tok_split(toklist_t *list, char *line, unsigned int linelen);
+
+#endif
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "trace.h"
+
+#define TRACE_BUFSIZE (64 * 1024)
+#define TRACE_EVENT_MAX 1024    // Longest event we write, details get cut to fit
+
+int traceEnabled = 0;
+unsigned long traceLine = 0;
+
+static int traceFd = -1;
+static pid_t tracePid;          // Forked children inherit the buffer, only the shell itself writes it out
+static long long traceStart;
+static char traceBuf[TRACE_BUFSIZE];
+static size_t traceUsed = 0;
+static int traceEvents = 0;
+
+long long trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void trace_flush(void) {
+    size_t off = 0;
+    while (off < traceUsed) {
+        ssize_t n = write(traceFd, traceBuf + off, traceUsed - off);
+        if (n <= 0) {
+            traceEnabled = 0; // Disk full or the like, stop tracing rather than stop the shell
+            break;
+        }
+        off += n;
+    }
+    traceUsed = 0;
+}
+
+static void trace_close(void) {
+    if (getpid() != tracePid || traceFd < 0) {
+        return;
+    }
+    const char *end = "\n]\n";
+    memcpy(traceBuf + traceUsed, end, strlen(end)); // trace_emit always leaves room for this
+    traceUsed += strlen(end);
+    trace_flush();
+    close(traceFd);
+    traceFd = -1;
+    traceEnabled = 0;
+}
+
+/* Start tracing into path, the events are written out at exit (and whenever the buffer is full)
+* Returns 0 for success, 1 if the file could not be opened (tracing stays off)
+*/
+int trace_open(const char *path) {
+    traceFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (traceFd < 0) {
+        perror("MYSH_TRACE");
+        return 1;
+    }
+    tracePid = getpid();
+    traceStart = trace_now();
+    traceUsed = 0;
+    traceUsed += snprintf(traceBuf, TRACE_BUFSIZE, "[\n");
+    traceEnabled = 1;
+    atexit(trace_close);
+    return 0;
+}
+
+// Copy s into out as the inside of a JSON string, at most room bytes, returns how many were written
+static size_t trace_escape(char *out, size_t room, const char *s) {
+    size_t n = 0;
+    for (; *s && n + 7 < room; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            out[n++] = '\\';
+            out[n++] = c;
+        } else if (c < 0x20) {
+            n += snprintf(out + n, room - n, "\\u%04x", c);
+        } else {
+            out[n++] = c;
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+/* One complete ("X") event from startNs to endNs
+* tid 0 puts it on the shell's own track, a child's pid gives it a track of its own
+*/
+void trace_emit(const char *name, long long startNs, long long endNs, int tid, const char *detail) {
+    if (getpid() != tracePid) {
+        return; // A forked builtin stage, its events would be lost with its copy of the buffer anyway
+    }
+    if (traceUsed + TRACE_EVENT_MAX + 8 > TRACE_BUFSIZE) {
+        trace_flush();
+    }
+    char *out = traceBuf + traceUsed;
+    int n = snprintf(out, TRACE_EVENT_MAX,
+                     "%s{\"name\":\"%s\",\"cat\":\"mysh\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                     "\"args\":{\"line\":%lu",
+                     traceEvents ? ",\n" : "", name, (startNs - traceStart) / 1000.0, (endNs - startNs) / 1000.0,
+                     (int)tracePid, tid ? tid : (int)tracePid, traceLine);
+    if (detail != NULL) {
+        n += snprintf(out + n, TRACE_EVENT_MAX - n, ",\"detail\":\"");
+        n += trace_escape(out + n, TRACE_EVENT_MAX - n - 8, detail);
+        out[n++] = '"';
+    }
+    out[n++] = '}';
+    out[n++] = '}';
+    traceUsed += n;
+    traceEvents++;
+}
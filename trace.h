@@ -0,0 +1,34 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * MYSH_TRACE=file writes a span for every phase of every line (read, tokenize, parse, glob, resolve, spawn,
+ * builtin, wait) and one per pipeline stage from its start until it was reaped, in Chrome trace event format
+ * so it opens in Perfetto (ui.perfetto.dev) or chrome://tracing
+ * When it is off a span costs one well predicted branch at each end and nothing else, no clock read and no allocation
+ * The events go through one static buffer that is written out when it fills up and when the shell exits
+ */
+
+extern int traceEnabled;
+extern unsigned long traceLine;     // Line being run, every event of the line gets it as an arg
+
+int trace_open(const char *path);
+long long trace_now(void);
+void trace_emit(const char *name, long long startNs, long long endNs, int tid, const char *detail);
+
+// Start of a span, 0 when tracing is off
+static inline long long trace_begin(void) {
+    if (__builtin_expect(traceEnabled, 0)) {
+        return trace_now();
+    }
+    return 0;
+}
+
+// End of a span that started at start, on the shell's own track, detail is an extra string arg or NULL
+static inline void trace_end(const char *name, long long start, const char *detail) {
+    if (__builtin_expect(traceEnabled, 0)) {
+        trace_emit(name, start, trace_now(), 0, detail);
+    }
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef VEC_H
+#define VEC_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/*
+ * Growable arrays of any type with room for the first N elements inside the struct itself,
+ * so a short one (most argvs, most token lists) never allocates anything
+ * VEC_DEFINE(name, type, N) makes name_t and these, all static inline:
+ *   name_init(v, arena)        empty, in the inline room, anything bigger comes from arena (malloc when arena is NULL)
+ *   name_reserve(v, n)         room for n elements in total
+ *   name_push(v, x)            append one
+ *   name_extend(v, xs, n)      append n at once, with at most one grow
+ *   name_truncate(v, n)        drop everything from n on
+ *   name_destroy(v)            free malloc'd storage, there is nothing to do for inline or arena storage
+ * The ones that can grow return 0 for success, 1 if the storage could not be allocated (the vector is unchanged then)
+ * Growing doubles the capacity, or goes straight to what is needed if that is more. Arena storage that is left behind
+ * stays in the arena until it is reset, like with al_init_arena
+ * While the inline room is in use data points into the struct, so a vector must not be copied or moved once it is set up
+ */
+
+#define VEC_DEFINE(name, type, N)                                                                       \
+typedef struct {                                                                                        \
+    type *data;                                                                                         \
+    unsigned int length;                                                                                \
+    unsigned int capacity;                                                                              \
+    arena_t *arena;                                                                                     \
+    type inl[N];                                                                                        \
+} name##_t;                                                                                             \
+                                                                                                        \
+static inline void name##_init(name##_t *v, arena_t *arena) {                                           \
+    v->data = v->inl;                                                                                   \
+    v->length = 0;                                                                                      \
+    v->capacity = N;                                                                                    \
+    v->arena = arena;                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+static inline int name##_grow(name##_t *v, unsigned int need) {                                         \
+    unsigned int cap = v->capacity * 2;                                                                 \
+    if (cap < need) {                                                                                   \
+        cap = need;                                                                                     \
+    }                                                                                                   \
+    type *grown;                                                                                        \
+    if (v->arena != NULL || v->data == v->inl) {                                                        \
+        grown = (v->arena != NULL) ? arena_alloc(v->arena, cap * sizeof(type)) : malloc(cap * sizeof(type)); \
+        if (grown != NULL) {                                                                            \
+            memcpy(grown, v->data, v->length * sizeof(type));                                           \
+        }                                                                                               \
+    } else {                                                                                            \
+        grown = realloc(v->data, cap * sizeof(type));                                                   \
+    }                                                                                                   \
+    if (grown == NULL) {                                                                                \
+        return 1;                                                                                       \
+    }                                                                                                   \
+    v->data = grown;                                                                                    \
+    v->capacity = cap;                                                                                  \
+    return 0;                                                                                           \
+}                                                                                                       \
+                                                                                                        \
+static inline int name##_reserve(name##_t *v, unsigned int n) {                                         \
+    return (n <= v->capacity) ? 0 : name##_grow(v, n);                                                  \
+}                                                                                                       \
+                                                                                                        \
+static inline int name##_push(name##_t *v, type x) {                                                    \
+    if (__builtin_expect(v->length == v->capacity, 0) && name##_grow(v, v->length + 1) != 0) {          \
+        return 1;                                                                                       \
+    }                                                                                                   \
+    v->data[v->length++] = x;                                                                           \
+    return 0;                                                                                           \
+}                                                                                                       \
+                                                                                                        \
+static inline int name##_extend(name##_t *v, type const *xs, unsigned int n) {                          \
+    if (name##_reserve(v, v->length + n) != 0) {                                                        \
+        return 1;                                                                                       \
+    }                                                                                                   \
+    memcpy(v->data + v->length, xs, n * sizeof(type));                                                  \
+    v->length += n;                                                                                     \
+    return 0;                                                                                           \
+}                                                                                                       \
+                                                                                                        \
+static inline void name##_truncate(name##_t *v, unsigned int n) {                                       \
+    if (n < v->length) {                                                                                \
+        v->length = n;                                                                                  \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+static inline void name##_destroy(name##_t *v) {                                                        \
+    if (v->arena == NULL && v->data != v->inl) {                                                        \
+        free(v->data);                                                                                  \
+    }                                                                                                   \
+    name##_init(v, v->arena);                                                                           \
+}
+
+// Lists of strings, an argv is a strvec_t with a NULL pushed at the end (finalizeArgs), 8 covers most command lines
+VEC_DEFINE(strvec, char *, 8)
+
+#endif
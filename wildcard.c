@@ -0,0 +1,575 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "dirwalk.h"
+#include "wildcard.h"
+
+#define WILD_CACHE_SIZE 32      // Directories whose listing we keep
+#define WILD_PATH_MAX 4096
+
+/*
+ * Compiled pattern, one per path component
+ * Every op matches one character (a literal, ? or a [...] class) or a run of them (*)
+ */
+
+enum { OP_LIT, OP_ANY, OP_CLASS, OP_STAR };
+
+typedef struct {
+    unsigned char kind;
+    unsigned char ch;           // OP_LIT
+    unsigned short cls;         // OP_CLASS, index into classes
+} wild_op_t;
+
+typedef struct {
+    const char *text;           // The component as written
+    size_t length;
+    int magic;                  // 0 means a plain name, it is used as it is without reading the directory
+    int recursive;              // The component is exactly **, any number of directories
+    wild_op_t *ops;
+    int opCount;
+    unsigned char (*classes)[32]; // One bit per byte value
+} wild_comp_t;
+
+/*
+ * Cached listing of one directory, the names all live in one block
+ */
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    int trusted;                // 0 if the directory changed so close to when we read it that the mtime could miss a change
+    unsigned long lastUse;
+    int count;
+    char **names;
+    unsigned char *types;       // d_type of every name
+    char *pool;
+} wild_dir_t;
+
+static wild_dir_t *dirCache[WILD_CACHE_SIZE];
+static unsigned long useClock = 0;
+
+int wild_has_magic(const char *word) {
+    return strpbrk(word, "*?[") != NULL;
+}
+
+// [...] starting at p (just past the '['), fills bits and returns how much of p it took, 0 if there is no closing ]
+static size_t wild_parse_class(const char *p, size_t len, unsigned char bits[32]) {
+    size_t i = 0;
+    int negate = 0;
+    memset(bits, 0, 32);
+    if (i < len && (p[i] == '!' || p[i] == '^')) {
+        negate = 1;
+        i++;
+    }
+    size_t first = i;
+    while (i < len && (p[i] != ']' || i == first)) { // A ] right at the start is just a ]
+        unsigned char lo = p[i], hi = p[i];
+        if (i + 2 < len && p[i + 1] == '-' && p[i + 2] != ']') {
+            hi = p[i + 2];
+            i += 2;
+        }
+        for (unsigned int c = lo; c <= hi; c++) {
+            bits[c >> 3] |= 1 << (c & 7);
+        }
+        i++;
+    }
+    if (i >= len) {
+        return 0;
+    }
+    if (negate) {
+        for (int b = 0; b < 32; b++) {
+            bits[b] = ~bits[b];
+        }
+    }
+    return i + 1;
+}
+
+static int wild_compile(wild_comp_t *comp, arena_t *arena) {
+    comp->ops = arena_alloc(arena, (comp->length + 1) * sizeof(wild_op_t));
+    comp->classes = arena_alloc(arena, (comp->length / 2 + 1) * 32);
+    if (comp->ops == NULL || comp->classes == NULL) {
+        return 1;
+    }
+    int classCount = 0;
+    comp->opCount = 0;
+    comp->magic = 0;
+    comp->recursive = (comp->length == 2 && comp->text[0] == '*' && comp->text[1] == '*');
+    for (size_t i = 0; i < comp->length; i++) {
+        wild_op_t *op = &comp->ops[comp->opCount];
+        char c = comp->text[i];
+        if (c == '*') {
+            comp->magic = 1;
+            if (comp->opCount > 0 && op[-1].kind == OP_STAR) {
+                continue; // ** next to anything else in a component is the same as *
+            }
+            op->kind = OP_STAR;
+        } else if (c == '?') {
+            comp->magic = 1;
+            op->kind = OP_ANY;
+        } else if (c == '[') {
+            size_t used = wild_parse_class(comp->text + i + 1, comp->length - i - 1, comp->classes[classCount]);
+            if (used == 0) {
+                op->kind = OP_LIT; // No closing ], the [ is just a character
+                op->ch = c;
+            } else {
+                comp->magic = 1;
+                op->kind = OP_CLASS;
+                op->cls = classCount++;
+                i += used;
+            }
+        } else {
+            op->kind = OP_LIT;
+            op->ch = c;
+        }
+        comp->opCount++;
+    }
+    return 0;
+}
+
+// Runs the ops against name, a * that fails to match is retried one character further along
+static int wild_match(const wild_comp_t *comp, const char *name) {
+    const wild_op_t *ops = comp->ops;
+    int count = comp->opCount;
+    if (name[0] == '.' && (count == 0 || ops[0].kind != OP_LIT || ops[0].ch != '.')) {
+        return 0; // Hidden names only match a pattern that asks for the dot
+    }
+    int pi = 0, starPi = -1;
+    const char *s = name, *starS = NULL;
+    while (*s) {
+        if (pi < count) {
+            const wild_op_t *op = &ops[pi];
+            unsigned char c = *s;
+            if (op->kind == OP_STAR) {
+                starPi = pi++;
+                starS = s;
+                continue;
+            }
+            if (op->kind == OP_ANY || (op->kind == OP_LIT && op->ch == c) ||
+                (op->kind == OP_CLASS && (comp->classes[op->cls][c >> 3] & (1 << (c & 7))))) {
+                pi++;
+                s++;
+                continue;
+            }
+        }
+        if (starPi < 0) {
+            return 0;
+        }
+        pi = starPi + 1;
+        s = ++starS;
+    }
+    while (pi < count && ops[pi].kind == OP_STAR) {
+        pi++;
+    }
+    return pi == count;
+}
+
+static void wild_free_dir(wild_dir_t *d) {
+    free(d->names);
+    free(d->types);
+    free(d->pool);
+    free(d);
+}
+
+// Read the whole directory into one listing, NULL if it can not be opened
+static wild_dir_t *wild_read_dir(const char *path, const struct stat *st) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return NULL;
+    }
+    wild_dir_t *d = calloc(1, sizeof(wild_dir_t));
+    size_t poolCap = 4096, poolLen = 0;
+    int cap = 64;
+    if (d != NULL) {
+        d->pool = malloc(poolCap);
+        d->names = malloc(cap * sizeof(char *));
+        d->types = malloc(cap);
+    }
+    if (d == NULL || d->pool == NULL || d->names == NULL || d->types == NULL) {
+        perror("malloc failed in wild_read_dir");
+        if (d != NULL) {
+            wild_free_dir(d);
+        }
+        closedir(dir);
+        return NULL;
+    }
+
+    // Names are kept as offsets until the pool stops moving, then turned into pointers
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name) + 1;
+        if (d->count == cap) {
+            cap *= 2;
+            char **names = realloc(d->names, cap * sizeof(char *));
+            unsigned char *types = names ? realloc(d->types, cap) : NULL;
+            if (names != NULL) {
+                d->names = names;
+            }
+            if (types == NULL) {
+                perror("realloc failed in wild_read_dir");
+                wild_free_dir(d);
+                closedir(dir);
+                return NULL;
+            }
+            d->types = types;
+        }
+        if (poolLen + len > poolCap) {
+            while (poolLen + len > poolCap) {
+                poolCap *= 2;
+            }
+            char *pool = realloc(d->pool, poolCap);
+            if (pool == NULL) {
+                perror("realloc failed in wild_read_dir");
+                wild_free_dir(d);
+                closedir(dir);
+                return NULL;
+            }
+            d->pool = pool;
+        }
+        memcpy(d->pool + poolLen, entry->d_name, len);
+        d->names[d->count] = (char *)poolLen;
+        d->types[d->count] = entry->d_type;
+        d->count++;
+        poolLen += len;
+    }
+    closedir(dir);
+    for (int i = 0; i < d->count; i++) {
+        d->names[i] = d->pool + (size_t)d->names[i];
+    }
+
+    d->dev = st->st_dev;
+    d->ino = st->st_ino;
+    d->mtime = st->st_mtim;
+    // mtimes are only as fine as the filesystem clock, a change in the same tick as our read would not move it
+    // so a listing read within 2 seconds of the last change is used this once and read again next time
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    d->trusted = (now.tv_sec > st->st_mtim.tv_sec + 2);
+    return d;
+}
+
+// The listing of path, from the cache if the directory has not changed since
+static wild_dir_t *wild_listing(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+    int slot = -1, oldest = 0;
+    for (int i = 0; i < WILD_CACHE_SIZE; i++) {
+        wild_dir_t *d = dirCache[i];
+        if (d == NULL) {
+            if (slot < 0) {
+                slot = i;
+            }
+            continue;
+        }
+        if (d->dev == st.st_dev && d->ino == st.st_ino) {
+            if (d->trusted && d->mtime.tv_sec == st.st_mtim.tv_sec && d->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+                d->lastUse = ++useClock;
+                return d;
+            }
+            wild_free_dir(d);
+            dirCache[i] = NULL;
+            slot = i;
+            break;
+        }
+        if (dirCache[oldest] == NULL || d->lastUse < dirCache[oldest]->lastUse) {
+            oldest = i;
+        }
+    }
+    if (slot < 0) {
+        wild_free_dir(dirCache[oldest]);
+        dirCache[oldest] = NULL;
+        slot = oldest;
+    }
+    wild_dir_t *d = wild_read_dir(path, &st);
+    if (d != NULL) {
+        d->lastUse = ++useClock;
+        dirCache[slot] = d;
+    }
+    return d;
+}
+
+// Whether path is a directory, d_type already says so unless it is a link or unknown
+static int wild_is_dir(unsigned char type, const char *path) {
+    if (type == DT_DIR) {
+        return 1;
+    }
+    if (type != DT_LNK && type != DT_UNKNOWN) {
+        return 0;
+    }
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+typedef struct {
+    wild_comp_t *comps;
+    int compCount;
+    int trailingSlash;          // The pattern ended in /, only directories match
+    arena_t *arena;
+    strvec_t *out;
+    int matches;
+    char path[WILD_PATH_MAX];   // What the matched components so far spell out, as it will be printed
+} wild_walk_t;
+
+static void wild_add(wild_walk_t *w, size_t len) {
+    char *match = arena_strndup(w->arena, w->path, len);
+    if (match == NULL || strvec_push(w->out, match) != 0) {
+        perror("arena_alloc failed in wild_expand");
+        exit(EXIT_FAILURE);
+    }
+    w->matches++;
+}
+
+static void wild_walk(wild_walk_t *w, int ci, size_t len);
+
+// What the dirwalk threads keep: names matching comp, and with dirsOnly only directories (with their /)
+typedef struct {
+    const wild_comp_t *comp;
+    int dirsOnly;
+} wild_tree_filter_t;
+
+static int wild_tree_filter(const void *ctx, const char *name, int isDir) {
+    const wild_tree_filter_t *f = ctx;
+    if (f->dirsOnly && !isDir) {
+        return DIRWALK_SKIP;
+    }
+    if (f->comp == NULL && name[0] == '.') {
+        return DIRWALK_SKIP; // ** does not stand for hidden directories, the walk does not go into them either
+    }
+    if (f->comp != NULL && !wild_match(f->comp, name)) {
+        return DIRWALK_SKIP;
+    }
+    return f->dirsOnly ? DIRWALK_KEEP_SLASH : DIRWALK_KEEP;
+}
+
+/*
+ * Component ci is **, it stands for the directory in w->path[0..len) and every directory under it
+ * The whole tree is read once by the dirwalk pool:
+ *  - ** as the last component keeps the directory and everything under it (only directories with a trailing /)
+ *  - ** followed by one last pattern component has that component matched by the threads as they read
+ *  - anything else collects the directories, then the rest of the pattern is walked from each of them
+ */
+static void wild_walk_tree(wild_walk_t *w, int ci, size_t len) {
+    int last = (ci == w->compCount - 1);
+    wild_comp_t *next = last ? NULL : &w->comps[ci + 1];
+    int direct = last || (ci + 1 == w->compCount - 1 && next->magic && !next->recursive);
+    wild_tree_filter_t filter;
+    filter.comp = last ? &w->comps[ci] : direct ? next : NULL;
+    filter.dirsOnly = direct ? w->trailingSlash : 1;
+
+    w->path[len] = '\0';
+    if (last && len > 0) {
+        // None of the directories is a match too, so d/** and d/**/ have d/ itself like bash
+        struct stat st;
+        if (stat(w->path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            wild_add(w, len);
+        }
+    }
+    dirwalk_result_t tree;
+    if (dirwalk(w->path, wild_tree_filter, &filter, &tree) != 0) {
+        perror("dirwalk failed in wild_expand");
+        exit(EXIT_FAILURE);
+    }
+    if (direct) {
+        if (strvec_reserve(w->out, w->out->length + tree.count) != 0) {
+            perror("arena_alloc failed in wild_expand");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < tree.count; i++) {
+            char *match = arena_strdup(w->arena, tree.paths[i]);
+            if (match == NULL || strvec_push(w->out, match) != 0) {
+                perror("arena_alloc failed in wild_expand");
+                exit(EXIT_FAILURE);
+            }
+            w->matches++;
+        }
+        dirwalk_free(&tree);
+        return;
+    }
+
+    // Zero directories first, the rest of the pattern right where ** is
+    char *dirs = arena_strndup(w->arena, w->path, len);
+    if (dirs == NULL) {
+        perror("arena_alloc failed in wild_expand");
+        exit(EXIT_FAILURE);
+    }
+    wild_walk(w, ci + 1, len);
+    for (size_t i = 0; i < tree.count; i++) {
+        size_t dirLen = strlen(tree.paths[i]);
+        if (dirLen + 2 >= WILD_PATH_MAX) {
+            continue;
+        }
+        memcpy(w->path, tree.paths[i], dirLen);
+        wild_walk(w, ci + 1, dirLen);
+    }
+    memcpy(w->path, dirs, len);
+    dirwalk_free(&tree);
+}
+
+// Match component ci and everything after it, w->path[0..len) is the directory it is in ("" for the current one)
+static void wild_walk(wild_walk_t *w, int ci, size_t len) {
+    wild_comp_t *comp = &w->comps[ci];
+    int last = (ci == w->compCount - 1);
+
+    if (comp->recursive) {
+        wild_walk_tree(w, ci, len);
+        return;
+    }
+    if (!comp->magic) {
+        // A plain name is not looked up in the listing, it just has to exist at the end
+        if (len + comp->length + 2 >= WILD_PATH_MAX) {
+            return;
+        }
+        memcpy(w->path + len, comp->text, comp->length);
+        len += comp->length;
+        if (!last) {
+            w->path[len] = '/';
+            wild_walk(w, ci + 1, len + 1);
+            return;
+        }
+        struct stat st;
+        w->path[len] = '\0';
+        if (lstat(w->path, &st) == 0 && (!w->trailingSlash || S_ISDIR(st.st_mode))) {
+            if (w->trailingSlash) {
+                w->path[len++] = '/';
+            }
+            wild_add(w, len);
+        }
+        return;
+    }
+
+    // The directory to list, without its last / (the root stays "/")
+    char dir[WILD_PATH_MAX];
+    if (len == 0) {
+        strcpy(dir, ".");
+    } else {
+        memcpy(dir, w->path, len);
+        dir[len > 1 ? len - 1 : len] = '\0';
+    }
+    wild_dir_t *d = wild_listing(dir);
+    if (d == NULL) {
+        return;
+    }
+    if (last) {
+        for (int i = 0; i < d->count; i++) {
+            if (!wild_match(comp, d->names[i])) {
+                continue;
+            }
+            size_t nameLen = strlen(d->names[i]);
+            if (len + nameLen + 2 >= WILD_PATH_MAX) {
+                continue;
+            }
+            memcpy(w->path + len, d->names[i], nameLen + 1);
+            if (!w->trailingSlash) {
+                wild_add(w, len + nameLen);
+            } else if (wild_is_dir(d->types[i], w->path)) {
+                w->path[len + nameLen] = '/';
+                wild_add(w, len + nameLen + 1);
+            }
+        }
+        return;
+    }
+
+    // Going deeper reads other directories, which can push this listing out of the cache,
+    // so the names that matched are copied out before walking into any of them
+    char **names = arena_alloc(w->arena, d->count * sizeof(char *) + 1);
+    unsigned char *types = arena_alloc(w->arena, d->count + 1);
+    if (names == NULL || types == NULL) {
+        perror("arena_alloc failed in wild_expand");
+        exit(EXIT_FAILURE);
+    }
+    int count = 0;
+    for (int i = 0; i < d->count; i++) {
+        if (wild_match(comp, d->names[i])) {
+            names[count] = arena_strdup(w->arena, d->names[i]);
+            if (names[count] == NULL) {
+                perror("arena_alloc failed in wild_expand");
+                exit(EXIT_FAILURE);
+            }
+            types[count++] = d->types[i];
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        size_t nameLen = strlen(names[i]);
+        if (len + nameLen + 2 >= WILD_PATH_MAX) {
+            continue;
+        }
+        memcpy(w->path + len, names[i], nameLen + 1);
+        if (wild_is_dir(types[i], w->path)) {
+            w->path[len + nameLen] = '/';
+            wild_walk(w, ci + 1, len + nameLen + 1);
+        }
+    }
+}
+
+static int wild_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Append every path that matches pattern to out, sorted, the strings come from arena
+* Returns how many there were, 0 means nothing matched (and nothing was added)
+*/
+int wild_expand(const char *pattern, arena_t *arena, strvec_t *out) {
+    wild_walk_t w;
+    size_t patLen = strlen(pattern);
+    w.comps = arena_alloc(arena, (patLen / 2 + 2) * sizeof(wild_comp_t));
+    if (w.comps == NULL) {
+        perror("arena_alloc failed in wild_expand");
+        exit(EXIT_FAILURE);
+    }
+    w.compCount = 0;
+    w.trailingSlash = 0;
+    w.arena = arena;
+    w.out = out;
+    w.matches = 0;
+
+    size_t start = 0, pathLen = 0;
+    if (pattern[0] == '/') {
+        w.path[pathLen++] = '/';
+        start = 1;
+    }
+    while (start < patLen) {
+        const char *slash = strchr(pattern + start, '/');
+        size_t end = slash ? (size_t)(slash - pattern) : patLen;
+        if (end > start) { // a//b is the same as a/b
+            wild_comp_t *comp = &w.comps[w.compCount++];
+            comp->text = pattern + start;
+            comp->length = end - start;
+            if (wild_compile(comp, arena) != 0) {
+                perror("arena_alloc failed in wild_expand");
+                exit(EXIT_FAILURE);
+            }
+            if (comp->recursive && w.compCount > 1 && comp[-1].recursive) {
+                w.compCount--; // **/** is the same as **
+            }
+        }
+        if (slash && end + 1 == patLen) {
+            w.trailingSlash = 1;
+        }
+        start = end + 1;
+    }
+    if (w.compCount == 0) {
+        return 0;
+    }
+
+    unsigned int first = out->length;
+    wild_walk(&w, 0, pathLen);
+    if (w.matches > 1) {
+        qsort(out->data + first, w.matches, sizeof(char *), wild_cmp);
+    }
+    return w.matches;
+}
+
+// Forget every cached listing
+void wild_flush(void) {
+    for (int i = 0; i < WILD_CACHE_SIZE; i++) {
+        if (dirCache[i] != NULL) {
+            wild_free_dir(dirCache[i]);
+            dirCache[i] = NULL;
+        }
+    }
+}
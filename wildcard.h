@@ -0,0 +1,19 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+#include "arena.h"
+#include "vec.h"
+
+/*
+ * Glob expansion for words with *, ? or [...] in them, in any component of the path (like test?/out[0-9].*)
+ * A pattern is compiled once into a small matcher per component, then run against the directory listings
+ * Listings are cached across lines, keyed on the device and inode of the directory and checked against its mtime,
+ * so a script that globs the same big directory over and over only reads it once
+ * Matches come back sorted, a leading . in a name is only matched by a pattern that starts with a . itself
+ */
+
+int wild_has_magic(const char *word);
+int wild_expand(const char *pattern, arena_t *arena, strvec_t *out);
+void wild_flush(void);
+
+#endif
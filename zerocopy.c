@@ -0,0 +1,251 @@
+#define _GNU_SOURCE // For splice, tee and copy_file_range
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h> // FICLONE
+#include "zerocopy.h"
+
+// What kind of fd we have, it decides which syscall can move the data
+enum { ZC_OTHER, ZC_PIPE, ZC_FILE };
+
+static int zc_kind(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return ZC_OTHER;
+    }
+    if (S_ISFIFO(st.st_mode)) {
+        return ZC_PIPE;
+    }
+    if (S_ISREG(st.st_mode)) {
+        return ZC_FILE;
+    }
+    return ZC_OTHER;
+}
+
+// Only errors that mean "this fd pair cant do it" send us to the read/write loop, anything else is a real error
+static int zc_unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == EXDEV;
+}
+
+static int zc_write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// The fallback, read a big chunk once and write it to every output
+static int zc_buffered(int in, const int *outs, int outCount) {
+    char buf[ZC_CHUNK];
+    for (;;) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        for (int i = 0; i < outCount; i++) {
+            if (zc_write_all(outs[i], buf, n) != 0) {
+                return -1;
+            }
+        }
+    }
+}
+
+// Move exactly len bytes with splice, one of the two has to be a pipe
+static int zc_splice_exact(int in, int out, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            errno = EIO; // The pipe ran dry in the middle of a chunk we already saw
+            return -1;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+/* Regular file to regular file: a reflink of the whole file when out is empty and both are at their start, the
+* filesystem (btrfs, XFS...) then shares the blocks and nothing gets copied at all, otherwise copy_file_range, which
+* keeps the data in the kernel, can reflink ranges too, and does the copy on the server for NFS
+* Returns 0 when everything was copied, -1 on an error, 1 if neither works for these two fds (nothing moved then)
+*/
+static int zc_file_range(int in, int out) {
+    int flags = fcntl(out, F_GETFL);
+    if (flags == -1 || (flags & O_APPEND)) {
+        return 1; // Both refuse a file opened in append mode
+    }
+    struct stat sin, sout;
+    if (fstat(in, &sin) == 0 && fstat(out, &sout) == 0 && sin.st_size > 0 && sout.st_size == 0 &&
+        lseek(in, 0, SEEK_CUR) == 0 && lseek(out, 0, SEEK_CUR) == 0 && ioctl(out, FICLONE, in) == 0) {
+        // The offsets end up where a copy would have left them
+        lseek(in, sin.st_size, SEEK_SET);
+        lseek(out, sin.st_size, SEEK_SET);
+        return 0;
+    }
+    int moved = 0;
+    for (;;) {
+        ssize_t n = copy_file_range(in, NULL, out, NULL, ZC_RANGE_CHUNK, 0);
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (moved || !zc_unsupported(errno)) {
+                return -1;
+            }
+            return 1;
+        }
+        moved = 1;
+    }
+}
+
+/* Copy in to out until EOF
+* copy_file_range (or a reflink) between two regular files, splice if either one is a pipe,
+* sendfile if in is a regular file, otherwise the read/write loop
+* If the kernel refuses the fast path before any byte moved we quietly take the loop instead
+*/
+int zc_copy(int in, int out) {
+    int kin = zc_kind(in);
+    int kout = zc_kind(out);
+    int moved = 0;
+
+    if (kin == ZC_PIPE || kout == ZC_PIPE) {
+        for (;;) {
+            ssize_t n = splice(in, NULL, out, NULL, ZC_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n == 0) {
+                return 0;
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (moved || !zc_unsupported(errno)) {
+                    return -1;
+                }
+                break;
+            }
+            moved = 1;
+        }
+    } else if (kin == ZC_FILE) {
+        int range = (kout == ZC_FILE) ? zc_file_range(in, out) : 1;
+        if (range <= 0) {
+            return range;
+        }
+        for (;;) {
+            ssize_t n = sendfile(out, in, NULL, ZC_CHUNK);
+            if (n == 0) {
+                return 0;
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (moved || !zc_unsupported(errno)) {
+                    return -1;
+                }
+                break;
+            }
+            moved = 1;
+        }
+    }
+    return zc_buffered(in, &out, 1);
+}
+
+/*
+ * Pipe input going to several outputs, the data never comes up to user space
+ * Per chunk: tee(2) peeks up to ZC_CHUNK bytes into our own empty pipe and that gets spliced to the first output,
+ * the outputs in the middle get the same bytes the same way, and the last one splices them straight out of in,
+ * which is what finally consumes the chunk. Every output has to be a pipe or a regular file not in append mode
+ */
+static int zc_tee_pipe(int in, const int *outs, int outCount) {
+    int tmp[2];
+    if (pipe2(tmp, O_CLOEXEC) != 0) {
+        return -1;
+    }
+    int result = 0;
+    for (;;) {
+        ssize_t n = tee(in, tmp[1], ZC_CHUNK, 0);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = -1;
+            break;
+        }
+        if (zc_splice_exact(tmp[0], outs[0], n) != 0) {
+            result = -1;
+            break;
+        }
+        for (int i = 1; i < outCount - 1 && result == 0; i++) {
+            ssize_t m;
+            do {
+                m = tee(in, tmp[1], n, 0); // tmp is empty again so the whole chunk fits
+            } while (m < 0 && errno == EINTR);
+            if (m != n) {
+                if (m >= 0) {
+                    errno = EIO;
+                }
+                result = -1;
+            } else if (zc_splice_exact(tmp[0], outs[i], n) != 0) {
+                result = -1;
+            }
+        }
+        if (result != 0 || zc_splice_exact(in, outs[outCount - 1], n) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    close(tmp[0]);
+    close(tmp[1]);
+    return result;
+}
+
+/* Copy in to every fd in outs until EOF, outCount has to be at least 1
+*/
+int zc_tee(int in, const int *outs, int outCount) {
+    if (outCount == 1) {
+        return zc_copy(in, outs[0]);
+    }
+
+    int fast = (zc_kind(in) == ZC_PIPE);
+    for (int i = 0; i < outCount && fast; i++) {
+        int kind = zc_kind(outs[i]);
+        int flags = fcntl(outs[i], F_GETFL);
+        // splice refuses files opened in append mode
+        if (kind == ZC_OTHER || (kind == ZC_FILE && (flags == -1 || (flags & O_APPEND)))) {
+            fast = 0;
+        }
+    }
+    if (fast) {
+        return zc_tee_pipe(in, outs, outCount);
+    }
+    return zc_buffered(in, outs, outCount);
+}
@@ -0,0 +1,18 @@
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+/*
+ * Moving bytes between fds without pulling them through our own buffers when the kernel lets us
+ * a reflink or copy_file_range between two regular files, splice when either side is a pipe, sendfile when the input
+ * is a regular file, tee(2) to copy a pipe to several places, and a big read/write loop for everything else
+ * (terminals, append mode files...)
+ * Both return 0 at EOF, -1 with errno set on an error, and copy from/to the current file offsets
+ */
+
+#define ZC_CHUNK (128 * 1024) // Bytes per splice/sendfile call and size of the fallback buffer
+#define ZC_RANGE_CHUNK (1024 * 1024 * 1024) // Bytes per copy_file_range call, nothing comes through us so it can be big
+
+int zc_copy(int in, int out);
+int zc_tee(int in, const int *outs, int outCount);
+
+#endif